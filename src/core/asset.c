@@ -378,6 +378,21 @@ const char* asset_path(const char* virtual_path)
     return virtual_path;
 }
 
+/*
+ * asset_mkdir()
+ * Create a directory (and any parent directories as needed) in the
+ * user-modifiable data folder, given its virtual path.
+ * Returns true on success or if the directory already exists
+ */
+bool asset_mkdir(const char* virtual_path)
+{
+    if(PHYSFS_mkdir(virtual_path))
+        return true;
+
+    LOG("Can't create directory %s. %s", virtual_path, PHYSFSx_getLastErrorMessage());
+    return false;
+}
+
 /*
  * asset_foreach_file()
  * Enumerate files.
@@ -30,6 +30,7 @@ bool asset_is_init();
 
 bool asset_exists(const char* virtual_path);
 const char* asset_path(const char* virtual_path);
+bool asset_mkdir(const char* virtual_path);
 void asset_foreach_file(const char* virtual_path_of_directory, const char* extension_filter, int (*callback)(const char* virtual_path, void* user_data), void* user_data, bool recursive);
 
 char* asset_user_datadir(char* dest, size_t dest_size);
@@ -22,6 +22,7 @@
 #include "audio.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "prefetch.h"
 #include "logfile.h"
 #include "timer.h"
 #include "video.h"
@@ -302,7 +303,7 @@ sound_t *sound_load(const char *path)
         s->valid_id = false;
         s->volume = 1.0f;
         s->filepath = str_dup(path);
-        if(NULL == (s->sample = al_load_sample(fullpath)))
+        if(NULL == (s->sample = prefetch_claim_sample(path)) && NULL == (s->sample = al_load_sample(fullpath)))
             fatal_error("Can't load sound \"%s\"", path);
 
         /* compute its duration */
@@ -318,6 +319,7 @@ sound_t *sound_load(const char *path)
     else
         resourcemanager_ref_sample(path);
 
+    prefetch_record_sample(path);
     return s;
 }
 
@@ -78,10 +78,15 @@ commandline_t commandline_parse(int argc, char **argv)
 
     cmd.mobile = COMMANDLINE_UNDEFINED;
     cmd.verbose = COMMANDLINE_UNDEFINED;
+    cmd.single_threaded = COMMANDLINE_UNDEFINED;
+    cmd.benchmark_jobs = COMMANDLINE_UNDEFINED;
+    cmd.pipelined_present = COMMANDLINE_UNDEFINED;
+    cmd.verify_jobs = COMMANDLINE_UNDEFINED;
 
     cmd.custom_level_path[0] = '\0';
     cmd.custom_quest_path[0] = '\0';
     cmd.language_filepath[0] = '\0';
+    cmd.renderstats_filepath[0] = '\0';
     cmd.gamedir[0] = '\0';
 
     cmd.user_argv = NULL;
@@ -121,6 +126,11 @@ commandline_t commandline_parse(int argc, char **argv)
                 "    --import-wizard                  import an Open Surge game using a wizard\n"
                 "    --mobile                         enable mobile device simulation\n"
                 "    --verbose                        print logs to stdout\n"
+                "    --render-stats \"filepath\"        export rendering statistics of each frame to a CSV file\n"
+                "    --single-threaded                run all jobs on the main thread (deterministic)\n"
+                "    --benchmark-jobs                 measure the overhead of the job system and log the results\n"
+                "    --verify-jobs                    replay parallel updates serially and crash if the results differ\n"
+                "    --pipelined-present              flip the display on a separate thread (experimental)\n"
                 "    -- -arg1 -arg2 -arg3...          user-defined arguments (useful for scripting)",
                 GAME_HEADER, program
             );
@@ -195,6 +205,18 @@ commandline_t commandline_parse(int argc, char **argv)
         else if(strcmp(argv[i], "--verbose") == 0)
             cmd.verbose = TRUE;
 
+        else if(strcmp(argv[i], "--single-threaded") == 0)
+            cmd.single_threaded = TRUE;
+
+        else if(strcmp(argv[i], "--benchmark-jobs") == 0)
+            cmd.benchmark_jobs = TRUE;
+
+        else if(strcmp(argv[i], "--pipelined-present") == 0)
+            cmd.pipelined_present = TRUE;
+
+        else if(strcmp(argv[i], "--verify-jobs") == 0)
+            cmd.verify_jobs = TRUE;
+
         else if(strcmp(argv[i], "--level") == 0) {
             if(++i < argc && *(argv[i]) != '-')
                 str_cpy(cmd.custom_level_path, argv[i], sizeof(cmd.custom_level_path));
@@ -216,6 +238,13 @@ commandline_t commandline_parse(int argc, char **argv)
                 crash("%s: missing --language parameter", program);
         }
 
+        else if(strcmp(argv[i], "--render-stats") == 0) {
+            if(++i < argc && *(argv[i]) != '-')
+                str_cpy(cmd.renderstats_filepath, argv[i], sizeof(cmd.renderstats_filepath));
+            else
+                crash("%s: missing --render-stats parameter", program);
+        }
+
         else if(strcmp(argv[i], "--game") == 0) {
             if(++i < argc && *(argv[i]) != '-') {
                 str_cpy(cmd.gamedir, argv[i], sizeof(cmd.gamedir));
@@ -38,12 +38,17 @@ struct commandline_t
     int mobile;
     int verbose;
     int compatibility_mode;
+    int single_threaded;
+    int benchmark_jobs;
+    int pipelined_present;
+    int verify_jobs;
 
     /* filepaths */
     char gamedir[COMMANDLINE_PATHMAX];
     char custom_level_path[COMMANDLINE_PATHMAX];
     char custom_quest_path[COMMANDLINE_PATHMAX];
     char language_filepath[COMMANDLINE_PATHMAX];
+    char renderstats_filepath[COMMANDLINE_PATHMAX];
 
     /* user arguments: what comes after "--" */
     const char** user_argv;
@@ -28,9 +28,12 @@
 #include "storyboard.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "prefetch.h"
+#include "jobs.h"
 #include "logfile.h"
 #include "timer.h"
 #include "video.h"
+#include "renderstats.h"
 #include "audio.h"
 #include "input.h"
 #include "fadefx.h"
@@ -204,6 +207,7 @@ void engine_mainloop()
         /* render */
         if(is_active && should_redraw && al_is_event_queue_empty(a5_event_queue)) {
             scene_t* current_scene = scenestack_top();
+            video_sync(); /* wait for the previous frame */
             current_scene->render();
             fadefx_update();
             video_render(render_overlay);
@@ -364,8 +368,15 @@ void init_managers(const commandline_t* cmd)
     audio_init();
     input_init();
     resourcemanager_init();
+    prefetch_init();
+    jobs_init(commandline_getint(cmd->single_threaded, FALSE));
+    jobs_set_verification(commandline_getint(cmd->verify_jobs, FALSE));
+    video_set_pipelined(commandline_getint(cmd->pipelined_present, FALSE));
     lang_init();
 
+    if(commandline_getint(cmd->benchmark_jobs, FALSE))
+        jobs_benchmark();
+
     load_managers_preferences(cmd);
 }
 
@@ -446,6 +457,10 @@ void load_managers_preferences(const commandline_t* cmd)
 
     if(*lang_path != '\0')
         lang_loadfile(lang_path);
+
+    /* export rendering statistics */
+    if(*(cmd->renderstats_filepath) != '\0')
+        renderstats_start_csv(cmd->renderstats_filepath);
 }
 
 
@@ -546,6 +561,8 @@ void release_accessories()
  */
 void release_managers()
 {
+    jobs_release(); /* joins the worker threads */
+    prefetch_release(); /* joins the worker threads */
     resourcemanager_release(); /* release bitmaps BEFORE the display! */
     video_release(); /* release the display */
     audio_release();
@@ -35,6 +35,7 @@
 #include "asset.h"
 #include "lang.h"
 #include "logfile.h"
+#include "renderstats.h"
 #include "nanoparser.h"
 #include "input.h"
 #include "../util/stringutil.h"
@@ -45,6 +46,7 @@
 #include "../entities/player.h"
 #include "../scenes/level.h"
 #include "../third_party/utf8.h"
+#include "../third_party/fast_draw.h"
 
 /* private stuff */
 #define FONT_STACKCAPACITY          8        /* color stack capacity */
@@ -52,8 +54,10 @@
 #define FONT_PATHMAX                1024     /* buffer size for multilingual paths */
 #define FONT_BLANKSMAXSIZE          8192     /* max buffer size for find_blanks() */
 #define FONT_COLORBREAKPOINT     ((char)0x2) /* a control character that delimits a change of color */
+#define FONT_GLYPHCACHESIZE         256      /* initial capacity of the glyph cache, in quads */
 
 /* macros */
+#define swap_darrays(a, b, type)    do { type* tmp_ = (a); size_t len_ = a##_len, cap_ = a##_cap; (a) = (b); a##_len = b##_len; a##_cap = b##_cap; (b) = tmp_; b##_len = len_; b##_cap = cap_; } while(0)
 #define IS_VAR_ANYCHAR(c)           ((isalnum((unsigned char)(c))) || ((c) == '_'))
 #define IS_VAR_1STCHAR(c)           ((isalpha((unsigned char)(c))) || ((c) == '_'))
 #define IS_TAG_1STCHAR(c)           ((isalpha((unsigned char)(c))) || ((c) == '/'))
@@ -112,10 +116,19 @@ struct fontscript_t {
 
 /* ------------------------------- */
 
+/* a glyph of a glyph run */
+typedef struct fontglyph_t fontglyph_t;
+struct fontglyph_t {
+    const image_t* image; /* region of the image atlas */
+    point2d_t offset; /* position relative to the beginning of the segment */
+};
+
 /* fontdrv_t: a font driver stores the attributes the font class (bmp, ttf) */
 typedef struct fontdrv_t fontdrv_t;
+typedef struct fonttext_t fonttext_t;
 struct fontdrv_t { /* abstract font: base class */
     void (*textout)(const fontdrv_t*,const char*,int,int,color_t); /* prints an unformatted line of text */
+    bool (*glyph_run)(const fontdrv_t*,const char*,fonttext_t*); /* appends the glyphs of an unformatted line of text to a fonttext_t; returns false if unsupported */
     int (*line_width)(const fontdrv_t*,const char*); /* width in pixels of an unformatted line of text */
     int (*line_height)(const fontdrv_t*); /* height in pixels of any line of text */
     const char* (*filepath)(const fontdrv_t*); /* relative path of the font */
@@ -135,6 +148,7 @@ struct fontdrv_bmp_t { /* bitmap font */
     char* filepath; /* relative path */
 };
 static void fontdrv_bmp_textout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color);
+static bool fontdrv_bmp_glyphrun(const fontdrv_t* fnt, const char* text, fonttext_t* out);
 static int fontdrv_bmp_linewidth(const fontdrv_t* fnt, const char* text);
 static int fontdrv_bmp_lineheight(const fontdrv_t* fnt);
 static const char* fontdrv_bmp_filepath(const fontdrv_t* fnt);
@@ -153,6 +167,7 @@ struct fontdrv_ttf_t { /* truetype font */
     char* filepath; /* relative path */
 };
 static void fontdrv_ttf_textout(const fontdrv_t* fnt, const char* text, int x, int y, color_t color);
+static bool fontdrv_ttf_glyphrun(const fontdrv_t* fnt, const char* text, fonttext_t* out);
 static int fontdrv_ttf_linewidth(const fontdrv_t* fnt, const char* text);
 static int fontdrv_ttf_lineheight(const fontdrv_t* fnt);
 static const char* fontdrv_ttf_filepath(const fontdrv_t* fnt);
@@ -185,7 +200,6 @@ typedef char* fontargs_t[FONTARGS_MAX];
 /* ------------------------------- */
 
 /* preprocessed font text */
-typedef struct fonttext_t fonttext_t;
 struct fonttext_t
 {
     /* the text is split into single-line, single-color segments */
@@ -199,6 +213,23 @@ struct fonttext_t
     DARRAY(int, line_width); /* the width in pixels of each line */
     DARRAY(char, buffer); /* string buffer */
 
+    /* glyph runs: the glyphs of each segment, computed once per preprocessing */
+    DARRAY(fontglyph_t, glyph); /* the glyphs of all segments, in order */
+    DARRAY(int, glyph_start); /* index of the first glyph of each segment */
+    bool has_glyph_runs; /* false if the font driver can't compute glyph runs */
+
+    /* cached layout: the key of the last preprocessing */
+    char* expanded_text; /* the text after expanding variables */
+    size_t expanded_text_capacity; /* buffer size of expanded_text */
+    const fontdrv_t* layout_drv; /* NULL if there is no cached layout */
+    int layout_max_width;
+    fontalign_t layout_align;
+
+    /* the segments of the previous layout, kept to reuse their widths */
+    DARRAY(char, prev_buffer);
+    DARRAY(const char*, prev_segment);
+    DARRAY(v2d_t, prev_size);
+
     /* misc */
     bool is_dirty; /* do we need to preprocess the text? */
     v2d_t total_size; /* total size of the text, in pixels */
@@ -209,6 +240,10 @@ static char* preprocess_substring(char* text, int index_of_first_char, int max_l
 static void preprocess_colors(fonttext_t* out, const char* text);
 static void preprocess_wordwrap(fonttext_t* out, const fontdrv_t* drv, int max_width);
 static void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align);
+static void preprocess_glyphs(fonttext_t* out, const fontdrv_t* drv);
+static int measure_segment(const fonttext_t* out, const fontdrv_t* drv, const char* segment);
+static bool has_cached_layout(const fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align);
+static void cache_layout(fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align);
 static void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, int max_width, fontalign_t align, fontargs_t argument, int index_of_first_char, int max_length);
 static void preprocess(font_t* f);
 
@@ -218,11 +253,13 @@ static void preprocess(font_t* f);
 struct font_t {
     fontdrv_t* drv; /* font driver */
     char* text; /* unprocessed text */
+    size_t text_capacity; /* buffer size of text */
     v2d_t position; /* position */
     int max_width; /* width (in pixels) for wordwrap */
     bool visible; /* is this font visible? */
     int index_of_first_char, max_length; /* substring (deprecated) */
     fontargs_t argument; /* text arguments: $1, $2 ... ${FONTARGS_MAX} */
+    size_t argument_capacity[FONTARGS_MAX]; /* buffer size of each argument */
     fontalign_t align; /* alignment */
     fonttext_t preprocessed_text; /* preprocessed text */
     char* lang_id; /* current language ID (multilingual support) */
@@ -239,12 +276,18 @@ static char* find_wordwrap(const fontdrv_t* drv, char* text, int max_width);
 static int find_blanks(const char* text, int blank[], size_t size);
 static char* tagged_text_offset(char* text, int charnum);
 static char* join_names(const char* name, const char* lang_id);
+static char* copy_to_buffer(char* buffer, size_t* capacity, const char* src);
 static bool must_refresh_driver(const font_t* fnt);
 static void refresh_driver(font_t* fnt);
 static inline bool has_loaded_ttf(const fontdrv_ttf_t* f);
 static void load_ttf(fontdrv_ttf_t* f);
 static void unload_ttf(fontdrv_ttf_t* f);
 
+/* rendering */
+static FAST_DRAW_CACHE* glyph_cache = NULL; /* shared by all fonts */
+static void render_glyph_runs(const font_t* f, point2d_t initial_position, rect_t target_rect);
+static void render_segments(const font_t* f, point2d_t initial_position, rect_t target_rect);
+
 /*
  * font_init()
  * Initializes the font module
@@ -268,6 +311,11 @@ void font_init()
 
     /* register predefined vars */
     register_predefined_vars();
+
+    /* create the glyph cache */
+    glyph_cache = fd_create_cache(FONT_GLYPHCACHESIZE, true, false);
+    if(glyph_cache == NULL)
+        logfile_message("Can't create the glyph cache. Text will be rendered without it.");
 }
 
 
@@ -277,6 +325,11 @@ void font_init()
  */
 void font_release()
 {
+    if(glyph_cache != NULL) {
+        fd_destroy_cache(glyph_cache);
+        glyph_cache = NULL;
+    }
+
     logfile_message("Unloading font callback table...");
     callbacktable_release();
 
@@ -321,7 +374,8 @@ font_t* font_create(const char* font_name)
     int i;
     font_t* f = mallocx(sizeof *f);
 
-    f->text = str_dup("");
+    f->text_capacity = 0;
+    f->text = copy_to_buffer(NULL, &f->text_capacity, "");
     f->max_width = 0;
     f->visible = true;
     f->position = v2d_new(0, 0);
@@ -335,8 +389,10 @@ font_t* font_create(const char* font_name)
     if(f->drv == NULL)
         fatal_error("Can't find font \"%s\"", f->name);
 
-    for(i=0; i<FONTARGS_MAX; i++)
+    for(i=0; i<FONTARGS_MAX; i++) {
         f->argument[i] = NULL;
+        f->argument_capacity[i] = 0;
+    }
 
     darray_init_ex(f->preprocessed_text.text_segment, 16);
     darray_init_ex(f->preprocessed_text.color, 16);
@@ -345,6 +401,17 @@ font_t* font_create(const char* font_name)
     darray_init_ex(f->preprocessed_text.color_sequence, 16);
     darray_init_ex(f->preprocessed_text.line_width, 4);
     darray_init_ex(f->preprocessed_text.buffer, 64);
+    darray_init_ex(f->preprocessed_text.glyph, 64);
+    darray_init_ex(f->preprocessed_text.glyph_start, 16);
+    f->preprocessed_text.has_glyph_runs = false;
+    f->preprocessed_text.expanded_text_capacity = 0;
+    f->preprocessed_text.expanded_text = copy_to_buffer(NULL, &f->preprocessed_text.expanded_text_capacity, "");
+    f->preprocessed_text.layout_drv = NULL;
+    f->preprocessed_text.layout_max_width = 0;
+    f->preprocessed_text.layout_align = FONTALIGN_LEFT;
+    darray_init_ex(f->preprocessed_text.prev_buffer, 64);
+    darray_init_ex(f->preprocessed_text.prev_segment, 16);
+    darray_init_ex(f->preprocessed_text.prev_size, 16);
     f->preprocessed_text.is_dirty = true;
     f->preprocessed_text.total_size = v2d_new(0, 0);
 
@@ -360,6 +427,12 @@ font_t* font_create(const char* font_name)
  */
 void font_destroy(font_t* f)
 {
+    darray_release(f->preprocessed_text.prev_size);
+    darray_release(f->preprocessed_text.prev_segment);
+    darray_release(f->preprocessed_text.prev_buffer);
+    free(f->preprocessed_text.expanded_text);
+    darray_release(f->preprocessed_text.glyph_start);
+    darray_release(f->preprocessed_text.glyph);
     darray_release(f->preprocessed_text.buffer);
     darray_release(f->preprocessed_text.line_width);
     darray_release(f->preprocessed_text.color_sequence);
@@ -396,16 +469,12 @@ void font_set_text(font_t* f, const char* fmt, ...)
     vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
 
-    /* update text */
-    if(f->text != NULL) {
-        /* no change? */
-        if(0 == strcmp(f->text, buf))
-            return;
+    /* no change? */
+    if(0 == strcmp(f->text, buf))
+        return;
 
-        /* release old text */
-        free(f->text);
-    }
-    f->text = str_dup(buf);
+    /* update text, reusing its buffer */
+    f->text = copy_to_buffer(f->text, &f->text_capacity, buf);
 
     /* preprocess text */
     f->preprocessed_text.is_dirty = true;
@@ -421,19 +490,23 @@ void font_set_text(font_t* f, const char* fmt, ...)
 void font_set_textarguments(font_t* f, int amount, ...)
 {
     int i, m = min(FONTARGS_MAX, amount);
+    bool is_dirty = false;
     va_list ap;
 
-    /* update arguments */
+    /* update arguments, reusing their buffers */
     va_start(ap, amount);
     for(i = 0; i < m; i++) {
-        if(f->argument[i] != NULL)
-            free(f->argument[i]);
-        f->argument[i] = str_dup(va_arg(ap, const char*));
+        const char* arg = va_arg(ap, const char*);
+        if(f->argument[i] == NULL || 0 != strcmp(f->argument[i], arg)) {
+            f->argument[i] = copy_to_buffer(f->argument[i], &f->argument_capacity[i], arg);
+            is_dirty = true;
+        }
     }
     va_end(ap);
 
     /* preprocess text */
-    f->preprocessed_text.is_dirty = true;
+    if(!f->preprocessed_text.is_dirty)
+        f->preprocessed_text.is_dirty = is_dirty;
 }
 
 
@@ -445,16 +518,19 @@ void font_set_textarguments(font_t* f, int amount, ...)
 void font_set_textargumentsv(font_t* f, int argc, const char** argv)
 {
     int m = min(FONTARGS_MAX, argc);
+    bool is_dirty = false;
 
-    /* update arguments */
+    /* update arguments, reusing their buffers */
     for(int i = 0; i < m; i++) {
-        if(f->argument[i] != NULL)
-            free(f->argument[i]);
-        f->argument[i] = str_dup(argv[i]);
+        if(f->argument[i] == NULL || 0 != strcmp(f->argument[i], argv[i])) {
+            f->argument[i] = copy_to_buffer(f->argument[i], &f->argument_capacity[i], argv[i]);
+            is_dirty = true;
+        }
     }
 
     /* preprocess text */
-    f->preprocessed_text.is_dirty = true;
+    if(!f->preprocessed_text.is_dirty)
+        f->preprocessed_text.is_dirty = is_dirty;
 }
 
 
@@ -516,48 +592,25 @@ void font_render(font_t* f, v2d_t camera_position)
     v2d_t topleft = v2d_subtract(camera_position, half_screen_size);
     v2d_t position = v2d_subtract(f->position, topleft);
 
-    /* render the text */
-    image_hold_drawing(true);
-    do {
-        /* boundaries of the drawing target */
-        const image_t* target = image_drawing_target();
-        int target_width = image_width(target);
-        int target_height = image_height(target);
-        rect_t target_rect = rect_new(0, 0, target_width, target_height);
-
-        /* clip out the entire text if possible */
-        point2d_t initial_position = point2d_new(floorf(position.x + 0.5f), floorf(position.y + 0.5f));
-        v2d_t total_size = f->preprocessed_text.total_size;
-        rect_t bounding_box = rect_new(initial_position.x, initial_position.y, total_size.x, total_size.y);
-        if(!rect_overlaps(target_rect, bounding_box))
-            break;
-
-        /* for each preprocessed text segment */
-        for(int i = 0; i < darray_length(f->preprocessed_text.text_segment); i++) {
-            const char* text_segment = f->preprocessed_text.text_segment[i];
-            color_t color = f->preprocessed_text.color[i];
-            point2d_t offset = f->preprocessed_text.offset[i];
-            v2d_t size = f->preprocessed_text.size[i];
-
-            /* skip empty segments, as in "</color>[__empty__]\n" */
-            if(*text_segment == '\0')
-                continue;
-
-            /* find the position of the segment in screen space */
-            point2d_t segment_position = point2d_add(initial_position, offset);
-            rect_t segment_rect = rect_new(segment_position.x, segment_position.y, size.x, size.y);
-
-            /* clip out the segment if possible */
-            if(segment_rect.y >= target_rect.height) /* exit early */
-                break;
-            if(!rect_overlaps(target_rect, segment_rect))
-                continue;
+    /* boundaries of the drawing target */
+    const image_t* target = image_drawing_target();
+    int target_width = image_width(target);
+    int target_height = image_height(target);
+    rect_t target_rect = rect_new(0, 0, target_width, target_height);
+
+    /* clip out the entire text if possible */
+    point2d_t initial_position = point2d_new(floorf(position.x + 0.5f), floorf(position.y + 0.5f));
+    v2d_t total_size = f->preprocessed_text.total_size;
+    rect_t bounding_box = rect_new(initial_position.x, initial_position.y, total_size.x, total_size.y);
+    if(!rect_overlaps(target_rect, bounding_box))
+        return;
 
-            /* render the segment */
-            f->drv->textout(f->drv, text_segment, segment_position.x, segment_position.y, color);
-        }
-    } while(0);
-    image_hold_drawing(false);
+    /* render the text after the images drawn so far */
+    image_flush_batch();
+    if(f->preprocessed_text.has_glyph_runs && glyph_cache != NULL)
+        render_glyph_runs(f, initial_position, target_rect);
+    else
+        render_segments(f, initial_position, target_rect);
 }
 
 
@@ -1046,6 +1099,21 @@ char* join_names(const char* name, const char* lang_id)
     return str;
 }
 
+/* copy_to_buffer(): copies src to a reusable buffer, which is
+   reallocated only if it's too small. Returns the buffer */
+char* copy_to_buffer(char* buffer, size_t* capacity, const char* src)
+{
+    size_t size = 1 + strlen(src);
+
+    if(buffer == NULL || size > *capacity) {
+        *capacity = max(size, 2 * (*capacity));
+        buffer = reallocx(buffer, *capacity * sizeof(*buffer));
+    }
+
+    memcpy(buffer, src, size);
+    return buffer;
+}
+
 
 
 
@@ -1244,6 +1312,7 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
     darray_clear(out->text_segment);
     darray_clear(out->color);
     darray_clear(out->offset);
+    darray_clear(out->size);
     out->total_size = v2d_new(0, 0);
 
     color = out->color_sequence[0];
@@ -1258,7 +1327,7 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
             *p = '\0';
 
             /* compute the size of the segment */
-            int segment_width = drv->line_width(drv, current_segment);
+            int segment_width = measure_segment(out, drv, current_segment);
             int segment_height = line_height;
             v2d_t segment_size = v2d_new(segment_width, segment_height);
 
@@ -1292,7 +1361,7 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
             *p = '\0';
 
             /* compute the size of the segment */
-            int segment_width = drv->line_width(drv, current_segment);
+            int segment_width = measure_segment(out, drv, current_segment);
             int segment_height = line_height;
             v2d_t segment_size = v2d_new(segment_width, segment_height);
 
@@ -1320,7 +1389,7 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
             /* *p = '\0'; */
 
             /* compute the size of the segment */
-            int segment_width = drv->line_width(drv, current_segment);
+            int segment_width = measure_segment(out, drv, current_segment);
             int segment_height = line_height;
             v2d_t segment_size = v2d_new(segment_width, segment_height);
 
@@ -1341,20 +1410,62 @@ void preprocess_split(fonttext_t* out, const fontdrv_t* drv, fontalign_t align)
     }
 }
 
+/* compute the glyph runs of the text segments */
+void preprocess_glyphs(fonttext_t* out, const fontdrv_t* drv)
+{
+    darray_clear(out->glyph);
+    darray_clear(out->glyph_start);
+    out->has_glyph_runs = true;
+
+    for(int i = 0; i < darray_length(out->text_segment); i++) {
+        darray_push(out->glyph_start, darray_length(out->glyph));
+
+        if(!drv->glyph_run(drv, out->text_segment[i], out)) {
+            /* the font driver doesn't support glyph runs */
+            darray_clear(out->glyph);
+            darray_clear(out->glyph_start);
+            out->has_glyph_runs = false;
+            break;
+        }
+    }
+}
+
+/* measure a text segment that is about to be added, reusing the width
+   of the segment of the previous layout at the same index if they match */
+int measure_segment(const fonttext_t* out, const fontdrv_t* drv, const char* segment)
+{
+    int index = darray_length(out->text_segment);
+
+    if(index < darray_length(out->prev_segment) && 0 == strcmp(out->prev_segment[index], segment))
+        return out->prev_size[index].x;
+
+    return drv->line_width(drv, segment);
+}
+
+/* checks if the cached layout was computed with the given parameters */
+bool has_cached_layout(const fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align)
+{
+    return out->layout_drv == drv &&
+           out->layout_max_width == max_width &&
+           out->layout_align == align &&
+           0 == strcmp(out->expanded_text, expanded_text);
+}
+
+/* store the parameters of the layout being computed */
+void cache_layout(fonttext_t* out, const fontdrv_t* drv, const char* expanded_text, int max_width, fontalign_t align)
+{
+    out->expanded_text = copy_to_buffer(out->expanded_text, &out->expanded_text_capacity, expanded_text);
+    out->layout_drv = drv;
+    out->layout_max_width = max_width;
+    out->layout_align = align;
+}
+
 /* preprocess a text for rendering */
 void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, int max_width, fontalign_t align, fontargs_t args, int index_of_first_char, int max_length)
 {
     static char buf[FONT_TEXTMAXSIZE], tmp[FONT_TEXTMAXSIZE];
     char* substr;
 
-    /* reset arrays */
-    darray_clear(out->text_segment);
-    darray_clear(out->color);
-    darray_clear(out->offset);
-    darray_clear(out->line_width);
-    darray_clear(out->color_sequence);
-    darray_clear(out->buffer);
-
     /* copy text to a temporary buffer */
     str_cpy(buf, text, sizeof(buf));
 
@@ -1364,6 +1475,30 @@ void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, in
     /* preprocess substring */
     substr = preprocess_substring(buf, index_of_first_char, max_length);
 
+    /* the layout doesn't change if the expanded text doesn't change */
+    if(has_cached_layout(out, drv, substr, max_width, align))
+        return;
+
+    /* keep the segments of the previous layout. Their widths
+       can be reused if they were computed with the same driver */
+    swap_darrays(out->buffer, out->prev_buffer, char);
+    swap_darrays(out->text_segment, out->prev_segment, const char*);
+    swap_darrays(out->size, out->prev_size, v2d_t);
+    if(out->layout_drv != drv)
+        darray_clear(out->prev_segment);
+
+    /* remember the key of the new layout */
+    cache_layout(out, drv, substr, max_width, align);
+
+    /* reset arrays */
+    darray_clear(out->text_segment);
+    darray_clear(out->color);
+    darray_clear(out->offset);
+    darray_clear(out->size);
+    darray_clear(out->line_width);
+    darray_clear(out->color_sequence);
+    darray_clear(out->buffer);
+
     /* preprocess colors */
     preprocess_colors(out, substr);
 
@@ -1373,6 +1508,9 @@ void preprocess_text(fonttext_t* out, const fontdrv_t* drv, const char* text, in
     /* split the text into segments */
     preprocess_split(out, drv, align);
 
+    /* compute the glyph runs */
+    preprocess_glyphs(out, drv);
+
 #if 0
     /* test */
     for(int i = 0; i < darray_length(out->text_segment); i++) {
@@ -1398,6 +1536,91 @@ void preprocess(font_t* f)
     f->preprocessed_text.is_dirty = false;
 }
 
+/* ------------------------------------------------- */
+/* rendering */
+/* ------------------------------------------------- */
+
+/* render the cached glyph runs of the text segments with a single
+   submission per texture. The glyphs of a bitmap font are regions of
+   the same image atlas, so this is typically a single draw call */
+void render_glyph_runs(const font_t* f, point2d_t initial_position, rect_t target_rect)
+{
+    const fonttext_t* text = &f->preprocessed_text;
+    const image_t* atlas = f->drv->image(f->drv);
+    texturehandle_t texture = atlas != NULL ? image_texture(atlas) : 0;
+    int segment_count = darray_length(text->text_segment);
+    int glyph_count = darray_length(text->glyph);
+
+    /* for each preprocessed text segment */
+    for(int i = 0; i < segment_count; i++) {
+        int first = text->glyph_start[i];
+        int last = (i + 1 < segment_count) ? text->glyph_start[i+1] : glyph_count;
+        ALLEGRO_COLOR color = text->color[i]._color;
+
+        /* skip empty segments */
+        if(first == last)
+            continue;
+
+        /* find the position of the segment in screen space */
+        point2d_t segment_position = point2d_add(initial_position, text->offset[i]);
+        rect_t segment_rect = rect_new(segment_position.x, segment_position.y, text->size[i].x, text->size[i].y);
+
+        /* clip out the segment if possible */
+        if(segment_rect.y >= target_rect.height) /* exit early */
+            break;
+        if(!rect_overlaps(target_rect, segment_rect))
+            continue;
+
+        /* accumulate the glyphs of the segment */
+        for(int j = first; j < last; j++) {
+            const fontglyph_t* glyph = &text->glyph[j];
+            point2d_t position = point2d_add(segment_position, glyph->offset);
+
+            fd_draw_tinted_bitmap(glyph_cache, IMAGE2BITMAP(glyph->image), color, position.x, position.y);
+            renderstats_count_batched_draw(texture, 6);
+        }
+    }
+
+    /* submit the glyphs */
+    fd_flush_cache(glyph_cache); /* invokes al_draw_indexed_prim() */
+    renderstats_end_batch();
+}
+
+/* render the text segments using the font driver */
+void render_segments(const font_t* f, point2d_t initial_position, rect_t target_rect)
+{
+    const fonttext_t* text = &f->preprocessed_text;
+
+    image_hold_drawing(true);
+
+    /* for each preprocessed text segment */
+    for(int i = 0; i < darray_length(text->text_segment); i++) {
+        const char* text_segment = text->text_segment[i];
+        color_t color = text->color[i];
+        point2d_t offset = text->offset[i];
+        v2d_t size = text->size[i];
+
+        /* skip empty segments, as in "</color>[__empty__]\n" */
+        if(*text_segment == '\0')
+            continue;
+
+        /* find the position of the segment in screen space */
+        point2d_t segment_position = point2d_add(initial_position, offset);
+        rect_t segment_rect = rect_new(segment_position.x, segment_position.y, size.x, size.y);
+
+        /* clip out the segment if possible */
+        if(segment_rect.y >= target_rect.height) /* exit early */
+            break;
+        if(!rect_overlaps(target_rect, segment_rect))
+            continue;
+
+        /* render the segment */
+        f->drv->textout(f->drv, text_segment, segment_position.x, segment_position.y, color);
+    }
+
+    image_hold_drawing(false);
+}
+
 /* ------------------------------------------------- */
 /* read the font scripts */
 /* ------------------------------------------------- */
@@ -1786,6 +2009,7 @@ fontdrv_t* fontdrv_bmp_new(const char* source_file, charproperties_t chr[], int
 
     /* initialize the vtable */
     ((fontdrv_t*)f)->textout = fontdrv_bmp_textout;
+    ((fontdrv_t*)f)->glyph_run = fontdrv_bmp_glyphrun;
     ((fontdrv_t*)f)->line_width = fontdrv_bmp_linewidth;
     ((fontdrv_t*)f)->line_height = fontdrv_bmp_lineheight;
     ((fontdrv_t*)f)->filepath = fontdrv_bmp_filepath;
@@ -1854,6 +2078,28 @@ void fontdrv_bmp_textout(const fontdrv_t* fnt, const char* text, int x, int y, c
     }
 }
 
+bool fontdrv_bmp_glyphrun(const fontdrv_t* fnt, const char* text, fonttext_t* out)
+{
+    const fontdrv_bmp_t* f = (const fontdrv_bmp_t*)fnt;
+    int hsp = f->spacing.x;
+    int vsp = f->spacing.y;
+    int x = 0;
+    uint32_t c = 0;
+
+    /* same layout as fontdrv_bmp_textout() */
+    for(size_t i = 0; (c = u8_nextchar(text, &i)) != 0; ) {
+        const image_t* glyph = find_bmp_glyph(f, c);
+        if(glyph != NULL) {
+            int dy = f->line_height - vsp - image_height(glyph);
+            fontglyph_t g = { .image = glyph, .offset = point2d_new(x, dy) };
+            darray_push(out->glyph, g);
+            x += image_width(glyph) + hsp;
+        }
+    }
+
+    return true;
+}
+
 int fontdrv_bmp_lineheight(const fontdrv_t* fnt)
 {
     const fontdrv_bmp_t* f = (const fontdrv_bmp_t*)fnt;
@@ -1909,6 +2155,7 @@ fontdrv_t* fontdrv_ttf_new(const char* source_file, int size, bool antialias, bo
     /* basic setup */
     fontdrv_ttf_t* f = mallocx(sizeof *f);
     ((fontdrv_t*)f)->textout = fontdrv_ttf_textout;
+    ((fontdrv_t*)f)->glyph_run = fontdrv_ttf_glyphrun;
     ((fontdrv_t*)f)->line_width = fontdrv_ttf_linewidth;
     ((fontdrv_t*)f)->line_height = fontdrv_ttf_lineheight;
     ((fontdrv_t*)f)->filepath = fontdrv_ttf_filepath;
@@ -1950,6 +2197,15 @@ void fontdrv_ttf_textout(const fontdrv_t* fnt, const char* text, int x, int y, c
     al_draw_text(f->font, color._color, x, y, flags, text);
 }
 
+bool fontdrv_ttf_glyphrun(const fontdrv_t* fnt, const char* text, fonttext_t* out)
+{
+    /* the glyphs of a TrueType font are cached by Allegro */
+    (void)fnt;
+    (void)text;
+    (void)out;
+    return false;
+}
+
 void fontdrv_ttf_release(fontdrv_t* fnt)
 {
     fontdrv_ttf_t* f = (fontdrv_ttf_t*)fnt;
@@ -1989,7 +2245,8 @@ int fontdrv_ttf_linewidth(const fontdrv_t* fnt, const char* text)
     }
     buffer[i] = '\0';
 
-    /* compute the width */
+    /* compute the width. This may cache glyphs in a texture */
+    video_sync();
     return al_get_text_width(f->font, buffer);
 }
 
@@ -2015,6 +2272,7 @@ void load_ttf(fontdrv_ttf_t* f)
     const char* fullpath = asset_path(f->filepath);
 
     logfile_message("Loading TrueType font \"%s\"...", fullpath);
+    video_sync();
 
     f->font = al_load_ttf_font(fullpath, -(f->size), !(f->antialias) ? ALLEGRO_TTF_MONOCHROME : 0);
     if(f->font == NULL)
@@ -2025,6 +2283,7 @@ void load_ttf(fontdrv_ttf_t* f)
 
 void unload_ttf(fontdrv_ttf_t* f)
 {
+    video_sync();
     al_destroy_font(f->font);
 }
 
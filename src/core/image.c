@@ -26,11 +26,14 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
 #include "image.h"
 #include "video.h"
 #include "logfile.h"
 #include "asset.h"
 #include "resourcemanager.h"
+#include "prefetch.h"
+#include "renderstats.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 
@@ -40,8 +43,9 @@
 #define WANT_WRAP 0
 #endif
 
-/* convert image flip flags to ALLEGRO_FLIP flags */
-#define FLIPPY(flags) ((((flags) & IF_HFLIP) != 0) * ALLEGRO_FLIP_HORIZONTAL + (((flags) & IF_VFLIP) != 0) * ALLEGRO_FLIP_VERTICAL)
+/* rendering statistics */
+#define QUAD_VERTICES 6 /* a quad is made of two triangles */
+#define ELLIPSE_VERTICES 32 /* an estimate */
 
 /* check if an expression is a power of two */
 #define IS_POWER_OF_TWO(n) (((n) & ((n) - 1)) == 0)
@@ -56,6 +60,36 @@ struct image_t {
 /* misc */
 static image_t* target = NULL; /* drawing target */
 static const int MAX_IMAGE_SIZE = 4096; /* maximum image size for broad compatibility with video cards */
+static const ALLEGRO_COLOR WHITE = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+/* sprite batcher: the images are drawn as quads that are accumulated in a
+   vertex array and submitted together while they share the same texture
+   and blending mode. The vertices are transformed on the CPU, so changing
+   the transform between draws doesn't break the batch */
+#define BATCH_CAPACITY 1024 /* maximum number of quads in a batch */
+typedef enum batchblend_t batchblend_t;
+enum batchblend_t {
+    BLEND_NORMAL,   /* the default blending of the engine (premultiplied alpha) */
+    BLEND_LIT_BASE, /* first pass of image_draw_lit() */
+    BLEND_LIT_GLOW  /* second pass of image_draw_lit() */
+};
+static struct {
+    ALLEGRO_VERTEX* vertex; /* storage of the quads */
+    int quad_count; /* number of quads in the current batch */
+    ALLEGRO_BITMAP* texture; /* the root bitmap of the current batch */
+    batchblend_t blend; /* the blending mode of the current batch */
+    ALLEGRO_COLOR blend_color; /* the blending color of the current batch */
+    int blender[6]; /* the Allegro blender of the current batch, if its blending mode is BLEND_NORMAL */
+} batch = {
+    .vertex = NULL,
+    .quad_count = 0,
+    .texture = NULL,
+    .blend = BLEND_NORMAL
+};
+static void batch_quad(const image_t* src, float sx, float sy, float sw, float sh, float cx, float cy, float dx, float dy, float xscale, float yscale, float angle, ALLEGRO_COLOR tint, int flags, batchblend_t blend, ALLEGRO_COLOR blend_color);
+static void set_batch_blender(batchblend_t blend, ALLEGRO_COLOR blend_color);
+static inline bool same_color(ALLEGRO_COLOR a, ALLEGRO_COLOR b);
+static inline bool same_blender(const int* a, const int* b);
 
 /*
  * image_load()
@@ -70,11 +104,26 @@ image_t* image_load(const char* path)
         const char* fullpath = asset_path(path);
         logfile_message("Loading image \"%s\"...", fullpath);
 
+        /* we're about to create a texture */
+        video_sync();
+
         /* build the image object */
         img = mallocx(sizeof *img);
 
-        /* loading the image */
-        if(NULL == (img->data = al_load_bitmap(fullpath))) {
+        /* loading the image. If it has been decoded in the background,
+           we just need to upload it to the video memory */
+        if(NULL != (img->data = prefetch_claim_image(path))) {
+            al_convert_bitmap(img->data);
+
+            /* the upload failed; we don't want a memory bitmap */
+            if(al_get_bitmap_flags(img->data) & ALLEGRO_MEMORY_BITMAP) {
+                logfile_message("Can't upload the prefetched image \"%s\". Loading it again...", fullpath);
+                al_destroy_bitmap(img->data);
+                img->data = NULL;
+            }
+        }
+
+        if(img->data == NULL && NULL == (img->data = al_load_bitmap(fullpath))) {
             fatal_error("Failed to load image \"%s\"", fullpath);
             free(img);
             return NULL;
@@ -99,6 +148,7 @@ image_t* image_load(const char* path)
     else
         resourcemanager_ref_image(path);
 
+    prefetch_record_image(path);
     return img;
 }
 
@@ -112,6 +162,8 @@ void image_save(const image_t* img, const char *path)
 {
     const char* fullpath = asset_path(path);
 
+    video_sync();
+    image_flush_batch();
     if(al_save_bitmap(fullpath, img->data))
         logfile_message("Saved image to \"%s\"", fullpath);
     else
@@ -138,6 +190,7 @@ image_t* image_create(int width, int height)
         return NULL;
     }
 
+    video_sync();
     if(NULL == (bmp = al_create_bitmap(width, height))) {
         logfile_message("ERROR: image_create(%d,%d) failed", width, height);
         return NULL;
@@ -165,6 +218,9 @@ image_t* image_create(int width, int height)
  */
 void image_destroy(image_t* img)
 {
+    video_sync();
+    image_flush_batch();
+
     if(img->data != NULL)
         al_destroy_bitmap(img->data);
 
@@ -239,6 +295,9 @@ image_t* image_create_backbuffer(int width, int height, bool want_depth_buffer)
  */
 image_t* image_create_ex(int width, int height, int flags)
 {
+    /* we're about to create a texture */
+    video_sync();
+
     /* save state */
     int prev_new_bitmap_flags = al_get_new_bitmap_flags();
     int prev_depth = al_get_new_bitmap_depth();
@@ -314,6 +373,8 @@ image_t* image_clone(const image_t* src)
     img->w = src->w;
     img->h = src->h;
     img->path = NULL;
+    video_sync();
+    image_flush_batch();
     if(NULL == (img->data = al_clone_bitmap(src->data)))
         fatal_error("Failed to clone image \"%s\" sized %dx%d", src->path ? src->path : "", src->w, src->h);
 
@@ -327,6 +388,8 @@ image_t* image_clone(const image_t* src)
 void image_enable_linear_filtering(image_t* img)
 {
     ALLEGRO_STATE state;
+    video_sync();
+    image_flush_batch();
     al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
 
     ALLEGRO_BITMAP* root = img->data;
@@ -366,6 +429,8 @@ void image_enable_linear_filtering(image_t* img)
 void image_disable_linear_filtering(image_t* img)
 {
     ALLEGRO_STATE state;
+    video_sync();
+    image_flush_batch();
     al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
 
     int flags = al_get_bitmap_flags(img->data);
@@ -411,6 +476,8 @@ void image_lock(image_t* img, const char* mode)
     }
 
     /* lock the bitmap */
+    video_sync();
+    image_flush_batch();
     if(!al_lock_bitmap(img->data, al_get_bitmap_format(img->data), flags))
         logfile_message("WARNING: can't lock image \"%s\" (mode: %s)", img->path, mode);
 }
@@ -470,6 +537,7 @@ color_t image_getpixel(const image_t* img, int x, int y)
  */
 void image_putpixel(int x, int y, color_t color)
 {
+    image_flush_batch();
     al_put_pixel(x, y, color._color);
 }
 
@@ -480,7 +548,9 @@ void image_putpixel(int x, int y, color_t color)
  */
 void image_line(int x1, int y1, int x2, int y2, color_t color)
 {
+    image_flush_batch();
     al_draw_line(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
+    renderstats_count_primitive(2);
 }
 
 
@@ -490,7 +560,9 @@ void image_line(int x1, int y1, int x2, int y2, color_t color)
  */
 void image_ellipse(int cx, int cy, int radius_x, int radius_y, color_t color)
 {
+    image_flush_batch();
     al_draw_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color, 0.0f);
+    renderstats_count_primitive(ELLIPSE_VERTICES);
 }
 
 
@@ -500,7 +572,9 @@ void image_ellipse(int cx, int cy, int radius_x, int radius_y, color_t color)
  */
 void image_ellipsefill(int cx, int cy, int radius_x, int radius_y, color_t color)
 {
+    image_flush_batch();
     al_draw_filled_ellipse(cx + 0.5f, cy + 0.5f, radius_x, radius_y, color._color);
+    renderstats_count_primitive(ELLIPSE_VERTICES);
 }
 
 
@@ -510,7 +584,9 @@ void image_ellipsefill(int cx, int cy, int radius_x, int radius_y, color_t color
  */
 void image_rect(int x1, int y1, int x2, int y2, color_t color)
 {
+    image_flush_batch();
     al_draw_rectangle(x1 + 0.5f, y1 + 0.5f, x2 + 0.5f, y2 + 0.5f, color._color, 0.0f);
+    renderstats_count_primitive(5);
 }
 
 
@@ -520,7 +596,9 @@ void image_rect(int x1, int y1, int x2, int y2, color_t color)
  */
 void image_rectfill(int x1, int y1, int x2, int y2, color_t color)
 {
+    image_flush_batch();
     al_draw_filled_rectangle(x1, y1, x2 + 1.0f, y2 + 1.0f, color._color);
+    renderstats_count_primitive(4);
 }
 
 
@@ -530,6 +608,7 @@ void image_rectfill(int x1, int y1, int x2, int y2, color_t color)
  */
 void image_clear(color_t color)
 {
+    image_flush_batch();
     al_clear_to_color(color._color);
 }
 
@@ -540,7 +619,7 @@ void image_clear(color_t color)
  */
 void image_blit(const image_t* src, int src_x, int src_y, int dest_x, int dest_y, int width, int height)
 {
-    al_draw_bitmap_region(src->data, src_x, src_y, width, height, dest_x, dest_y, 0);
+    batch_quad(src, src_x, src_y, width, height, 0.0f, 0.0f, dest_x, dest_y, 1.0f, 1.0f, 0.0f, WHITE, IF_NONE, BLEND_NORMAL, WHITE);
 }
 
 
@@ -553,7 +632,7 @@ void image_blit(const image_t* src, int src_x, int src_y, int dest_x, int dest_y
  */
 void image_draw(const image_t* src, int x, int y, int flags)
 {
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, 1.0f, 1.0f, 0.0f, WHITE, flags, BLEND_NORMAL, WHITE);
 }
 
 
@@ -569,12 +648,7 @@ void image_draw(const image_t* src, int x, int y, int flags)
  */
 void image_draw_scaled(const image_t* src, int x, int y, v2d_t scale, int flags)
 { 
-    al_draw_scaled_bitmap(
-        src->data,
-        0.0f, 0.0f, src->w, src->h,
-        x, y, scale.x * src->w, scale.y * src->h,
-        FLIPPY(flags)
-    );
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, scale.x, scale.y, 0.0f, WHITE, flags, BLEND_NORMAL, WHITE);
 }
 
 /*
@@ -586,12 +660,7 @@ void image_draw_scaled_trans(const image_t* src, int x, int y, v2d_t scale, floa
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
 
-    al_draw_tinted_scaled_bitmap(
-        src->data, tint,
-        0.0f, 0.0f, src->w, src->h,
-        x, y, scale.x * src->w, scale.y * src->h,
-        FLIPPY(flags)
-    );
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, scale.x, scale.y, 0.0f, tint, flags, BLEND_NORMAL, tint);
 }
 
 /*
@@ -602,7 +671,7 @@ void image_draw_scaled_trans(const image_t* src, int x, int y, v2d_t scale, floa
  */
 void image_draw_rotated(const image_t* src, int x, int y, int cx, int cy, float radians, int flags)
 {
-    al_draw_rotated_bitmap(src->data, cx, cy, x, y, -radians, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, cx, cy, x, y, 1.0f, 1.0f, -radians, WHITE, flags, BLEND_NORMAL, WHITE);
 }
 
 /*
@@ -614,7 +683,7 @@ void image_draw_rotated_trans(const image_t* src, int x, int y, int cx, int cy,
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
 
-    al_draw_tinted_rotated_bitmap(src->data, tint, cx, cy, x, y, -radians, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, cx, cy, x, y, 1.0f, 1.0f, -radians, tint, flags, BLEND_NORMAL, tint);
 }
 
 /*
@@ -623,7 +692,7 @@ void image_draw_rotated_trans(const image_t* src, int x, int y, int cx, int cy,
  */
 void image_draw_scaled_rotated(const image_t* src, int x, int y, int cx, int cy, v2d_t scale, float radians, int flags)
 {
-    al_draw_scaled_rotated_bitmap(src->data, cx, cy, x, y, scale.x, scale.y, -radians, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, cx, cy, x, y, scale.x, scale.y, -radians, WHITE, flags, BLEND_NORMAL, WHITE);
 }
 
 /*
@@ -635,7 +704,7 @@ void image_draw_scaled_rotated_trans(const image_t* src, int x, int y, int cx, i
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
 
-    al_draw_tinted_scaled_rotated_bitmap(src->data, tint, cx, cy, x, y, scale.x, scale.y, -radians, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, cx, cy, x, y, scale.x, scale.y, -radians, tint, flags, BLEND_NORMAL, tint);
 }
  
 /*
@@ -648,7 +717,7 @@ void image_draw_trans(const image_t* src, int x, int y, float alpha, int flags)
     float a = clip01(alpha);
     ALLEGRO_COLOR tint = al_map_rgba_f(a, a, a, a);
 
-    al_draw_tinted_bitmap(src->data, tint, x, y, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, 1.0f, 1.0f, 0.0f, tint, flags, BLEND_NORMAL, tint);
 }
 
 /*
@@ -659,102 +728,17 @@ void image_draw_lit(const image_t* src, int x, int y, color_t color, int flags)
 {
     /*
 
-    "While deferred bitmap drawing is enabled, the only functions that can be
-    used are the bitmap drawing functions and font drawing functions. Changing
-    the state such as the blending modes will result in undefined behaviour."
-
-    source: Allegro manual at
-    https://liballeg.org/a5docs/trunk/graphics.html#al_hold_bitmap_drawing
+    The image is drawn twice with different blending modes. Each pass is
+    a quad of the sprite batcher, which changes the blender when submitting
+    the batch. See set_batch_blender() for the blending equations.
 
     */
 
-    /* temporarily disable deferred drawing if it's activated */
-    bool is_held = al_is_bitmap_drawing_held();
-    if(is_held)
-        al_hold_bitmap_drawing(false);
-
-    /* store the blend state */
-    ALLEGRO_STATE state;
-    al_store_state(&state, ALLEGRO_STATE_BLENDER);
-
-    /* blending magic */
-    al_set_blend_color(color._color);
-    al_set_blender(
-
-        /*
-
-        this works with a source image with pre-multiplied alpha:
-
-            x = dx * (1 - sa) + (sx * sa) * cc
-
-        replace x by r, g, b, a
-
-        x is the result of the blending
-        dx is destination color
-        sx is the source color
-        sa is the source alpha
-        (sx * sa) is the source color with pre-multiplied alpha
-        cc is a constant color
-
-        if sa = 1 (fully opaque), then we'll have x = sx * cc
-        if sa = 0 (fully transparent), then we'll have x = dx
-
-        */
-
-        ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_INVERSE_ALPHA
-    );
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
-
-    al_set_blender(
-
-        /*
-
-        this second equation works as follows:
-
-            y = dy + (sy * sa) * cc
-
-        where dy = x is the result of the previous call to al_draw_bitmap()
-        and sy = sx is the source pixel of the bitmap that is being drawn.
-        Replace y by r, g, b, a.
-
-        let's analyze two cases:
-
-        1) suppose that sa = 1.0 (fully opaque pixel). This means that,
-           in the previous call to al_draw_bitmap(), we had x = sx * cc
-           as the result. Therefore, we'll have y = sx * cc + sx * cc =
-           2 * sx * cc now, which will give us a nice colored effect with
-           both additive and multiplicative blending.
-
-        2) suppose that sa = 0.0 (fully transparent pixel). This means that,
-           in the previous call to al_draw_bitmap(), we had x = dx as the
-           result. Therefore, we'll have y = dx now, which means that we'll
-           be preserving the background as-is.
-
-        we could modify the cc variable of this second equation for a more
-        refined control of the color. If we had two separate colors for each
-        equation, cc1 and cc2, then the result would be y = sx * (cc1 + cc2).
-        If cc2 = t * cc1 for some 0 < t < 1, then y' = (1 + t) * sx * cc1 <
-        2 * sx * cc1. Seems like overkill, though.
-
-        perhaps a better result would be achieved with y' = sx * cc + cc,
-        because multiplicative blending doesn't always look great depending
-        on the colors. How can we draw y'' = cc * sa? So far I don't see in
-        Allegro an op with a constant offset, neither a way to compute 1/sx.
-        Creating a temporary, single-colored bitmap could work. Is there an
-        easier way? We can draw a black silhouette with blending alone.
-
-        */
-
-        ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_ONE
-    );
-    al_draw_bitmap(src->data, x, y, FLIPPY(flags));
+    /* first pass: multiplicative blending */
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, 1.0f, 1.0f, 0.0f, WHITE, flags, BLEND_LIT_BASE, color._color);
 
-    /* restore the blending state */
-    al_restore_state(&state);
-
-    /* re-enable deferred drawing if it was activated */
-    if(is_held)
-        al_hold_bitmap_drawing(true);
+    /* second pass: additive blending */
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, 1.0f, 1.0f, 0.0f, WHITE, flags, BLEND_LIT_GLOW, color._color);
 }
 
 /*
@@ -764,7 +748,7 @@ void image_draw_lit(const image_t* src, int x, int y, color_t color, int flags)
  */
 void image_draw_tinted(const image_t* src, int x, int y, color_t color, int flags)
 {
-    al_draw_tinted_bitmap(src->data, color._color, x, y, FLIPPY(flags));
+    batch_quad(src, 0.0f, 0.0f, src->w, src->h, 0.0f, 0.0f, x, y, 1.0f, 1.0f, 0.0f, color._color, flags, BLEND_NORMAL, color._color);
 }
 
 /*
@@ -773,8 +757,11 @@ void image_draw_tinted(const image_t* src, int x, int y, color_t color, int flag
  */
 void image_set_drawing_target(image_t* new_target)
 {
+    video_sync();
+    image_flush_batch();
     target = (new_target != video_get_backbuffer()) ? new_target : NULL;
     al_set_target_bitmap(image_drawing_target()->data);
+    renderstats_count_target_switch();
 }
 
 /*
@@ -803,20 +790,100 @@ void image_hold_drawing(bool hold)
 
     if(hold) {
 
-        if(0 == counter++)
+        if(0 == counter++) {
             al_hold_bitmap_drawing(true);
+            renderstats_count_hold(true);
+        }
 
     }
     else {
 
-        if(0 == --counter)
+        if(0 == --counter) {
+            image_flush_batch();
             al_hold_bitmap_drawing(false);
+            renderstats_count_hold(false);
+        }
 
         counter = max(0, counter);
 
     }
 }
 
+/*
+ * image_init_batching()
+ * Initializes the sprite batcher. This is called by the video manager
+ * after creating the display
+ */
+void image_init_batching()
+{
+    batch.vertex = mallocx(QUAD_VERTICES * BATCH_CAPACITY * sizeof(*batch.vertex));
+    batch.quad_count = 0;
+    batch.texture = NULL;
+    batch.blend = BLEND_NORMAL;
+}
+
+/*
+ * image_release_batching()
+ * Releases the sprite batcher
+ */
+void image_release_batching()
+{
+    image_flush_batch();
+
+    free(batch.vertex);
+    batch.vertex = NULL;
+}
+
+/*
+ * image_flush_batch()
+ * Submits the images drawn so far. Call this before drawing with
+ * Allegro directly or before changing the rendering state
+ */
+void image_flush_batch()
+{
+    int vertex_count = QUAD_VERTICES * batch.quad_count;
+    ALLEGRO_TRANSFORM identity;
+    ALLEGRO_STATE state;
+
+    /* nothing to do */
+    if(batch.quad_count == 0)
+        return;
+
+    /* deferred drawing must be disabled while submitting primitives. Doing
+       so submits the text held by Allegro before the batch, in order */
+    bool is_held = al_is_bitmap_drawing_held();
+    if(is_held)
+        al_hold_bitmap_drawing(false);
+
+    /* the vertices have been transformed already */
+    al_identity_transform(&identity);
+    al_store_state(&state, ALLEGRO_STATE_TRANSFORM | ALLEGRO_STATE_BLENDER);
+    al_use_transform(&identity);
+
+    /* set the blender of the batch */
+    set_batch_blender(batch.blend, batch.blend_color);
+    renderstats_count_state_change();
+
+    /* submit the batch. The vertices are uploaded by the driver in a
+       single copy; locking a vertex buffer at the same offset on every
+       flush would stall the pipeline and copy the batch twice */
+    al_draw_prim(batch.vertex, NULL, batch.texture, 0, vertex_count, ALLEGRO_PRIM_TRIANGLE_LIST);
+
+    renderstats_end_batch();
+
+    /* restore the state */
+    al_restore_state(&state);
+    renderstats_count_state_change();
+
+    if(is_held)
+        al_hold_bitmap_drawing(true);
+
+    /* start a new batch */
+    batch.quad_count = 0;
+    batch.texture = NULL;
+    batch.blend = BLEND_NORMAL;
+}
+
 /*
  * image_filepath()
  * The relative path to the file of this image, if it exists.
@@ -836,4 +903,195 @@ texturehandle_t image_texture(const image_t* img)
     /* we require ALLEGRO_OPENGL to be a display flag */
     texturehandle_t tex = al_get_opengl_texture(img->data);
     return tex;
-}
\ No newline at end of file
+}
+
+
+
+
+/*
+ * private
+ */
+
+/* adds a quad to the batch. The region (sx, sy, sw, sh) of the source image
+   is scaled and rotated about the pivot (cx, cy), which is placed at (dx, dy).
+   The result is transformed by the current transform */
+void batch_quad(const image_t* src, float sx, float sy, float sw, float sh, float cx, float cy, float dx, float dy, float xscale, float yscale, float angle, ALLEGRO_COLOR tint, int flags, batchblend_t blend, ALLEGRO_COLOR blend_color)
+{
+    const ALLEGRO_TRANSFORM* transform = al_get_current_transform();
+    ALLEGRO_BITMAP* bitmap = src->data;
+    ALLEGRO_BITMAP* root = al_get_parent_bitmap(bitmap);
+    float c = 1.0f, s = 0.0f;
+    int blender[6] = { 0 };
+
+    /* sub-images share the texture of their root (sub-bitmaps aren't nested in Allegro) */
+    if(root == NULL)
+        root = bitmap;
+
+    /* the normal blending is whatever blender is set in Allegro when drawing */
+    if(blend == BLEND_NORMAL) {
+        al_get_separate_blender(&blender[0], &blender[1], &blender[2], &blender[3], &blender[4], &blender[5]);
+        blend_color = al_get_blend_color();
+    }
+
+    /* start a new batch if the texture or the blending changes, or if the batch is full */
+    if(root != batch.texture || blend != batch.blend || !same_color(blend_color, batch.blend_color) || !same_blender(blender, batch.blender) || batch.quad_count == BATCH_CAPACITY) {
+        image_flush_batch();
+        batch.texture = root;
+        batch.blend = blend;
+        batch.blend_color = blend_color;
+        memcpy(batch.blender, blender, sizeof(batch.blender));
+    }
+
+    /* texture coordinates in pixels of the root bitmap */
+    float u0 = sx + al_get_bitmap_x(bitmap), u1 = u0 + sw;
+    float v0 = sy + al_get_bitmap_y(bitmap), v1 = v0 + sh;
+
+    if(flags & IF_HFLIP) {
+        float tmp = u0;
+        u0 = u1;
+        u1 = tmp;
+    }
+
+    if(flags & IF_VFLIP) {
+        float tmp = v0;
+        v0 = v1;
+        v1 = tmp;
+    }
+
+    /* compute the corners of the quad */
+    const float local_x[4] = { 0.0f, sw, sw, 0.0f };
+    const float local_y[4] = { 0.0f, 0.0f, sh, sh };
+    const float u[4] = { u0, u1, u1, u0 };
+    const float v[4] = { v0, v0, v1, v1 };
+    ALLEGRO_VERTEX corner[4];
+
+    if(angle != 0.0f) {
+        c = cosf(angle);
+        s = sinf(angle);
+    }
+
+    for(int i = 0; i < 4; i++) {
+        float x = (local_x[i] - cx) * xscale;
+        float y = (local_y[i] - cy) * yscale;
+
+        corner[i].x = x * c - y * s + dx;
+        corner[i].y = x * s + y * c + dy;
+        corner[i].z = 0.0f;
+        al_transform_coordinates_3d(transform, &corner[i].x, &corner[i].y, &corner[i].z);
+
+        corner[i].u = u[i];
+        corner[i].v = v[i];
+        corner[i].color = tint;
+    }
+
+    /* write two triangles */
+    ALLEGRO_VERTEX* vertex = batch.vertex + QUAD_VERTICES * batch.quad_count++;
+    vertex[0] = corner[0];
+    vertex[1] = corner[1];
+    vertex[2] = corner[2];
+    vertex[3] = corner[0];
+    vertex[4] = corner[2];
+    vertex[5] = corner[3];
+
+    renderstats_count_batched_draw(al_get_opengl_texture(root), QUAD_VERTICES);
+}
+
+/* sets the blender of a batch */
+void set_batch_blender(batchblend_t blend, ALLEGRO_COLOR blend_color)
+{
+    switch(blend) {
+        case BLEND_NORMAL:
+            al_set_blend_color(blend_color);
+            al_set_separate_blender(
+                batch.blender[0], batch.blender[1], batch.blender[2],
+                batch.blender[3], batch.blender[4], batch.blender[5]
+            );
+            break;
+
+        case BLEND_LIT_BASE:
+            al_set_blend_color(blend_color);
+            al_set_blender(
+
+                /*
+
+                this works with a source image with pre-multiplied alpha:
+
+                    x = dx * (1 - sa) + (sx * sa) * cc
+
+                replace x by r, g, b, a
+
+                x is the result of the blending
+                dx is destination color
+                sx is the source color
+                sa is the source alpha
+                (sx * sa) is the source color with pre-multiplied alpha
+                cc is a constant color
+
+                if sa = 1 (fully opaque), then we'll have x = sx * cc
+                if sa = 0 (fully transparent), then we'll have x = dx
+
+                */
+
+                ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_INVERSE_ALPHA
+            );
+            break;
+
+        case BLEND_LIT_GLOW:
+            al_set_blend_color(blend_color);
+            al_set_blender(
+
+                /*
+
+                this second equation works as follows:
+
+                    y = dy + (sy * sa) * cc
+
+                where dy = x is the result of the first pass
+                and sy = sx is the source pixel of the bitmap that is being drawn.
+                Replace y by r, g, b, a.
+
+                let's analyze two cases:
+
+                1) suppose that sa = 1.0 (fully opaque pixel). This means that,
+                   in the first pass, we had x = sx * cc
+                   as the result. Therefore, we'll have y = sx * cc + sx * cc =
+                   2 * sx * cc now, which will give us a nice colored effect with
+                   both additive and multiplicative blending.
+
+                2) suppose that sa = 0.0 (fully transparent pixel). This means that,
+                   in the first pass, we had x = dx as the
+                   result. Therefore, we'll have y = dx now, which means that we'll
+                   be preserving the background as-is.
+
+                we could modify the cc variable of this second equation for a more
+                refined control of the color. If we had two separate colors for each
+                equation, cc1 and cc2, then the result would be y = sx * (cc1 + cc2).
+                If cc2 = t * cc1 for some 0 < t < 1, then y' = (1 + t) * sx * cc1 <
+                2 * sx * cc1. Seems like overkill, though.
+
+                perhaps a better result would be achieved with y' = sx * cc + cc,
+                because multiplicative blending doesn't always look great depending
+                on the colors. How can we draw y'' = cc * sa? So far I don't see in
+                Allegro an op with a constant offset, neither a way to compute 1/sx.
+                Creating a temporary, single-colored bitmap could work. Is there an
+                easier way? We can draw a black silhouette with blending alone.
+
+                */
+
+                ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_ONE
+            );
+            break;
+    }
+}
+
+/* compare two colors */
+bool same_color(ALLEGRO_COLOR a, ALLEGRO_COLOR b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+/* compare two blenders given as (op, src, dst, alpha_op, alpha_src, alpha_dst) */
+bool same_blender(const int* a, const int* b)
+{
+    return memcmp(a, b, 6 * sizeof(int)) == 0;
+}
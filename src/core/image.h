@@ -80,6 +80,11 @@ void image_set_drawing_target(image_t* new_target);
 image_t* image_drawing_target();
 void image_hold_drawing(bool hold);
 
+/* sprite batching */
+void image_init_batching(); /* called by the video manager */
+void image_release_batching();
+void image_flush_batch(); /* submit the images drawn so far; call before drawing with Allegro directly */
+
 /* drawing primitives */
 void image_clear(color_t color);
 void image_line(int x1, int y1, int x2, int y2, color_t color);
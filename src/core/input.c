@@ -19,6 +19,10 @@
  */
 
 #include <allegro5/allegro.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "input.h"
 #include "engine.h"
 #include "video.h"
@@ -68,18 +72,28 @@ struct input_list_t {
 
 
 
-/* keyboard input */
-static bool a5_key[ALLEGRO_KEY_MAX] = { false };
-
-/* mouse input */
+/* mouse state */
 #define LEFT_MOUSE_BUTTON   1 /* primary button, 1 << 0 */
 #define RIGHT_MOUSE_BUTTON  2 /* secondary button, 1 << 1 */
 #define MIDDLE_MOUSE_BUTTON 4 /* tertiary button, 1 << 2 */
-static struct {
+typedef struct a5mouse_t a5mouse_t;
+struct a5mouse_t {
     int x, y, z; /* position of the cursor */
     int dx, dy, dz; /* deltas */
     int b; /* bit vector of active buttons */
-} a5_mouse = { 0 };
+};
+
+/* keyboard & mouse input, as seen by the game loop */
+static bool a5_key[ALLEGRO_KEY_MAX] = { false };
+static a5mouse_t a5_mouse = { 0 };
+
+/* keyboard & mouse input, as updated by the event handlers */
+typedef struct inputsnapshot_t inputsnapshot_t;
+struct inputsnapshot_t {
+    bool key[ALLEGRO_KEY_MAX];
+    a5mouse_t mouse;
+};
+static inputsnapshot_t device;
 
 /* joystick input */
 #define MAX_JOYS         8 /* maximum number of joysticks */
@@ -130,6 +144,45 @@ static struct {
     int tracked_touch_id;
 } emulated_mouse = { .initialized = false, .tracked_touch_id = -1 };
 
+/*
+
+Input thread: the keyboard, mouse and touch events are read on a dedicated
+thread, so that bursts of events don't delay the game loop. The thread
+coalesces the events into the state of the devices and publishes snapshots
+of that state using a lock-free triple buffer: the input thread writes to
+the back buffer and the game loop reads from the front buffer. These are
+exchanged with the middle buffer atomically. The game loop consumes the
+most recent snapshot once per tick.
+
+Keyboard events are forwarded to the game loop, since there are event
+listeners (e.g., hotkeys) that act on them. If the input thread can't be
+created, the events are handled by the game loop as usual.
+
+*/
+#define FRESH_SNAPSHOT 4 /* flag of the middle index: it holds a snapshot that hasn't been consumed */
+static struct {
+    ALLEGRO_THREAD* thread;
+    ALLEGRO_EVENT_QUEUE* event_queue;
+    ALLEGRO_EVENT_SOURCE forwarded_keys; /* keyboard events forwarded to the game loop */
+    inputsnapshot_t snapshot[3]; /* triple buffer */
+    int back; /* owned by the input thread */
+    int front; /* owned by the game loop */
+    volatile long middle; /* shared; possibly tagged with FRESH_SNAPSHOT */
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+    ALLEGRO_MUTEX* mutex; /* no atomics available */
+#endif
+} input_thread = { .thread = NULL };
+
+static bool start_input_thread();
+static void stop_input_thread();
+static void* run_input_thread(ALLEGRO_THREAD* thread, void* arg);
+static void publish_snapshot();
+static bool consume_snapshot();
+static void add_input_event_source(ALLEGRO_EVENT_SOURCE* event_source);
+static void add_input_event_listener(ALLEGRO_EVENT_TYPE event_type, void (*callback)(const ALLEGRO_EVENT*,void*));
+static inline long exchange_index(volatile long* index, long value);
+static inline long load_index(volatile long* index);
+
 
 /*
  * input_init()
@@ -139,19 +192,28 @@ void input_init()
 {
     logfile_message("Initializing the input system...");
 
+    /* initialize the state of the devices */
+    memset(&device, 0, sizeof(device));
+
+    /* start the input thread */
+    if(start_input_thread())
+        logfile_message("Reading input events on a dedicated thread");
+    else
+        logfile_message("Can't create the input thread. Input events will be read by the game loop");
+
     /* initialize the Allegro input system */
     if(!al_install_keyboard())
         fatal_error("Can't initialize the keyboard");
-    engine_add_event_source(al_get_keyboard_event_source());
-    engine_add_event_listener(ALLEGRO_EVENT_KEY_DOWN, NULL, a5_handle_keyboard_event);
-    engine_add_event_listener(ALLEGRO_EVENT_KEY_UP, NULL, a5_handle_keyboard_event);
+    add_input_event_source(al_get_keyboard_event_source());
+    add_input_event_listener(ALLEGRO_EVENT_KEY_DOWN, a5_handle_keyboard_event);
+    add_input_event_listener(ALLEGRO_EVENT_KEY_UP, a5_handle_keyboard_event);
 
     if(!al_install_mouse())
         fatal_error("Can't initialize the mouse");
-    engine_add_event_source(al_get_mouse_event_source());
-    engine_add_event_listener(ALLEGRO_EVENT_MOUSE_BUTTON_DOWN, NULL, a5_handle_mouse_event);
-    engine_add_event_listener(ALLEGRO_EVENT_MOUSE_BUTTON_UP, NULL, a5_handle_mouse_event);
-    engine_add_event_listener(ALLEGRO_EVENT_MOUSE_AXES, NULL, a5_handle_mouse_event);
+    add_input_event_source(al_get_mouse_event_source());
+    add_input_event_listener(ALLEGRO_EVENT_MOUSE_BUTTON_DOWN, a5_handle_mouse_event);
+    add_input_event_listener(ALLEGRO_EVENT_MOUSE_BUTTON_UP, a5_handle_mouse_event);
+    add_input_event_listener(ALLEGRO_EVENT_MOUSE_AXES, a5_handle_mouse_event);
 
     if(!al_install_joystick())
         fatal_error("Can't initialize the joystick subsystem");
@@ -172,12 +234,12 @@ void input_init()
         al_init_user_event_source(&emulated_mouse.event_source);
         emulated_mouse.initialized = true;
 
-        engine_add_event_source(&emulated_mouse.event_source);
-        engine_add_event_source(al_get_touch_input_event_source());
-        engine_add_event_listener(ALLEGRO_EVENT_TOUCH_BEGIN, NULL, a5_handle_touch_event);
-        engine_add_event_listener(ALLEGRO_EVENT_TOUCH_END, NULL, a5_handle_touch_event);
-        engine_add_event_listener(ALLEGRO_EVENT_TOUCH_MOVE, NULL, a5_handle_touch_event);
-        engine_add_event_listener(ALLEGRO_EVENT_TOUCH_CANCEL, NULL, a5_handle_touch_event);
+        add_input_event_source(&emulated_mouse.event_source);
+        add_input_event_source(al_get_touch_input_event_source());
+        add_input_event_listener(ALLEGRO_EVENT_TOUCH_BEGIN, a5_handle_touch_event);
+        add_input_event_listener(ALLEGRO_EVENT_TOUCH_END, a5_handle_touch_event);
+        add_input_event_listener(ALLEGRO_EVENT_TOUCH_MOVE, a5_handle_touch_event);
+        add_input_event_listener(ALLEGRO_EVENT_TOUCH_CANCEL, a5_handle_touch_event);
     }
 
     /* initialize the input list */
@@ -211,6 +273,15 @@ void input_update()
 {
     int num_joys = min(al_get_num_joysticks(), MAX_JOYS);
 
+    /* read keyboard & mouse input */
+    if(input_thread.thread != NULL) {
+        consume_snapshot();
+    }
+    else {
+        memcpy(a5_key, device.key, sizeof(a5_key));
+        a5_mouse = device.mouse;
+    }
+
     /* read joystick input */
     for(int j = 0; j < num_joys; j++) {
         ALLEGRO_JOYSTICK* joystick = al_get_joystick(j);
@@ -362,9 +433,12 @@ void input_release()
 
     inputmap_release();
 
+    /* stop the input thread before destroying the event sources */
+    stop_input_thread();
+
     if(emulated_mouse.initialized) {
         logfile_message("Disabling mouse emulation via touch input");
-        engine_remove_event_source(&emulated_mouse.event_source);
+        engine_remove_event_source(&emulated_mouse.event_source); /* in case there is no input thread */
         al_destroy_user_event_source(&emulated_mouse.event_source);
         emulated_mouse.initialized = false;
     }
@@ -964,11 +1038,11 @@ void a5_handle_keyboard_event(const ALLEGRO_EVENT* event, void* data)
     switch(event->type) {
 
         case ALLEGRO_EVENT_KEY_DOWN:
-            a5_key[event->keyboard.keycode] = true;
+            device.key[event->keyboard.keycode] = true;
             break;
 
         case ALLEGRO_EVENT_KEY_UP:
-            a5_key[event->keyboard.keycode] = false;
+            device.key[event->keyboard.keycode] = false;
             break;
 
     }
@@ -980,23 +1054,23 @@ void a5_handle_keyboard_event(const ALLEGRO_EVENT* event, void* data)
 void a5_handle_mouse_event(const ALLEGRO_EVENT* event, void* data)
 {
     #define update_mouse_position() do { \
-        a5_mouse.dx = event->mouse.x - a5_mouse.x; \
-        a5_mouse.dy = event->mouse.y - a5_mouse.y; \
-        a5_mouse.dz = event->mouse.z - a5_mouse.z; \
-        a5_mouse.x = event->mouse.x; \
-        a5_mouse.y = event->mouse.y; \
-        a5_mouse.z = event->mouse.z; \
+        device.mouse.dx = event->mouse.x - device.mouse.x; \
+        device.mouse.dy = event->mouse.y - device.mouse.y; \
+        device.mouse.dz = event->mouse.z - device.mouse.z; \
+        device.mouse.x = event->mouse.x; \
+        device.mouse.y = event->mouse.y; \
+        device.mouse.z = event->mouse.z; \
     } while(0)
 
     switch(event->type) {
 
         case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-            a5_mouse.b |= 1 << (event->mouse.button - 1);
+            device.mouse.b |= 1 << (event->mouse.button - 1);
             update_mouse_position();
             break;
 
         case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
-            a5_mouse.b &= ~(1 << (event->mouse.button - 1));
+            device.mouse.b &= ~(1 << (event->mouse.button - 1));
             update_mouse_position();
             break;
 
@@ -1147,6 +1221,189 @@ void a5_handle_touch_event(const ALLEGRO_EVENT* event, void* data)
     }
 }
 
+/* start the input thread. Returns true on success */
+bool start_input_thread()
+{
+    input_thread.thread = NULL;
+    input_thread.event_queue = al_create_event_queue();
+    if(input_thread.event_queue == NULL)
+        return false;
+
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+    input_thread.mutex = al_create_mutex();
+    if(input_thread.mutex == NULL) {
+        al_destroy_event_queue(input_thread.event_queue);
+        return false;
+    }
+#endif
+
+    /* initialize the triple buffer */
+    for(int i = 0; i < 3; i++)
+        memset(&input_thread.snapshot[i], 0, sizeof(inputsnapshot_t));
+    input_thread.back = 0;
+    input_thread.middle = 1;
+    input_thread.front = 2;
+
+    /* forward the keyboard events to the game loop */
+    al_init_user_event_source(&input_thread.forwarded_keys);
+    engine_add_event_source(&input_thread.forwarded_keys);
+
+    /* spawn the thread */
+    input_thread.thread = al_create_thread(run_input_thread, NULL);
+    if(input_thread.thread == NULL) {
+        engine_remove_event_source(&input_thread.forwarded_keys);
+        al_destroy_user_event_source(&input_thread.forwarded_keys);
+        al_destroy_event_queue(input_thread.event_queue);
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+        al_destroy_mutex(input_thread.mutex);
+#endif
+        return false;
+    }
+
+    al_start_thread(input_thread.thread);
+    return true;
+}
+
+/* stop the input thread, if it's running */
+void stop_input_thread()
+{
+    if(input_thread.thread == NULL)
+        return;
+
+    logfile_message("Stopping the input thread...");
+
+    al_join_thread(input_thread.thread, NULL); /* the thread notices it should stop within a timeout */
+    al_destroy_thread(input_thread.thread);
+    input_thread.thread = NULL;
+
+    engine_remove_event_source(&input_thread.forwarded_keys);
+    al_destroy_user_event_source(&input_thread.forwarded_keys);
+    al_destroy_event_queue(input_thread.event_queue);
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+    al_destroy_mutex(input_thread.mutex);
+#endif
+}
+
+/* the input thread: reads and coalesces input events */
+void* run_input_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    const float TIMEOUT = 0.1f; /* in seconds */
+    ALLEGRO_EVENT event;
+
+    while(!al_get_thread_should_stop(thread)) {
+
+        /* wait for an event */
+        if(!al_wait_for_event_timed(input_thread.event_queue, &event, TIMEOUT))
+            continue;
+
+        /* handle all pending events, then publish a single snapshot */
+        do {
+            switch(event.type) {
+                case ALLEGRO_EVENT_KEY_DOWN:
+                case ALLEGRO_EVENT_KEY_UP:
+                    a5_handle_keyboard_event(&event, NULL);
+                    al_emit_user_event(&input_thread.forwarded_keys, &event, NULL);
+                    break;
+
+                case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+                case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+                case ALLEGRO_EVENT_MOUSE_AXES:
+                    a5_handle_mouse_event(&event, NULL);
+                    break;
+
+                case ALLEGRO_EVENT_TOUCH_BEGIN:
+                case ALLEGRO_EVENT_TOUCH_END:
+                case ALLEGRO_EVENT_TOUCH_MOVE:
+                case ALLEGRO_EVENT_TOUCH_CANCEL:
+                    a5_handle_touch_event(&event, NULL); /* emits mouse events to this thread */
+                    break;
+            }
+        } while(al_get_next_event(input_thread.event_queue, &event));
+
+        publish_snapshot();
+    }
+
+    (void)arg;
+    return NULL;
+}
+
+/* publish the state of the devices (called by the input thread) */
+void publish_snapshot()
+{
+    int back = input_thread.back;
+
+    input_thread.snapshot[back] = device;
+    input_thread.back = exchange_index(&input_thread.middle, back | FRESH_SNAPSHOT) & ~FRESH_SNAPSHOT;
+}
+
+/* consume the most recent snapshot, if there is a new one (called by the
+   game loop). Returns true if a new snapshot has been consumed */
+bool consume_snapshot()
+{
+    /* no new snapshot */
+    if(!(load_index(&input_thread.middle) & FRESH_SNAPSHOT))
+        return false;
+
+    /* swap the front and the middle buffers */
+    int front = exchange_index(&input_thread.middle, input_thread.front) & ~FRESH_SNAPSHOT;
+    input_thread.front = front;
+
+    /* read the snapshot */
+    const inputsnapshot_t* snapshot = &input_thread.snapshot[front];
+    memcpy(a5_key, snapshot->key, sizeof(a5_key));
+    a5_mouse = snapshot->mouse;
+
+    return true;
+}
+
+/* add an event source of input devices */
+void add_input_event_source(ALLEGRO_EVENT_SOURCE* event_source)
+{
+    if(input_thread.thread != NULL)
+        al_register_event_source(input_thread.event_queue, event_source);
+    else
+        engine_add_event_source(event_source);
+}
+
+/* add an event listener of input devices. If there is an input
+   thread, the listener is called by that thread instead */
+void add_input_event_listener(ALLEGRO_EVENT_TYPE event_type, void (*callback)(const ALLEGRO_EVENT*,void*))
+{
+    if(input_thread.thread == NULL)
+        engine_add_event_listener(event_type, NULL, callback);
+}
+
+/* atomically set an index of the triple buffer, returning its previous value */
+long exchange_index(volatile long* index, long value)
+{
+#if defined(__GNUC__)
+    return __atomic_exchange_n(index, value, __ATOMIC_ACQ_REL);
+#elif defined(_MSC_VER)
+    return _InterlockedExchange(index, value);
+#else
+    al_lock_mutex(input_thread.mutex);
+    long old_value = *index;
+    *index = value;
+    al_unlock_mutex(input_thread.mutex);
+    return old_value;
+#endif
+}
+
+/* atomically read an index of the triple buffer */
+long load_index(volatile long* index)
+{
+#if defined(__GNUC__)
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+    return _InterlockedOr(index, 0);
+#else
+    al_lock_mutex(input_thread.mutex);
+    long value = *index;
+    al_unlock_mutex(input_thread.mutex);
+    return value;
+#endif
+}
+
 /* log joysticks */
 void log_joysticks()
 {
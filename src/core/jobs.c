@@ -0,0 +1,737 @@
+/*
+ * Open Surge Engine
+ * jobs.c - job system with work stealing
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <stdint.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "jobs.h"
+#include "logfile.h"
+#include "../util/darray.h"
+#include "../util/util.h"
+
+/* the maximum number of worker threads */
+#define MAX_WORKERS 7
+
+/* the number of locks that protect the lists of dependents of the jobs */
+#define DEPENDENCY_LOCKS 16
+
+/* thread-local storage */
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define THREAD_LOCAL __thread
+#endif
+
+/* a job */
+struct job_t {
+    void (*run)(void*); /* the work */
+    void* data; /* user data */
+    volatile long pending; /* number of unfinished dependencies, plus one until the job is submitted */
+    volatile long references; /* the handle of the caller and the scheduler */
+    volatile long is_finished;
+    volatile long waiter; /* index of the thread that waits for the job, or -1 */
+    DARRAY(job_t*, dependent); /* jobs that depend on this one; protected by a dependency lock */
+};
+
+/* a deque of ready jobs. The owner thread pushes and pops at the
+   end; other threads steal the oldest jobs from the beginning */
+typedef struct jobqueue_t jobqueue_t;
+struct jobqueue_t {
+    ALLEGRO_MUTEX* mutex;
+    DARRAY(job_t*, job);
+    size_t head; /* index of the oldest job */
+};
+
+/* a chunk of a parallel loop */
+typedef struct jobchunk_t jobchunk_t;
+struct jobchunk_t {
+    void (*run)(int,int,void*);
+    void* data;
+    int first, last;
+};
+
+/* private data */
+static ALLEGRO_THREAD* worker[MAX_WORKERS];
+static int worker_count = 0;
+static bool is_single_threaded = true;
+static bool is_verifying = false; /* see jobs_set_verification() */
+static jobqueue_t queue[1 + MAX_WORKERS]; /* queue[0] belongs to the main thread */
+static volatile long ready_count = 0; /* number of jobs in the queues */
+static ALLEGRO_MUTEX* dependency_mutex[DEPENDENCY_LOCKS]; /* picked by the address of the prerequisite */
+
+/* sleeping threads. Idle workers wait for ready jobs; a thread that waits
+   for a job sleeps on its own condition, so that it alone is woken up */
+static ALLEGRO_MUTEX* sleep_mutex = NULL; /* protects the data below */
+static ALLEGRO_COND* work_cond = NULL; /* signaled when a job becomes ready */
+static ALLEGRO_COND* thread_cond[1 + MAX_WORKERS]; /* signaled when the job a thread waits for is finished */
+static bool is_waiting[1 + MAX_WORKERS]; /* is the i-th thread sleeping in jobs_wait()? */
+static int idle_count = 0; /* number of workers sleeping on work_cond */
+static volatile long sleeper_count = 0; /* idle workers plus waiting threads; read without the lock */
+static volatile long must_quit = 0;
+
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+static ALLEGRO_MUTEX* atomic_mutex = NULL; /* no atomics available */
+#endif
+
+#if defined(THREAD_LOCAL)
+static THREAD_LOCAL int thread_index = 0; /* index of the queue of the current thread */
+#define current_thread_index() (thread_index)
+#else
+#define current_thread_index() 0 /* all threads push to queue[0] */
+#endif
+
+/* private functions */
+static void* worker_thread(ALLEGRO_THREAD* thread, void* arg);
+static job_t* take_job(int index);
+static void run_job(job_t* job);
+static void make_ready(job_t* job);
+static void wake_up_a_thread();
+static void release_job(job_t* job);
+static job_t* pop_job(jobqueue_t* q);
+static job_t* steal_job(jobqueue_t* q);
+static inline ALLEGRO_MUTEX* dependency_lock(const job_t* job);
+static inline long add_and_fetch(volatile long* value, long delta);
+static inline long load_long(volatile long* value);
+static inline void store_long(volatile long* value, long new_value);
+static void run_chunk(void* data);
+static void nop(void* data);
+static void nop_loop(int first, int last, void* data);
+static void busy_loop(int first, int last, void* data);
+static void report(const char* name, int n, double seconds, double baseline);
+
+
+
+/*
+ * jobs_init()
+ * Initializes the job system. In single-threaded mode,
+ * there are no worker threads
+ */
+void jobs_init(bool single_threaded)
+{
+    int cpu_count = al_get_cpu_count();
+    int wanted_workers = single_threaded ? 0 : clip(cpu_count - 1, 0, MAX_WORKERS);
+
+    logfile_message("Initializing the job system...");
+
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+    atomic_mutex = al_create_mutex();
+#endif
+
+    sleep_mutex = al_create_mutex();
+    work_cond = al_create_cond();
+    idle_count = 0;
+    store_long(&sleeper_count, 0);
+    store_long(&must_quit, 0);
+    store_long(&ready_count, 0);
+
+    for(int i = 0; i < DEPENDENCY_LOCKS; i++)
+        dependency_mutex[i] = al_create_mutex();
+
+    for(int i = 0; i <= MAX_WORKERS; i++) {
+        queue[i].mutex = al_create_mutex();
+        queue[i].head = 0;
+        darray_init(queue[i].job);
+        thread_cond[i] = al_create_cond();
+        is_waiting[i] = false;
+    }
+
+    /* spawn the worker threads */
+    worker_count = 0;
+    for(int i = 0; i < wanted_workers; i++) {
+        ALLEGRO_THREAD* thread = al_create_thread(worker_thread, (void*)(intptr_t)(1 + i));
+        if(thread == NULL)
+            break;
+
+        worker[worker_count++] = thread;
+        al_start_thread(thread);
+    }
+
+    /* without workers, the jobs run on the thread that waits for them */
+    is_single_threaded = (worker_count == 0);
+
+    logfile_message("The job system is using %d worker thread(s)%s", worker_count, is_single_threaded ? " (single-threaded mode)" : "");
+}
+
+/*
+ * jobs_release()
+ * Releases the job system
+ */
+void jobs_release()
+{
+    logfile_message("Releasing the job system...");
+
+    /* stop the worker threads */
+    al_lock_mutex(sleep_mutex);
+    store_long(&must_quit, 1);
+    al_broadcast_cond(work_cond);
+    al_unlock_mutex(sleep_mutex);
+
+    for(int i = 0; i < worker_count; i++) {
+        al_join_thread(worker[i], NULL);
+        al_destroy_thread(worker[i]);
+    }
+    worker_count = 0;
+    is_single_threaded = true;
+
+    /* release the queues */
+    for(int i = 0; i <= MAX_WORKERS; i++) {
+        if(darray_length(queue[i].job) > queue[i].head)
+            logfile_message("The job system is being released with pending jobs");
+
+        darray_release(queue[i].job);
+        al_destroy_mutex(queue[i].mutex);
+        al_destroy_cond(thread_cond[i]);
+        queue[i].mutex = NULL;
+        thread_cond[i] = NULL;
+    }
+
+    for(int i = 0; i < DEPENDENCY_LOCKS; i++) {
+        al_destroy_mutex(dependency_mutex[i]);
+        dependency_mutex[i] = NULL;
+    }
+
+    al_destroy_cond(work_cond);
+    al_destroy_mutex(sleep_mutex);
+    work_cond = NULL;
+    sleep_mutex = NULL;
+
+#if !defined(__GNUC__) && !defined(_MSC_VER)
+    al_destroy_mutex(atomic_mutex);
+    atomic_mutex = NULL;
+#endif
+}
+
+/*
+ * jobs_thread_count()
+ * The number of threads that run jobs, including the main thread
+ */
+int jobs_thread_count()
+{
+    return 1 + worker_count;
+}
+
+/*
+ * jobs_set_verification()
+ * Enables or disables verification. When enabled, the users of parallel loops
+ * replay the work serially and check that the results are bit-identical. This
+ * is slow and meant for testing
+ */
+void jobs_set_verification(bool enabled)
+{
+    is_verifying = enabled;
+
+    if(enabled)
+        logfile_message("The job system will verify parallel work");
+}
+
+/*
+ * jobs_is_verifying()
+ * Should parallel work be replayed serially and checked?
+ * See jobs_set_verification()
+ */
+bool jobs_is_verifying()
+{
+    return is_verifying;
+}
+
+/*
+ * jobs_create()
+ * Creates a job that calls run(data). The job won't run until it's submitted
+ */
+job_t* jobs_create(void (*run)(void*), void* data)
+{
+    job_t* job = mallocx(sizeof *job);
+
+    job->run = run;
+    job->data = data;
+    job->pending = 1;
+    job->references = 2;
+    job->is_finished = 0;
+    job->waiter = -1;
+    darray_init(job->dependent);
+
+    return job;
+}
+
+/*
+ * jobs_add_dependency()
+ * The job will run only after the prerequisite is finished.
+ * Call this before submitting the job
+ */
+void jobs_add_dependency(job_t* job, job_t* prerequisite)
+{
+    ALLEGRO_MUTEX* lock = dependency_lock(prerequisite);
+
+    al_lock_mutex(lock);
+
+    if(!load_long(&prerequisite->is_finished)) {
+        add_and_fetch(&job->pending, 1);
+        darray_push(prerequisite->dependent, job);
+    }
+
+    al_unlock_mutex(lock);
+}
+
+/*
+ * jobs_submit()
+ * Submits a job. It will run as soon as its dependencies are finished
+ */
+void jobs_submit(job_t* job)
+{
+    if(add_and_fetch(&job->pending, -1) == 0)
+        make_ready(job);
+}
+
+/*
+ * jobs_wait()
+ * Waits until a submitted job is finished and releases it.
+ * The calling thread runs ready jobs while it waits
+ */
+void jobs_wait(job_t* job)
+{
+    int index = current_thread_index();
+
+    /* tell the job who is waiting for it */
+    store_long(&job->waiter, index);
+
+    while(!load_long(&job->is_finished)) {
+
+        /* help */
+        job_t* other = take_job(index);
+        if(other != NULL) {
+            run_job(other);
+            continue;
+        }
+
+        /* nobody else can run the job */
+        if(is_single_threaded)
+            fatal_error("Deadlock in the job system: waiting for a job that can't be run");
+
+        /* sleep until the job is finished or until there is a job to help with */
+        al_lock_mutex(sleep_mutex);
+        is_waiting[index] = true;
+        add_and_fetch(&sleeper_count, 1);
+
+        while(!load_long(&job->is_finished) && load_long(&ready_count) <= 0)
+            al_wait_cond(thread_cond[index], sleep_mutex);
+
+        add_and_fetch(&sleeper_count, -1);
+        is_waiting[index] = false;
+        al_unlock_mutex(sleep_mutex);
+
+    }
+
+    release_job(job);
+}
+
+/*
+ * jobs_parallel_for()
+ * Calls run(first, last, data) for chunks of at most chunk_size elements
+ * of the [0, count) range, in parallel, and waits until all are done
+ */
+void jobs_parallel_for(int count, int chunk_size, void (*run)(int,int,void*), void* data)
+{
+    int chunk_count;
+
+    /* count the chunks */
+    chunk_size = max(1, chunk_size);
+    chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    /* nothing to split: run the chunks in order on this thread */
+    if(chunk_count <= 1 || worker_count == 0) {
+        for(int first = 0; first < count; first += chunk_size)
+            run(first, min(first + chunk_size, count), data);
+        return;
+    }
+
+    /* submit a job for each chunk but the first one */
+    jobchunk_t* chunk = mallocx(chunk_count * sizeof *chunk);
+    job_t** job = mallocx(chunk_count * sizeof *job);
+
+    for(int i = 0; i < chunk_count; i++) {
+        chunk[i].run = run;
+        chunk[i].data = data;
+        chunk[i].first = i * chunk_size;
+        chunk[i].last = min(chunk[i].first + chunk_size, count);
+    }
+
+    for(int i = 1; i < chunk_count; i++) {
+        job[i] = jobs_create(run_chunk, &chunk[i]);
+        jobs_submit(job[i]);
+    }
+
+    /* run the first chunk on this thread and help with the others */
+    run_chunk(&chunk[0]);
+    for(int i = 1; i < chunk_count; i++)
+        jobs_wait(job[i]);
+
+    /* done */
+    free(job);
+    free(chunk);
+}
+
+/*
+ * jobs_benchmark()
+ * Measures the scheduling overhead of the job system and the speedup
+ * of a parallel loop, comparing both to running the same work serially
+ * on the calling thread, and logs the results
+ */
+void jobs_benchmark()
+{
+    const int n = 10000;
+    job_t** job = mallocx(n * sizeof *job);
+    double start, serial;
+
+    logfile_message("Benchmarking the job system with %d thread(s)...", jobs_thread_count());
+
+    /* baseline: calling the empty job directly */
+    start = al_get_time();
+    for(int i = 0; i < n; i++)
+        nop(NULL);
+    serial = al_get_time() - start;
+    report("direct calls", n, serial, serial);
+
+    /* independent jobs */
+    start = al_get_time();
+    for(int i = 0; i < n; i++) {
+        job[i] = jobs_create(nop, NULL);
+        jobs_submit(job[i]);
+    }
+    for(int i = 0; i < n; i++)
+        jobs_wait(job[i]);
+    report("independent jobs", n, al_get_time() - start, serial);
+
+    /* a chain of dependent jobs */
+    start = al_get_time();
+    for(int i = 0; i < n; i++) {
+        job[i] = jobs_create(nop, NULL);
+        if(i > 0)
+            jobs_add_dependency(job[i], job[i-1]);
+    }
+    for(int i = n - 1; i >= 0; i--)
+        jobs_submit(job[i]);
+    for(int i = 0; i < n; i++)
+        jobs_wait(job[i]);
+    report("chain of jobs", n, al_get_time() - start, serial);
+
+    /* fan-in: the last job depends on all the others */
+    start = al_get_time();
+    for(int i = 0; i < n; i++)
+        job[i] = jobs_create(nop, NULL);
+    for(int i = 0; i < n - 1; i++)
+        jobs_add_dependency(job[n-1], job[i]);
+    for(int i = 0; i < n; i++)
+        jobs_submit(job[i]);
+    for(int i = n - 1; i >= 0; i--)
+        jobs_wait(job[i]);
+    report("fan-in", n, al_get_time() - start, serial);
+
+    /* parallel loop with one element per chunk */
+    start = al_get_time();
+    jobs_parallel_for(n, 1, nop_loop, NULL);
+    report("parallel-for chunks", n, al_get_time() - start, serial);
+
+    /* a parallel loop that does some work, compared to the same loop run serially */
+    float* result = mallocx(n * sizeof *result);
+
+    start = al_get_time();
+    busy_loop(0, n, result);
+    serial = al_get_time() - start;
+    report("serial busy loop", n, serial, serial);
+
+    start = al_get_time();
+    jobs_parallel_for(n, 64, busy_loop, result);
+    report("parallel busy loop", n, al_get_time() - start, serial);
+
+    /* done */
+    free(result);
+    free(job);
+}
+
+
+
+/*
+ * private
+ */
+
+/* worker thread */
+void* worker_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    int index = (int)(intptr_t)arg;
+
+#if defined(THREAD_LOCAL)
+    thread_index = index;
+#endif
+
+    while(!load_long(&must_quit)) {
+
+        /* run a job */
+        job_t* job = take_job(index);
+        if(job != NULL) {
+            run_job(job);
+            continue;
+        }
+
+        /* sleep until there is a job */
+        al_lock_mutex(sleep_mutex);
+        idle_count++;
+        add_and_fetch(&sleeper_count, 1);
+
+        while(load_long(&ready_count) <= 0 && !load_long(&must_quit))
+            al_wait_cond(work_cond, sleep_mutex);
+
+        add_and_fetch(&sleeper_count, -1);
+        idle_count--;
+        al_unlock_mutex(sleep_mutex);
+
+    }
+
+    (void)thread;
+    return NULL;
+}
+
+/* takes a ready job from the queue of the given thread, or steals one from
+   another thread. Returns NULL if there are no ready jobs */
+job_t* take_job(int index)
+{
+    job_t* job = NULL;
+
+    /* single-threaded mode: run the jobs in the order they became ready */
+    if(is_single_threaded)
+        job = steal_job(&queue[0]);
+
+    /* pop the most recent job of our own queue, or steal the oldest job of another */
+    else {
+        job = pop_job(&queue[index]);
+        for(int i = 1; job == NULL && i <= worker_count; i++)
+            job = steal_job(&queue[(index + i) % (1 + worker_count)]);
+    }
+
+    /* update the counter */
+    if(job != NULL)
+        add_and_fetch(&ready_count, -1);
+
+    return job;
+}
+
+/* runs a job, makes its dependents ready and wakes up the thread that waits for it */
+void run_job(job_t* job)
+{
+    ALLEGRO_MUTEX* lock = dependency_lock(job);
+
+    job->run(job->data);
+
+    /* no dependents can be added after the job is finished */
+    al_lock_mutex(lock);
+    store_long(&job->is_finished, 1);
+    al_unlock_mutex(lock);
+
+    for(size_t i = 0; i < darray_length(job->dependent); i++) {
+        job_t* dependent = job->dependent[i];
+        if(add_and_fetch(&dependent->pending, -1) == 0)
+            make_ready(dependent);
+    }
+    darray_clear(job->dependent);
+
+    /* wake up the waiter, if it's sleeping */
+    long waiter = load_long(&job->waiter);
+    if(waiter >= 0 && load_long(&sleeper_count) > 0) {
+        al_lock_mutex(sleep_mutex);
+        if(is_waiting[waiter])
+            al_signal_cond(thread_cond[waiter]);
+        al_unlock_mutex(sleep_mutex);
+    }
+
+    release_job(job);
+}
+
+/* pushes a job to the queue of the current thread */
+void make_ready(job_t* job)
+{
+    jobqueue_t* q = &queue[current_thread_index()];
+
+    al_lock_mutex(q->mutex);
+    darray_push(q->job, job);
+    al_unlock_mutex(q->mutex);
+
+    add_and_fetch(&ready_count, 1);
+    wake_up_a_thread();
+}
+
+/* wakes up a single sleeping thread, so that it runs a job that has become
+   ready. Idle workers are preferred over the threads that wait for a job */
+void wake_up_a_thread()
+{
+    /* this gotta be fast when no one is sleeping */
+    if(load_long(&sleeper_count) == 0)
+        return;
+
+    al_lock_mutex(sleep_mutex);
+
+    if(idle_count > 0)
+        al_signal_cond(work_cond);
+    else {
+        for(int i = 0; i <= worker_count; i++) {
+            if(is_waiting[i]) {
+                al_signal_cond(thread_cond[i]);
+                break;
+            }
+        }
+    }
+
+    al_unlock_mutex(sleep_mutex);
+}
+
+/* releases a reference to a job */
+void release_job(job_t* job)
+{
+    if(add_and_fetch(&job->references, -1) == 0) {
+        darray_release(job->dependent);
+        free(job);
+    }
+}
+
+/* pops the most recent job of a queue */
+job_t* pop_job(jobqueue_t* q)
+{
+    job_t* job = NULL;
+
+    al_lock_mutex(q->mutex);
+    if(darray_length(q->job) > q->head) {
+        darray_pop(q->job, job);
+        if(darray_length(q->job) == q->head) {
+            darray_clear(q->job);
+            q->head = 0;
+        }
+    }
+    al_unlock_mutex(q->mutex);
+
+    return job;
+}
+
+/* steals the oldest job of a queue */
+job_t* steal_job(jobqueue_t* q)
+{
+    job_t* job = NULL;
+
+    al_lock_mutex(q->mutex);
+    if(darray_length(q->job) > q->head) {
+        job = q->job[q->head++];
+        if(darray_length(q->job) == q->head) {
+            darray_clear(q->job);
+            q->head = 0;
+        }
+    }
+    al_unlock_mutex(q->mutex);
+
+    return job;
+}
+
+/* the lock that protects the list of dependents of a job */
+ALLEGRO_MUTEX* dependency_lock(const job_t* job)
+{
+    return dependency_mutex[((uintptr_t)job / sizeof(*job)) % DEPENDENCY_LOCKS];
+}
+
+/* atomically add delta to a value, returning the new value */
+long add_and_fetch(volatile long* value, long delta)
+{
+#if defined(__GNUC__)
+    return __atomic_add_fetch(value, delta, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+    return _InterlockedExchangeAdd(value, delta) + delta;
+#else
+    al_lock_mutex(atomic_mutex);
+    long new_value = (*value += delta);
+    al_unlock_mutex(atomic_mutex);
+    return new_value;
+#endif
+}
+
+/* atomically read a value */
+long load_long(volatile long* value)
+{
+#if defined(__GNUC__)
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+    return _InterlockedOr(value, 0);
+#else
+    al_lock_mutex(atomic_mutex);
+    long current_value = *value;
+    al_unlock_mutex(atomic_mutex);
+    return current_value;
+#endif
+}
+
+/* atomically write a value */
+void store_long(volatile long* value, long new_value)
+{
+#if defined(__GNUC__)
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER)
+    _InterlockedExchange(value, new_value);
+#else
+    al_lock_mutex(atomic_mutex);
+    *value = new_value;
+    al_unlock_mutex(atomic_mutex);
+#endif
+}
+
+/* runs a chunk of a parallel loop */
+void run_chunk(void* data)
+{
+    jobchunk_t* chunk = (jobchunk_t*)data;
+    chunk->run(chunk->first, chunk->last, chunk->data);
+}
+
+/* benchmark: an empty job */
+void nop(void* data)
+{
+    (void)data;
+}
+
+/* benchmark: an empty loop */
+void nop_loop(int first, int last, void* data)
+{
+    (void)first;
+    (void)last;
+    (void)data;
+}
+
+/* benchmark: a loop that does some arithmetic for each element */
+void busy_loop(int first, int last, void* data)
+{
+    float* result = (float*)data;
+
+    for(int i = first; i < last; i++) {
+        float x = (float)i;
+        for(int j = 0; j < 1000; j++)
+            x = x * 0.999f + 1.0f;
+        result[i] = x;
+    }
+}
+
+/* benchmark: log a result, compared to a baseline */
+void report(const char* name, int n, double seconds, double baseline)
+{
+    logfile_message("%-20s %8.3f us per job (%d jobs in %.2f ms, %.2fx the baseline)", name, 1e6 * seconds / n, n, 1e3 * seconds, seconds / max(baseline, 1e-9));
+}
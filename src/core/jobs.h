@@ -0,0 +1,69 @@
+/*
+ * Open Surge Engine
+ * jobs.h - job system with work stealing
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <stdbool.h>
+
+/*
+
+A job is a small unit of work that runs on a fixed pool of worker threads.
+Each thread owns a deque of ready jobs: it pushes and pops jobs at one end,
+and idle threads steal jobs from the other end of the deques of the others.
+
+A job may depend on other jobs, in which case it becomes ready only after
+all of them are finished. A thread that waits for a job helps to run the
+ready jobs in the meantime.
+
+In single-threaded mode there are no workers: jobs run on the thread that
+waits for them, in the order in which they became ready. The outcome is
+deterministic.
+
+Every job that is created must be submitted and then waited for, which
+releases it. Jobs may be created, submitted and waited for by other jobs.
+
+*/
+
+/* a job */
+typedef struct job_t job_t;
+
+/* initialization */
+void jobs_init(bool single_threaded);
+void jobs_release();
+int jobs_thread_count(); /* number of threads that run jobs, including the main thread */
+
+/* jobs */
+job_t* jobs_create(void (*run)(void*), void* data); /* the job won't run until it's submitted */
+void jobs_add_dependency(job_t* job, job_t* prerequisite); /* job will run after prerequisite. Call before submitting job */
+void jobs_submit(job_t* job); /* the job will run as soon as its dependencies are finished */
+void jobs_wait(job_t* job); /* wait until the job is finished and release it */
+
+/* parallel loops */
+void jobs_parallel_for(int count, int chunk_size, void (*run)(int,int,void*), void* data); /* calls run(first, last, data) for chunks of [0, count) and waits */
+
+/* benchmark */
+void jobs_benchmark(); /* measure the scheduling overhead and log the results */
+
+/* verification */
+void jobs_set_verification(bool enabled); /* should parallel work be replayed serially and checked? */
+bool jobs_is_verifying(); /* see jobs_set_verification() */
+
+#endif
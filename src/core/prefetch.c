@@ -0,0 +1,538 @@
+/*
+ * Open Surge Engine
+ * prefetch.c - background prefetching of assets based on recorded manifests
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+#include <allegro5/allegro_physfs.h>
+#include <string.h>
+#include "prefetch.h"
+#include "asset.h"
+#include "logfile.h"
+#include "resourcemanager.h"
+#include "../util/darray.h"
+#include "../util/djb2.h"
+#include "../util/util.h"
+#include "../util/stringutil.h"
+
+/* where the manifests are stored (user-modifiable data directory) */
+#define MANIFEST_FOLDER "cache/prefetch"
+
+/* the maximum number of worker threads */
+#define MAX_WORKERS 4
+
+/* asset types */
+typedef enum prefetchtype_t prefetchtype_t;
+enum prefetchtype_t {
+    PREFETCH_IMAGE,
+    PREFETCH_SAMPLE
+};
+
+static const char* TYPE_NAME[] = {
+    [PREFETCH_IMAGE] = "image",
+    [PREFETCH_SAMPLE] = "sample"
+};
+
+/* a prefetch job decodes a single asset */
+typedef struct prefetchjob_t prefetchjob_t;
+struct prefetchjob_t {
+    prefetchtype_t type;
+    enum {
+        JOB_PENDING,    /* waiting for a worker */
+        JOB_RUNNING,    /* being decoded by a worker */
+        JOB_DONE,       /* decoded; waiting to be claimed */
+        JOB_CLAIMED     /* claimed by the main thread (data is no longer owned by the job) */
+    } state;
+    char* path; /* relative path */
+    void* data; /* ALLEGRO_BITMAP* or ALLEGRO_SAMPLE*, depending on the type */
+};
+
+/* an entry of a manifest being recorded */
+typedef struct manifestentry_t manifestentry_t;
+struct manifestentry_t {
+    prefetchtype_t type;
+    char* path;
+};
+
+/* private data */
+static ALLEGRO_MUTEX* mutex = NULL;
+static ALLEGRO_COND* cond = NULL;
+static ALLEGRO_THREAD* worker[MAX_WORKERS];
+static int worker_count = 0;
+static bool must_quit = false;
+
+STATIC_DARRAY(prefetchjob_t, job); /* protected by the mutex */
+static size_t next_job = 0; /* index of the next job to be picked by a worker */
+static int hits = 0; /* how many decoded assets have been claimed */
+static char* prefetch_key = NULL; /* the key we're prefetching */
+
+STATIC_DARRAY(manifestentry_t, recording); /* main thread only */
+static char* recording_key = NULL; /* the key whose manifest we're recording */
+
+/* private functions */
+static void* worker_thread(ALLEGRO_THREAD* thread, void* arg);
+static void* decode_asset(prefetchtype_t type, const char* path);
+static void destroy_asset(prefetchtype_t type, void* data);
+static void* claim(prefetchtype_t type, const char* path);
+static void record(prefetchtype_t type, const char* path);
+static bool read_manifest(const char* key);
+static bool write_manifest(const char* key);
+static const char* manifest_path(const char* key, char* buffer, size_t buffer_size);
+
+
+
+/*
+ * prefetch_init()
+ * Initializes the prefetcher
+ */
+void prefetch_init()
+{
+    int cpu_count = al_get_cpu_count();
+    int wanted_workers = clip(cpu_count - 1, 1, MAX_WORKERS);
+
+    logfile_message("Initializing the prefetcher...");
+
+    mutex = al_create_mutex();
+    cond = al_create_cond();
+    must_quit = false;
+
+    darray_init(job);
+    darray_init(recording);
+    next_job = 0;
+    hits = 0;
+
+    /* spawn the worker threads */
+    worker_count = 0;
+    for(int i = 0; i < wanted_workers; i++) {
+        ALLEGRO_THREAD* thread = al_create_thread(worker_thread, NULL);
+        if(thread == NULL)
+            break;
+
+        worker[worker_count++] = thread;
+        al_start_thread(thread);
+    }
+
+    logfile_message("The prefetcher is using %d worker thread(s)", worker_count);
+}
+
+/*
+ * prefetch_release()
+ * Releases the prefetcher
+ */
+void prefetch_release()
+{
+    logfile_message("Releasing the prefetcher...");
+
+    /* discard the current manifest & unclaimed assets */
+    if(recording_key != NULL)
+        prefetch_stop_recording();
+    prefetch_cancel();
+
+    /* stop the worker threads */
+    al_lock_mutex(mutex);
+    must_quit = true;
+    al_broadcast_cond(cond);
+    al_unlock_mutex(mutex);
+
+    for(int i = 0; i < worker_count; i++) {
+        al_join_thread(worker[i], NULL);
+        al_destroy_thread(worker[i]);
+    }
+    worker_count = 0;
+
+    /* release the data */
+    darray_release(recording);
+    darray_release(job);
+
+    al_destroy_cond(cond);
+    al_destroy_mutex(mutex);
+    cond = NULL;
+    mutex = NULL;
+}
+
+/*
+ * prefetch_start()
+ * Start decoding the assets listed in the manifest of the given key
+ * on worker threads. Calling this function again with the same key
+ * while the assets are being prefetched does nothing.
+ */
+void prefetch_start(const char* key)
+{
+    /* already prefetching? */
+    if(prefetch_key != NULL && strcmp(prefetch_key, key) == 0)
+        return;
+
+    /* discard a previous prefetch */
+    prefetch_cancel();
+
+    /* nothing to do */
+    if(worker_count == 0)
+        return;
+
+    /* read the manifest and schedule the jobs */
+    if(read_manifest(key)) {
+        logfile_message("Prefetching %d asset(s) of \"%s\"...", (int)darray_length(job), key);
+        prefetch_key = str_dup(key);
+    }
+}
+
+/*
+ * prefetch_cancel()
+ * Discard the assets that haven't been claimed and cancel the pending jobs
+ */
+void prefetch_cancel()
+{
+    if(mutex == NULL)
+        return;
+
+    al_lock_mutex(mutex);
+
+    /* workers will not pick pending jobs anymore */
+    next_job = darray_length(job);
+
+    /* wait for the running jobs */
+    for(;;) {
+        bool is_running = false;
+
+        for(size_t i = 0; i < darray_length(job) && !is_running; i++)
+            is_running = (job[i].state == JOB_RUNNING);
+
+        if(!is_running)
+            break;
+
+        al_wait_cond(cond, mutex);
+    }
+
+    /* release the jobs */
+    for(size_t i = 0; i < darray_length(job); i++) {
+        if(job[i].state == JOB_DONE && job[i].data != NULL)
+            destroy_asset(job[i].type, job[i].data);
+        free(job[i].path);
+    }
+
+    if(prefetch_key != NULL)
+        logfile_message("Prefetched %d of %d asset(s) of \"%s\"", hits, (int)darray_length(job), prefetch_key);
+
+    darray_clear(job);
+    next_job = 0;
+    hits = 0;
+
+    al_unlock_mutex(mutex);
+
+    /* clear the key */
+    if(prefetch_key != NULL) {
+        free(prefetch_key);
+        prefetch_key = NULL;
+    }
+}
+
+/*
+ * prefetch_start_recording()
+ * Start recording the manifest of the given key, i.e., keep
+ * track of the assets that are loaded from now on
+ */
+void prefetch_start_recording(const char* key)
+{
+    if(recording_key != NULL)
+        prefetch_stop_recording();
+
+    recording_key = str_dup(key);
+}
+
+/*
+ * prefetch_stop_recording()
+ * Stop recording and write the manifest to the cache
+ */
+void prefetch_stop_recording()
+{
+    if(recording_key == NULL)
+        return;
+
+    /* write the manifest */
+    if(!write_manifest(recording_key))
+        logfile_message("Can't write the prefetch manifest of \"%s\"", recording_key);
+
+    /* clear the recording */
+    for(size_t i = 0; i < darray_length(recording); i++)
+        free(recording[i].path);
+    darray_clear(recording);
+
+    free(recording_key);
+    recording_key = NULL;
+}
+
+/*
+ * prefetch_record_image()
+ * Add an image to the manifest being recorded, if any
+ */
+void prefetch_record_image(const char* path)
+{
+    record(PREFETCH_IMAGE, path);
+}
+
+/*
+ * prefetch_record_sample()
+ * Add a sample to the manifest being recorded, if any
+ */
+void prefetch_record_sample(const char* path)
+{
+    record(PREFETCH_SAMPLE, path);
+}
+
+/*
+ * prefetch_claim_image()
+ * Claim an image decoded in the background. Returns a memory bitmap
+ * owned by the caller, or NULL if the image hasn't been prefetched.
+ * If the image is being decoded, we'll wait for it.
+ */
+ALLEGRO_BITMAP* prefetch_claim_image(const char* path)
+{
+    return (ALLEGRO_BITMAP*)claim(PREFETCH_IMAGE, path);
+}
+
+/*
+ * prefetch_claim_sample()
+ * Claim a sample decoded in the background. Returns a sample owned
+ * by the caller, or NULL if the sample hasn't been prefetched.
+ */
+ALLEGRO_SAMPLE* prefetch_claim_sample(const char* path)
+{
+    return (ALLEGRO_SAMPLE*)claim(PREFETCH_SAMPLE, path);
+}
+
+
+
+/*
+ * private
+ */
+
+/* worker thread */
+void* worker_thread(ALLEGRO_THREAD* thread, void* arg)
+{
+    /* these settings are thread-specific */
+    al_set_physfs_file_interface();
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP); /* we can't create textures in this thread */
+
+    al_lock_mutex(mutex);
+    while(!must_quit) {
+
+        /* skip the jobs claimed by the main thread before being picked */
+        while(next_job < darray_length(job) && job[next_job].state != JOB_PENDING)
+            next_job++;
+
+        /* wait for a job */
+        if(next_job >= darray_length(job)) {
+            al_wait_cond(cond, mutex);
+            continue;
+        }
+
+        /* pick a job. job[] may be reallocated while we decode
+           the asset, so we store the index instead of a pointer */
+        size_t index = next_job++;
+        prefetchtype_t type = job[index].type;
+        const char* path = job[index].path; /* won't be freed while the job is running */
+        job[index].state = JOB_RUNNING;
+
+        /* decode the asset */
+        al_unlock_mutex(mutex);
+        void* data = decode_asset(type, path);
+        al_lock_mutex(mutex);
+
+        /* done */
+        job[index].data = data;
+        job[index].state = JOB_DONE;
+        al_broadcast_cond(cond);
+
+    }
+    al_unlock_mutex(mutex);
+
+    (void)thread;
+    (void)arg;
+    return NULL;
+}
+
+/* decode an asset. This is called by a worker thread */
+void* decode_asset(prefetchtype_t type, const char* path)
+{
+    /* we don't call asset_path(), as it's not thread-safe. If the
+       path isn't found, the main thread will load the asset later */
+    switch(type) {
+        case PREFETCH_IMAGE:
+            return al_load_bitmap(path);
+
+        case PREFETCH_SAMPLE:
+            return al_load_sample(path);
+    }
+
+    return NULL;
+}
+
+/* destroy an asset that hasn't been claimed */
+void destroy_asset(prefetchtype_t type, void* data)
+{
+    switch(type) {
+        case PREFETCH_IMAGE:
+            al_destroy_bitmap((ALLEGRO_BITMAP*)data);
+            break;
+
+        case PREFETCH_SAMPLE:
+            al_destroy_sample((ALLEGRO_SAMPLE*)data);
+            break;
+    }
+}
+
+/* claim a prefetched asset */
+void* claim(prefetchtype_t type, const char* path)
+{
+    void* data = NULL;
+
+    /* nothing is being prefetched */
+    if(prefetch_key == NULL)
+        return NULL;
+
+    al_lock_mutex(mutex);
+    for(size_t i = 0; i < darray_length(job); i++) {
+        if(job[i].type != type || strcmp(job[i].path, path) != 0)
+            continue;
+
+        /* not picked yet: the caller will load the asset itself */
+        if(job[i].state == JOB_PENDING) {
+            job[i].state = JOB_CLAIMED;
+            break;
+        }
+
+        /* wait for the worker */
+        while(job[i].state == JOB_RUNNING)
+            al_wait_cond(cond, mutex);
+
+        /* take ownership of the data */
+        if(job[i].state == JOB_DONE) {
+            data = job[i].data;
+            job[i].data = NULL;
+            job[i].state = JOB_CLAIMED;
+            hits += (data != NULL);
+        }
+
+        break;
+    }
+    al_unlock_mutex(mutex);
+
+    return data;
+}
+
+/* add an asset to the manifest being recorded */
+void record(prefetchtype_t type, const char* path)
+{
+    if(recording_key == NULL)
+        return;
+
+    /* skip duplicates */
+    for(size_t i = 0; i < darray_length(recording); i++) {
+        if(recording[i].type == type && strcmp(recording[i].path, path) == 0)
+            return;
+    }
+
+    darray_push(recording, ((manifestentry_t){ .type = type, .path = str_dup(path) }));
+}
+
+/* read a manifest, scheduling a job for each asset that isn't loaded yet */
+bool read_manifest(const char* key)
+{
+    char filepath[64], line[1024];
+    ALLEGRO_FILE* fp;
+    int n = 0;
+
+    manifest_path(key, filepath, sizeof(filepath));
+    if(!asset_exists(filepath))
+        return false;
+
+    if(NULL == (fp = al_fopen(asset_path(filepath), "r")))
+        return false;
+
+    al_lock_mutex(mutex);
+    while(al_fgets(fp, line, sizeof(line)) != NULL) {
+        prefetchtype_t type;
+        char* path = strchr(line, ' ');
+
+        /* read a "<type> <path>" line */
+        if(path == NULL || *line == '#')
+            continue;
+        *(path++) = '\0';
+        path[strcspn(path, "\r\n")] = '\0';
+
+        if(strcmp(line, TYPE_NAME[PREFETCH_IMAGE]) == 0)
+            type = PREFETCH_IMAGE;
+        else if(strcmp(line, TYPE_NAME[PREFETCH_SAMPLE]) == 0)
+            type = PREFETCH_SAMPLE;
+        else
+            continue;
+
+        /* skip assets that are already loaded */
+        if(type == PREFETCH_IMAGE && resourcemanager_find_image(path) != NULL)
+            continue;
+        else if(type == PREFETCH_SAMPLE && resourcemanager_find_sample(path) != NULL)
+            continue;
+
+        /* schedule a job */
+        darray_push(job, ((prefetchjob_t){
+            .type = type,
+            .state = JOB_PENDING,
+            .path = str_dup(path),
+            .data = NULL
+        }));
+        n++;
+    }
+    al_broadcast_cond(cond);
+    al_unlock_mutex(mutex);
+
+    al_fclose(fp);
+    return n > 0;
+}
+
+/* write the manifest being recorded to the cache */
+bool write_manifest(const char* key)
+{
+    char filepath[64];
+    ALLEGRO_FILE* fp;
+
+    if(!asset_mkdir(MANIFEST_FOLDER))
+        return false;
+
+    manifest_path(key, filepath, sizeof(filepath));
+    if(NULL == (fp = al_fopen(asset_path(filepath), "w")))
+        return false;
+
+    al_fprintf(fp, "# prefetch manifest of %s\n", key);
+    for(size_t i = 0; i < darray_length(recording); i++)
+        al_fprintf(fp, "%s %s\n", TYPE_NAME[recording[i].type], recording[i].path);
+
+    al_fclose(fp);
+    return true;
+}
+
+/* the path of the manifest of a key in the virtual filesystem */
+const char* manifest_path(const char* key, char* buffer, size_t buffer_size)
+{
+    char hash[20];
+
+    x64_to_str(djb2(key), hash, sizeof(hash));
+    snprintf(buffer, buffer_size, "%s/%s.txt", MANIFEST_FOLDER, hash);
+
+    return buffer;
+}
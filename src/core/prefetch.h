@@ -0,0 +1,61 @@
+/*
+ * Open Surge Engine
+ * prefetch.h - background prefetching of assets based on recorded manifests
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include <stdbool.h>
+
+/*
+
+A manifest is a list of the assets that were touched while loading
+something (e.g., a level). Manifests are identified by a key, which
+is typically the path of the file being loaded, and are stored in
+the cache/ folder of the user-modifiable data directory.
+
+Given a key, the prefetcher decodes the assets listed in its manifest
+on worker threads. The decoded assets are later claimed by image_load()
+and sound_load(), skipping the expensive decoding on the main thread.
+
+*/
+
+/* forward declarations */
+struct ALLEGRO_BITMAP;
+struct ALLEGRO_SAMPLE;
+
+/* initialization */
+void prefetch_init();
+void prefetch_release();
+
+/* background loading */
+void prefetch_start(const char* key); /* start decoding the assets listed in the manifest of key */
+void prefetch_cancel(); /* discard any assets that haven't been claimed */
+
+/* recording */
+void prefetch_start_recording(const char* key); /* start recording the manifest of key */
+void prefetch_stop_recording(); /* stop recording and write the manifest to the cache */
+void prefetch_record_image(const char* path); /* called by image_load() */
+void prefetch_record_sample(const char* path); /* called by sound_load() */
+
+/* claim decoded assets; these return NULL if nothing was prefetched */
+struct ALLEGRO_BITMAP* prefetch_claim_image(const char* path); /* returns a memory bitmap */
+struct ALLEGRO_SAMPLE* prefetch_claim_sample(const char* path);
+
+#endif
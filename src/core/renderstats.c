@@ -0,0 +1,285 @@
+/*
+ * Open Surge Engine
+ * renderstats.c - rendering statistics: draw calls, batches, state changes...
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "renderstats.h"
+#include "logfile.h"
+#include "timer.h"
+#include "../util/util.h"
+
+/* names of the statistics */
+static const char* STAT_NAME[RENDERSTAT_COUNT] = {
+    [RENDERSTAT_DRAW_CALLS] = "draw_calls",
+    [RENDERSTAT_BATCHES] = "batches",
+    [RENDERSTAT_VERTICES] = "vertices",
+    [RENDERSTAT_TEXTURE_BINDS] = "texture_binds",
+    [RENDERSTAT_STATE_CHANGES] = "state_changes",
+    [RENDERSTAT_TARGET_SWITCHES] = "target_switches"
+};
+
+/* counters */
+static int counter[RENDERSTAT_COUNT] = { 0 }; /* current frame */
+static int last_frame[RENDERSTAT_COUNT] = { 0 }; /* last complete frame */
+
+/* batching model */
+#define NO_TEXTURE 0
+static bool is_held = false; /* is deferred drawing enabled? */
+static uint32_t batch_texture = NO_TEXTURE; /* texture of the open batch, if any */
+static uint32_t bound_texture = NO_TEXTURE; /* the texture that is currently bound */
+
+/* CSV export */
+static FILE* csv = NULL;
+static void write_csv_header();
+static void write_csv_line();
+
+/* helpers */
+#define LOG(...) logfile_message("Render stats - " __VA_ARGS__)
+static inline void end_batch() { batch_texture = NO_TEXTURE; }
+
+
+
+/*
+ * renderstats_init()
+ * Initializes the rendering statistics
+ */
+void renderstats_init()
+{
+    for(int i = 0; i < RENDERSTAT_COUNT; i++)
+        counter[i] = last_frame[i] = 0;
+
+    is_held = false;
+    batch_texture = NO_TEXTURE;
+    bound_texture = NO_TEXTURE;
+    csv = NULL;
+}
+
+/*
+ * renderstats_release()
+ * Releases the rendering statistics
+ */
+void renderstats_release()
+{
+    renderstats_stop_csv();
+}
+
+/*
+ * renderstats_next_frame()
+ * Closes the counters of the current frame and starts a new frame
+ */
+void renderstats_next_frame()
+{
+    for(int i = 0; i < RENDERSTAT_COUNT; i++) {
+        last_frame[i] = counter[i];
+        counter[i] = 0;
+    }
+
+    /* flipping the display ends any batch */
+    end_batch();
+    bound_texture = NO_TEXTURE;
+
+    if(csv != NULL)
+        write_csv_line();
+}
+
+/*
+ * renderstats_get()
+ * The value of a statistic in the last complete frame
+ */
+int renderstats_get(renderstat_t stat)
+{
+    assertx(stat >= 0 && stat < RENDERSTAT_COUNT);
+    return last_frame[stat];
+}
+
+/*
+ * renderstats_name()
+ * The name of a statistic
+ */
+const char* renderstats_name(renderstat_t stat)
+{
+    assertx(stat >= 0 && stat < RENDERSTAT_COUNT);
+    return STAT_NAME[stat];
+}
+
+/*
+ * renderstats_start_csv()
+ * Start exporting the statistics of each frame to a CSV file.
+ * Returns true on success
+ */
+bool renderstats_start_csv(const char* filepath)
+{
+    renderstats_stop_csv();
+
+    if(NULL == (csv = fopen(filepath, "w"))) {
+        LOG("Can't export to \"%s\"", filepath);
+        return false;
+    }
+
+    LOG("Exporting to \"%s\"...", filepath);
+    write_csv_header();
+    return true;
+}
+
+/*
+ * renderstats_stop_csv()
+ * Stop exporting the statistics to a CSV file
+ */
+void renderstats_stop_csv()
+{
+    if(csv != NULL) {
+        fclose(csv);
+        csv = NULL;
+    }
+}
+
+/*
+ * renderstats_is_exporting_csv()
+ * Are we exporting the statistics to a CSV file?
+ */
+bool renderstats_is_exporting_csv()
+{
+    return csv != NULL;
+}
+
+/*
+ * renderstats_count_draw()
+ * Counts a textured draw with the given number of vertices
+ */
+void renderstats_count_draw(uint32_t texture, int vertices)
+{
+    counter[RENDERSTAT_DRAW_CALLS]++;
+    counter[RENDERSTAT_VERTICES] += vertices;
+
+    /* a new batch starts if drawing isn't held or if the texture changes */
+    if(!is_held || texture != batch_texture) {
+        counter[RENDERSTAT_BATCHES]++;
+
+        if(texture != bound_texture) {
+            counter[RENDERSTAT_TEXTURE_BINDS]++;
+            bound_texture = texture;
+        }
+    }
+
+    batch_texture = is_held ? texture : NO_TEXTURE;
+}
+
+/*
+ * renderstats_count_primitive()
+ * Counts an untextured draw with the given number of vertices
+ */
+void renderstats_count_primitive(int vertices)
+{
+    counter[RENDERSTAT_DRAW_CALLS]++;
+    counter[RENDERSTAT_VERTICES] += vertices;
+    counter[RENDERSTAT_BATCHES]++;
+
+    end_batch();
+}
+
+/*
+ * renderstats_count_batched_draw()
+ * Counts a textured draw that is batched by the caller (e.g., with a
+ * vertex array). Consecutive draws of the same texture are merged into
+ * one batch until renderstats_end_batch() is called
+ */
+void renderstats_count_batched_draw(uint32_t texture, int vertices)
+{
+    counter[RENDERSTAT_DRAW_CALLS]++;
+    counter[RENDERSTAT_VERTICES] += vertices;
+
+    if(texture != batch_texture) {
+        counter[RENDERSTAT_BATCHES]++;
+
+        if(texture != bound_texture) {
+            counter[RENDERSTAT_TEXTURE_BINDS]++;
+            bound_texture = texture;
+        }
+    }
+
+    batch_texture = texture;
+}
+
+/*
+ * renderstats_end_batch()
+ * Ends a batch of draws
+ */
+void renderstats_end_batch()
+{
+    end_batch();
+}
+
+/*
+ * renderstats_count_hold()
+ * Counts a change of the deferred drawing mode
+ */
+void renderstats_count_hold(bool hold)
+{
+    if(hold == is_held)
+        return;
+
+    counter[RENDERSTAT_STATE_CHANGES]++;
+    is_held = hold;
+
+    end_batch();
+}
+
+/*
+ * renderstats_count_state_change()
+ * Counts a change of the rendering state (shader, blender...)
+ */
+void renderstats_count_state_change()
+{
+    counter[RENDERSTAT_STATE_CHANGES]++;
+    end_batch();
+}
+
+/*
+ * renderstats_count_target_switch()
+ * Counts a change of the drawing target
+ */
+void renderstats_count_target_switch()
+{
+    counter[RENDERSTAT_TARGET_SWITCHES]++;
+    end_batch();
+}
+
+
+
+/*
+ * private
+ */
+
+/* write the header of the CSV file */
+void write_csv_header()
+{
+    fprintf(csv, "frame");
+    for(int i = 0; i < RENDERSTAT_COUNT; i++)
+        fprintf(csv, ",%s", STAT_NAME[i]);
+    fprintf(csv, "\n");
+}
+
+/* write the statistics of the last frame to the CSV file */
+void write_csv_line()
+{
+    fprintf(csv, "%lld", (long long)timer_get_frames());
+    for(int i = 0; i < RENDERSTAT_COUNT; i++)
+        fprintf(csv, ",%d", last_frame[i]);
+    fprintf(csv, "\n");
+}
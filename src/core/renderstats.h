@@ -0,0 +1,77 @@
+/*
+ * Open Surge Engine
+ * renderstats.h - rendering statistics: draw calls, batches, state changes...
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RENDERSTATS_H
+#define _RENDERSTATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+
+The counters are fed by the rendering functions of the engine and are
+computed on the CPU, so they don't depend on the graphics driver. They
+are kept per frame: renderstats_get() reports the last complete frame.
+
+Batches and texture binds are estimates. Images are batched by the sprite
+batcher of the engine: consecutive draws of the same texture are submitted
+together. Other draws follow the batching rules of Allegro: while drawing
+is held, consecutive draws of the same texture are submitted together.
+Any state change ends the current batch.
+
+*/
+
+/* rendering statistics */
+typedef enum renderstat_t renderstat_t;
+enum renderstat_t {
+    RENDERSTAT_DRAW_CALLS,      /* drawing operations (images, primitives) */
+    RENDERSTAT_BATCHES,         /* estimated draw submissions to the GPU */
+    RENDERSTAT_VERTICES,        /* submitted vertices */
+    RENDERSTAT_TEXTURE_BINDS,   /* estimated changes of the bound texture */
+    RENDERSTAT_STATE_CHANGES,   /* changes of shaders, blenders, deferred drawing... */
+    RENDERSTAT_TARGET_SWITCHES, /* changes of the drawing target */
+
+    RENDERSTAT_COUNT            /* number of statistics */
+};
+
+/* initialization */
+void renderstats_init();
+void renderstats_release();
+void renderstats_next_frame(); /* called once per frame, after flipping the display */
+
+/* querying */
+int renderstats_get(renderstat_t stat); /* the value of a statistic in the last frame */
+const char* renderstats_name(renderstat_t stat); /* the name of a statistic, e.g., "draw_calls" */
+
+/* CSV export: one line per frame */
+bool renderstats_start_csv(const char* filepath); /* filepath in the native filesystem */
+void renderstats_stop_csv();
+bool renderstats_is_exporting_csv();
+
+/* counting: these are called by the rendering functions */
+void renderstats_count_draw(uint32_t texture, int vertices); /* a textured draw */
+void renderstats_count_primitive(int vertices); /* an untextured draw */
+void renderstats_count_batched_draw(uint32_t texture, int vertices); /* a textured draw batched by the caller */
+void renderstats_end_batch(); /* the caller has submitted its batch */
+void renderstats_count_hold(bool hold); /* deferred drawing has been toggled */
+void renderstats_count_state_change();
+void renderstats_count_target_switch();
+
+#endif
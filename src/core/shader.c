@@ -19,6 +19,7 @@
  */
 
 #include <allegro5/allegro.h>
+#include <allegro5/allegro_opengl.h>
 #include "shader.h"
 #include "../util/dictionary.h"
 #include "../util/iterator.h"
@@ -27,6 +28,8 @@
 #include "../util/numeric.h"
 #include "../core/logfile.h"
 #include "../core/image.h"
+#include "../core/video.h"
+#include "../core/renderstats.h"
 
 /* shader struct */
 struct shader_t
@@ -75,6 +78,8 @@ struct shader_uniform_t
 {
     shader_uniformtype_t type;
     char name[1 + UNIFORM_NAME_MAXLEN];
+    GLint location; /* cached location of the uniform in the program, or UNRESOLVED_LOCATION */
+    bool dirty; /* does the value need to be uploaded to the program? */
     union {
         float f;
         int i;
@@ -87,6 +92,10 @@ struct shader_uniform_t
 static shader_uniform_t* create_uniform(shader_uniformtype_t type, const char* var_name);
 static void destroy_uniform(shader_uniform_t* uniform);
 static bool set_uniform(const shader_uniform_t* uniform);
+static bool upload_uniform(shader_uniform_t* uniform, ALLEGRO_SHADER* program);
+static void invalidate_uniforms(shader_t* shader);
+static inline bool is_sampler(const shader_uniform_t* uniform);
+#define UNRESOLVED_LOCATION (-2) /* glGetUniformLocation() returns -1 if the uniform doesn't exist */
 static void uniform_dtor(void *uniform, void* ctx) { destroy_uniform((shader_uniform_t*)uniform); (void)ctx; }
 
 /* default vertex shader */
@@ -156,6 +165,20 @@ static const char DEFAULT_SHADER_NAME[] = "default";
 static shader_t* default_shader = NULL;
 static const shader_t* active_shader = NULL;
 static dictionary_t* registry = NULL;
+static unsigned uniform_upload_count = 0;
+
+/* OpenGL-specific: uniforms are uploaded using cached locations */
+ALLEGRO_DEFINE_PROC_TYPE(GLint, fun_glgetuniformlocation_t, (GLuint, const GLchar*));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_gluniform1f_t, (GLint, GLfloat));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_gluniform1i_t, (GLint, GLint));
+ALLEGRO_DEFINE_PROC_TYPE(void, fun_gluniformfv_t, (GLint, GLsizei, const GLfloat*));
+static fun_glgetuniformlocation_t _glGetUniformLocation = NULL;
+static fun_gluniform1f_t _glUniform1f = NULL;
+static fun_gluniform1i_t _glUniform1i = NULL;
+static fun_gluniformfv_t _glUniform2fv = NULL;
+static fun_gluniformfv_t _glUniform3fv = NULL;
+static fun_gluniformfv_t _glUniform4fv = NULL;
+static void import_opengl_symbols();
 
 
 
@@ -168,6 +191,10 @@ void shader_init()
     LOG("Initializing...");
     default_shader = NULL;
     active_shader = NULL;
+    uniform_upload_count = 0;
+
+    /* import the OpenGL functions used to upload uniforms */
+    import_opengl_symbols();
 
     /* initialize the registry of shaders */
     registry = dictionary_create(false, destroy_shader_callback, NULL);
@@ -237,6 +264,7 @@ void shader_recreate_all()
     while(iterator_has_next(it)) {
         shader_t* shader = iterator_next(it);
         recreate_shader(shader);
+        invalidate_uniforms(shader);
     }
 
     iterator_destroy(it);
@@ -327,22 +355,31 @@ bool shader_set_active(const shader_t* shader)
 
        https://liballeg.org/a5docs/trunk/shader.html */
 
-    /* use the shader */
+    /* use the shader. The images drawn so far are submitted with the previous one */
+    video_sync();
+    image_flush_batch();
     bool success = al_use_shader(shader->shader);
 
-    /* set uniform variables */
+    /* set uniform variables. A program keeps the values of its uniforms,
+       so we only upload the ones that have changed since the last time.
+       Samplers are always set, because texture units are shared. */
     if(success) {
         iterator_t* it = dictionary_values(shader->uniforms);
         while(iterator_has_next(it)) {
-            const shader_uniform_t* uniform = iterator_next(it);
-            set_uniform(uniform);
+            shader_uniform_t* uniform = iterator_next(it);
+            if(uniform->dirty || is_sampler(uniform)) {
+                if(upload_uniform(uniform, shader->shader))
+                    uniform->dirty = false;
+            }
         }
         iterator_destroy(it);
     }
 
     /* update active shader */
-    if(success)
+    if(success) {
         active_shader = shader;
+        renderstats_count_state_change();
+    }
 
     /* done! */
     return success;
@@ -382,10 +419,11 @@ void shader_set_float(shader_t* shader, const char* var_name, float value)
         stored_uniform->value.f = value;
         dictionary_put(shader->uniforms, var_name, stored_uniform);
     }
-    else {
+    else if(stored_uniform->value.f != value) {
         /* update uniform */
         assertx(stored_uniform->type == TYPE_FLOAT, "Can't change uniform type");
         stored_uniform->value.f = value;
+        stored_uniform->dirty = true;
     }
 }
 
@@ -403,10 +441,11 @@ void shader_set_int(shader_t* shader, const char* var_name, int value)
         stored_uniform->value.i = value;
         dictionary_put(shader->uniforms, var_name, stored_uniform);
     }
-    else {
+    else if(stored_uniform->value.i != value) {
         /* update uniform */
         assertx(stored_uniform->type == TYPE_INT, "Can't change uniform type");
         stored_uniform->value.i = value;
+        stored_uniform->dirty = true;
     }
 }
 
@@ -424,10 +463,11 @@ void shader_set_bool(shader_t* shader, const char* var_name, bool value)
         stored_uniform->value.b = value;
         dictionary_put(shader->uniforms, var_name, stored_uniform);
     }
-    else {
+    else if(stored_uniform->value.b != value) {
         /* update uniform */
         assertx(stored_uniform->type == TYPE_BOOL, "Can't change uniform type");
         stored_uniform->value.b = value;
+        stored_uniform->dirty = true;
     }
 }
 
@@ -446,10 +486,11 @@ void shader_set_float_vector(shader_t* shader, const char* var_name, int num_com
         memcpy(stored_uniform->value.fvec, value, num_components * sizeof(*value));
         dictionary_put(shader->uniforms, var_name, stored_uniform);
     }
-    else {
+    else if(0 != memcmp(stored_uniform->value.fvec, value, num_components * sizeof(*value))) {
         /* update uniform */
         assertx(stored_uniform->type == TYPE_FLOAT2 + (num_components-2), "Can't change uniform type");
         memcpy(stored_uniform->value.fvec, value, num_components * sizeof(*value));
+        stored_uniform->dirty = true;
     }
 }
 
@@ -478,6 +519,15 @@ void shader_set_sampler(shader_t* shader, const char* var_name, const image_t* i
     }
 }
 
+/*
+ * shader_uniform_upload_count()
+ * The number of uniform variables uploaded to the GPU since initialization
+ */
+unsigned shader_uniform_upload_count()
+{
+    return uniform_upload_count;
+}
+
 
 
 
@@ -490,6 +540,8 @@ void shader_set_sampler(shader_t* shader, const char* var_name, const image_t* i
 /* create a GLSL shader. On error, returns NULL and sets an error string */
 ALLEGRO_SHADER* create_glsl_shader(const char* fs_glsl, const char* vs_glsl, char* error_string, size_t error_string_size)
 {
+    video_sync();
+
     ALLEGRO_SHADER* sh = al_create_shader(ALLEGRO_SHADER_GLSL);
 
     if(sh == NULL) {
@@ -517,6 +569,7 @@ ALLEGRO_SHADER* create_glsl_shader(const char* fs_glsl, const char* vs_glsl, cha
 /* destroy a GLSL shader */
 ALLEGRO_SHADER* destroy_glsl_shader(ALLEGRO_SHADER* shader)
 {
+    video_sync();
     al_destroy_shader(shader);
     return NULL;
 }
@@ -582,6 +635,8 @@ shader_uniform_t* create_uniform(shader_uniformtype_t type, const char* var_name
     /* initialize */
     uniform->type = type;
     str_cpy(uniform->name, var_name, sizeof uniform->name);
+    uniform->location = UNRESOLVED_LOCATION;
+    uniform->dirty = true;
 
     /* done! */
     return uniform;
@@ -635,4 +690,97 @@ bool set_uniform(const shader_uniform_t* uniform)
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+/* upload a uniform variable to the program, which must be active.
+   Uses the cached location of the uniform if possible */
+bool upload_uniform(shader_uniform_t* uniform, ALLEGRO_SHADER* program)
+{
+    /* samplers also bind textures; let Allegro handle them */
+    if(is_sampler(uniform) || _glGetUniformLocation == NULL) {
+        uniform_upload_count++;
+        return set_uniform(uniform);
+    }
+
+    /* resolve the location of the uniform only once per program */
+    if(uniform->location == UNRESOLVED_LOCATION) {
+        GLuint program_object = al_get_opengl_program_object(program);
+        uniform->location = _glGetUniformLocation(program_object, uniform->name);
+    }
+
+    /* the uniform doesn't exist in the program (or it isn't used) */
+    if(uniform->location < 0)
+        return true; /* nothing to upload */
+
+    /* upload */
+    uniform_upload_count++;
+    switch(uniform->type) {
+        case TYPE_FLOAT:
+            _glUniform1f(uniform->location, uniform->value.f);
+            return true;
+
+        case TYPE_INT:
+            _glUniform1i(uniform->location, uniform->value.i);
+            return true;
+
+        case TYPE_BOOL:
+            _glUniform1i(uniform->location, uniform->value.b);
+            return true;
+
+        case TYPE_FLOAT2:
+            _glUniform2fv(uniform->location, 1, uniform->value.fvec);
+            return true;
+
+        case TYPE_FLOAT3:
+            _glUniform3fv(uniform->location, 1, uniform->value.fvec);
+            return true;
+
+        case TYPE_FLOAT4:
+            _glUniform4fv(uniform->location, 1, uniform->value.fvec);
+            return true;
+
+        default:
+            return set_uniform(uniform);
+    }
+}
+
+/* forget the cached locations of the uniforms of a shader and mark them
+   for upload (the program has been recreated) */
+void invalidate_uniforms(shader_t* shader)
+{
+    iterator_t* it = dictionary_values(shader->uniforms);
+
+    while(iterator_has_next(it)) {
+        shader_uniform_t* uniform = iterator_next(it);
+        uniform->location = UNRESOLVED_LOCATION;
+        uniform->dirty = true;
+    }
+
+    iterator_destroy(it);
+}
+
+/* is the uniform a texture sampler? */
+bool is_sampler(const shader_uniform_t* uniform)
+{
+    return uniform->type >= TYPE_SAMPLER_0 && uniform->type <= TYPE_SAMPLER_15;
+}
+
+/* import OpenGL symbols */
+void import_opengl_symbols()
+{
+    _glGetUniformLocation = (fun_glgetuniformlocation_t)al_get_opengl_proc_address("glGetUniformLocation");
+    _glUniform1f = (fun_gluniform1f_t)al_get_opengl_proc_address("glUniform1f");
+    _glUniform1i = (fun_gluniform1i_t)al_get_opengl_proc_address("glUniform1i");
+    _glUniform2fv = (fun_gluniformfv_t)al_get_opengl_proc_address("glUniform2fv");
+    _glUniform3fv = (fun_gluniformfv_t)al_get_opengl_proc_address("glUniform3fv");
+    _glUniform4fv = (fun_gluniformfv_t)al_get_opengl_proc_address("glUniform4fv");
+
+    /* we need all of them; otherwise, we set uniforms by name */
+    if(
+        _glGetUniformLocation == NULL || _glUniform1f == NULL || _glUniform1i == NULL ||
+        _glUniform2fv == NULL || _glUniform3fv == NULL || _glUniform4fv == NULL
+    ) {
+        LOG("Can't import the OpenGL functions for uniforms. Setting uniforms by name.");
+        _glGetUniformLocation = NULL;
+    }
+}
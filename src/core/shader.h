@@ -46,6 +46,8 @@ void shader_set_bool(shader_t* shader, const char* var_name, bool value);
 void shader_set_float_vector(shader_t* shader, const char* var_name, int num_components, const float* value);
 void shader_set_sampler(shader_t* shader, const char* var_name, const struct image_t* image);
 
+unsigned shader_uniform_upload_count(); /* for stats */
+
 #if !defined(__ANDROID__)
 #define SHADER_GLSL_PREFIX "#version 330 core\n"
 #else
@@ -38,6 +38,7 @@
 #include "video.h"
 #include "image.h"
 #include "shader.h"
+#include "renderstats.h"
 #include "engine.h"
 #include "timer.h"
 #include "logfile.h"
@@ -78,6 +79,32 @@ static void reconfigure_backbuffer();
 static void compute_screen_size(videomode_t mode, int* screen_width, int* screen_height);
 
 
+/* Frame pipelining: the display is flipped on a present thread, which borrows
+   the OpenGL context while the main thread updates the next frame */
+#if !defined(__ANDROID__) && !defined(__APPLE__)
+#define CAN_PIPELINE_FRAMES 1 /* is it safe to flip the display on another thread? */
+#else
+#define CAN_PIPELINE_FRAMES 0
+#endif
+static bool is_pipelined = false; /* are we flipping the display on the present thread? */
+static bool is_presenting = false; /* does the present thread own the context? Accessed by the main thread only */
+static ALLEGRO_THREAD* present_thread = NULL;
+static ALLEGRO_MUTEX* present_mutex = NULL;
+static ALLEGRO_COND* present_cond = NULL;
+static bool present_requested = false; /* protected by the mutex */
+static bool present_must_quit = false; /* protected by the mutex */
+static struct {
+    int frame_count; /* number of presented frames */
+    double blocked_time; /* seconds the main thread spent presenting frames or waiting for the present thread */
+    double present_time; /* seconds spent in present(), on any thread */
+} present_stats = { 0, 0.0, 0.0 };
+static void present();
+static void log_present_stats();
+static void start_present_thread();
+static void stop_present_thread();
+static void* present_thread_fn(ALLEGRO_THREAD* thread, void* arg);
+
+
 /* OpenGL-specific */
 ALLEGRO_DEFINE_PROC_TYPE(void, fun_glinvalidateframebuffer_t, (GLenum, GLsizei, const GLenum*));
 ALLEGRO_DEFINE_PROC_TYPE(void, fun_glclear_t, (GLbitfield));
@@ -264,11 +291,17 @@ void video_init()
     /* import OpenGL symbols */
     import_opengl_symbols();
 
+    /* initialize the rendering statistics */
+    renderstats_init();
+
     /* initialize the shader system */
     shader_init();
     if(!use_default_shader())
         FATAL("Failed to use the default shader");
 
+    /* initialize the sprite batcher */
+    image_init_batching();
+
     /* initialize the console */
     init_console();
 
@@ -284,12 +317,22 @@ void video_release()
 {
     LOG("Releasing the video manager...");
 
+    /* stop pipelining frames */
+    video_set_pipelined(false);
+    log_present_stats();
+
     /* release the console */
     release_console();
 
+    /* release the sprite batcher */
+    image_release_batching();
+
     /* release the shader system */
     shader_release();
 
+    /* release the rendering statistics */
+    renderstats_release();
+
     /* destroy the backbuffer */
     destroy_backbuffer();
 
@@ -307,10 +350,16 @@ void video_render(void (*render_overlay)())
     ALLEGRO_TRANSFORM display_transform;
     ALLEGRO_TRANSFORM identity_transform;
 
+    /* the main thread must own the OpenGL context */
+    video_sync();
+
     /* compute an appropriate transform */
     al_identity_transform(&identity_transform);
     compute_display_transform(&display_transform);
 
+    /* submit the images drawn to our backbuffer */
+    image_flush_batch();
+
     /* hint the graphics driver that we no longer need the depth buffer
        just before switching the target bitmap */
     if(_glInvalidateFramebuffer != NULL) {
@@ -322,6 +371,7 @@ void video_render(void (*render_overlay)())
 
     /* copy our backbuffer to the display backbuffer */
     al_set_target_bitmap(al_get_backbuffer(display));
+    renderstats_count_target_switch();
     al_use_transform(&display_transform);
 #if USE_ROUNDROBIN_BACKBUFFER
 #if 1
@@ -335,6 +385,7 @@ void video_render(void (*render_overlay)())
         al_draw_bitmap(IMAGE2BITMAP(backbuffer[backbuffer_index]), 0.0f, 0.0f, 0);
 #endif
     al_use_transform(&identity_transform);
+    renderstats_count_draw(al_get_opengl_texture(IMAGE2BITMAP(backbuffer[backbuffer_index])), 6);
 
     /* compute the framerate */
     update_fps();
@@ -342,23 +393,11 @@ void video_render(void (*render_overlay)())
     /* render stuff in window space */
     if(render_overlay != NULL)
         render_overlay();
+    image_flush_batch();
     render_texts();
 
-    /* flip display */
-    al_flip_display();
-
-    /* OpenGL: clear values */
-    if(_glClearColor != NULL)
-        _glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    if(_glClearDepth != NULL)
-        _glClearDepth(1.0);
-
-    /* clearing just after flipping may provide a slight performance increase
-       in some drivers */
-    if(_glClear != NULL)
-        _glClear(GL_COLOR_BUFFER_BIT);
-    else
-        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+    /* the frame is complete. The render stats are kept on the main thread */
+    renderstats_next_frame();
 
 #if USE_ROUNDROBIN_BACKBUFFER
     /* use a round-robin scheme for a (possible) performance improvement,
@@ -366,27 +405,81 @@ void video_render(void (*render_overlay)())
     backbuffer_index = 1 - backbuffer_index;
 #endif
 
-    /* restore our backbuffer */
-    al_set_target_bitmap(IMAGE2BITMAP(backbuffer[backbuffer_index]));
+    /* present() will restore our backbuffer as the target */
+    renderstats_count_target_switch();
 
-    /* it's a good idea to call glClear() just after glBindFramebuffer() in
-       some tiled architectures (mobile) */
-    if(_glClear != NULL) {
-        /* clear color & depth buffers in a single call */
-        _glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    /* flip the display on the present thread while the main thread updates
+       the next frame, or right now if we're not pipelining frames */
+    double start_time = al_get_time();
+    if(is_pipelined) {
+        al_set_target_bitmap(NULL); /* release the OpenGL context */
+        is_presenting = true;
+
+        al_lock_mutex(present_mutex);
+        present_requested = true;
+        al_broadcast_cond(present_cond);
+        al_unlock_mutex(present_mutex);
     }
-    else {
-        /* Allegro should call glClear() behind the scenes */
-        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
-        al_clear_depth_buffer(1);
+    else
+        present();
+
+    present_stats.blocked_time += al_get_time() - start_time;
+    present_stats.frame_count++;
+}
+
+/*
+ * video_sync()
+ * Waits until the previous frame is presented and makes the OpenGL context
+ * current on the calling thread. Call it before using the GPU outside of the
+ * rendering phase, e.g., when creating images during the update of the game
+ */
+void video_sync()
+{
+    /* no frame being presented */
+    if(!is_presenting)
+        return;
+
+    /* wait for the present thread */
+    double start_time = al_get_time();
+    al_lock_mutex(present_mutex);
+    while(present_requested)
+        al_wait_cond(present_cond, present_mutex);
+    al_unlock_mutex(present_mutex);
+
+    /* reclaim the OpenGL context */
+    is_presenting = false;
+    al_set_target_bitmap(IMAGE2BITMAP(backbuffer[backbuffer_index]));
+    present_stats.blocked_time += al_get_time() - start_time;
+}
+
+/*
+ * video_set_pipelined()
+ * Enables or disables frame pipelining. When enabled, the display is flipped
+ * on a present thread while the main thread updates the next frame
+ */
+void video_set_pipelined(bool pipelined)
+{
+    if(pipelined && !CAN_PIPELINE_FRAMES) {
+        LOG("Frame pipelining isn't available on this platform");
+        pipelined = false;
     }
 
-    /*
+    if(pipelined == is_pipelined)
+        return;
 
-    See also:
-    https://community.arm.com/arm-community-blogs/b/graphics-gaming-and-vr-blog/posts/mali-performance-2-how-to-correctly-handle-framebuffers
+    if(pipelined)
+        start_present_thread();
+    else
+        stop_present_thread();
+}
 
-    */
+/*
+ * video_is_pipelined()
+ * Are we flipping the display on a present thread?
+ */
+bool video_is_pipelined()
+{
+    return is_pipelined;
 }
 
 /*
@@ -604,6 +697,7 @@ v2d_t video_get_window_size()
  */
 image_t* video_get_backbuffer()
 {
+    video_sync(); /* the present thread switches the backbuffer */
     return backbuffer[backbuffer_index];
 }
 
@@ -694,6 +788,8 @@ v2d_t video_convert_window_to_screen(v2d_t window_coordinates)
  */
 image_t* video_take_snapshot()
 {
+    video_sync();
+
 #if USE_ROUNDROBIN_BACKBUFFER
     int index = 1 - backbuffer_index;
 #else
@@ -828,6 +924,8 @@ void destroy_display()
 /* Reconfigure the display according to the current settings */
 void reconfigure_display()
 {
+    video_sync();
+
 #if !defined(__ANDROID__)
     int multiplier = (int)(settings.resolution - VIDEORESOLUTION_1X) + 1;
     int new_display_width = game_screen_width * multiplier;
@@ -915,6 +1013,9 @@ void a5_handle_video_event(const ALLEGRO_EVENT* event, void* data)
 {
     static bool was_immersive = false;
 
+    /* the main thread must own the OpenGL context */
+    video_sync();
+
     switch(event->type) {
 
         case ALLEGRO_EVENT_DISPLAY_CLOSE:
@@ -936,6 +1037,7 @@ void a5_handle_video_event(const ALLEGRO_EVENT* event, void* data)
             break;
 
         case ALLEGRO_EVENT_DISPLAY_HALT_DRAWING:
+            image_flush_batch(); /* submit the pending images before drawing halts */
             al_acknowledge_drawing_halt(event->display.source);
             destroy_backbuffer(); /* the backbuffer has the ALLEGRO_NO_PRESERVE_TEXTURE flag enabled */
             shader_discard_all();
@@ -1028,6 +1130,8 @@ void destroy_backbuffer()
 /* Reconfigure the backbuffer according to the current settings */
 void reconfigure_backbuffer()
 {
+    video_sync();
+
     /* validate */
     if(backbuffer[0] == NULL) {
         FATAL("Can't reconfigure the backbuffer: no backbuffer");
@@ -1082,6 +1186,158 @@ void compute_screen_size(videomode_t mode, int* screen_width, int* screen_height
 }
 
 
+/*
+ *
+ * FRAME PIPELINING
+ *
+ */
+
+/* flips the display and clears the backbuffer of the next frame, which
+   is selected by the main thread. The OpenGL context must be current on
+   the calling thread. This may run on the present thread, so it doesn't
+   touch any other state */
+void present()
+{
+    double start_time = al_get_time();
+
+    /* flip display */
+    al_flip_display();
+
+    /* OpenGL: clear values */
+    if(_glClearColor != NULL)
+        _glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    if(_glClearDepth != NULL)
+        _glClearDepth(1.0);
+
+    /* clearing just after flipping may provide a slight performance increase
+       in some drivers */
+    if(_glClear != NULL)
+        _glClear(GL_COLOR_BUFFER_BIT);
+    else
+        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+
+    /* restore our backbuffer */
+    al_set_target_bitmap(IMAGE2BITMAP(backbuffer[backbuffer_index]));
+
+    /* it's a good idea to call glClear() just after glBindFramebuffer() in
+       some tiled architectures (mobile) */
+    if(_glClear != NULL) {
+        /* clear color & depth buffers in a single call */
+        _glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    else {
+        /* Allegro should call glClear() behind the scenes */
+        al_clear_to_color(al_map_rgba_f(0.0f, 0.0f, 0.0f, 0.0f));
+        al_clear_depth_buffer(1);
+    }
+
+    /*
+
+    See also:
+    https://community.arm.com/arm-community-blogs/b/graphics-gaming-and-vr-blog/posts/mali-performance-2-how-to-correctly-handle-framebuffers
+
+    */
+
+    /* the main thread reads this only after synchronizing with the present thread */
+    present_stats.present_time += al_get_time() - start_time;
+}
+
+/* logs how long it took to present the frames, so that frame pipelining
+   can be compared to presenting on the main thread (see --pipelined-present) */
+void log_present_stats()
+{
+    int n = present_stats.frame_count;
+
+    if(n == 0)
+        return;
+
+    LOG("Presented %d frames. present() took %.3f ms per frame; the main thread was blocked for %.3f ms per frame (%s)",
+        n,
+        1000.0 * present_stats.present_time / n,
+        1000.0 * present_stats.blocked_time / n,
+        is_pipelined ? "pipelined" : "not pipelined"
+    );
+}
+
+/* spawns the present thread */
+void start_present_thread()
+{
+    present_mutex = al_create_mutex();
+    present_cond = al_create_cond();
+    present_requested = false;
+    present_must_quit = false;
+
+    if(NULL == (present_thread = al_create_thread(present_thread_fn, NULL))) {
+        LOG("Can't create the present thread");
+        al_destroy_cond(present_cond);
+        al_destroy_mutex(present_mutex);
+        present_cond = NULL;
+        present_mutex = NULL;
+        return;
+    }
+
+    al_start_thread(present_thread);
+    is_pipelined = true;
+
+    LOG("Frame pipelining is enabled");
+}
+
+/* stops the present thread after the pending frame is presented */
+void stop_present_thread()
+{
+    video_sync();
+
+    al_lock_mutex(present_mutex);
+    present_must_quit = true;
+    al_broadcast_cond(present_cond);
+    al_unlock_mutex(present_mutex);
+
+    al_join_thread(present_thread, NULL);
+    al_destroy_thread(present_thread);
+    al_destroy_cond(present_cond);
+    al_destroy_mutex(present_mutex);
+    present_thread = NULL;
+    present_cond = NULL;
+    present_mutex = NULL;
+
+    is_pipelined = false;
+
+    LOG("Frame pipelining is disabled");
+}
+
+/* present thread */
+void* present_thread_fn(ALLEGRO_THREAD* thread, void* arg)
+{
+    al_lock_mutex(present_mutex);
+    while(!present_must_quit) {
+
+        /* wait for a frame */
+        if(!present_requested) {
+            al_wait_cond(present_cond, present_mutex);
+            continue;
+        }
+
+        /* borrow the OpenGL context, present the frame and give the context back */
+        al_unlock_mutex(present_mutex);
+        al_set_target_backbuffer(display);
+        present();
+        al_set_target_bitmap(NULL);
+        al_lock_mutex(present_mutex);
+
+        /* done */
+        present_requested = false;
+        al_broadcast_cond(present_cond);
+
+    }
+    al_unlock_mutex(present_mutex);
+
+    (void)thread;
+    (void)arg;
+    return NULL;
+}
+
+
+
 /*
  *
  * DEFAULT SHADER
@@ -1093,6 +1349,8 @@ bool use_default_shader()
 {
     const shader_t* default_shader = shader_get_default();
 
+    video_sync();
+
 #if USE_ROUNDROBIN_BACKBUFFER
     if(backbuffer[0] == NULL || backbuffer[1] == NULL)
         return shader_set_active(default_shader);
@@ -32,6 +32,11 @@ void video_init();
 void video_release();
 void video_render(void (*render_overlay)());
 
+/* frame pipelining */
+void video_sync(); /* wait until the previous frame is presented; call before using the GPU outside of rendering */
+void video_set_pipelined(bool pipelined); /* flip the display on a present thread? */
+bool video_is_pipelined();
+
 /* backbuffer */
 #define VIDEO_SCREEN_W ((int)(video_get_screen_size().x))
 #define VIDEO_SCREEN_H ((int)(video_get_screen_size().y))
@@ -24,10 +24,12 @@
 #include "background.h"
 #include "actor.h"
 #include "../core/sprite.h"
+#include "../core/image.h"
 #include "../core/video.h"
 #include "../core/asset.h"
 #include "../core/logfile.h"
 #include "../core/timer.h"
+#include "../core/renderstats.h"
 #include "../core/nanoparser.h"
 #include "../util/numeric.h"
 #include "../util/rect.h"
@@ -56,7 +58,7 @@ struct bgtheme_t {
     char* filepath; /* filepath of the background */
     double animation_time; /* animation time, in seconds */
 #if WANT_FAST_DRAW
-    int draw_count; /* number of draws */
+    FAST_DRAW_CACHE* cache; /* reused every frame; it grows as needed */
 #endif
 };
 
@@ -133,7 +135,9 @@ static void split_layers(bgtheme_t *bgtheme);
 static void group_layers(bgtheme_t *bgtheme);
 
 /* rendering */
+#define INITIAL_CACHE_SIZE 64 /* in quads */
 typedef void (*renderstrategy_t)(const image_t*,v2d_t,void*);
+static void render(bgtheme_t* bgtheme, bglayer_t* const *layers, int layer_count, v2d_t camera_position);
 static void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_position, double animation_time, void* data, renderstrategy_t render_image);
 static void render_without_cache(const image_t* image, v2d_t position, void* data);
 static void render_with_cache(const image_t* image, v2d_t position, void* data);
@@ -171,7 +175,7 @@ bgtheme_t* background_load(const char *filepath)
     bgtheme->foreground_count = 0;
     bgtheme->animation_time = 0.0;
 #if WANT_FAST_DRAW
-    bgtheme->draw_count = 1;
+    bgtheme->cache = fd_create_cache(INITIAL_CACHE_SIZE, true, false);
 #endif
 
     /* read the .bg file */
@@ -204,6 +208,11 @@ bgtheme_t* background_unload(bgtheme_t *bgtheme)
         free(bgtheme->layer);
     }
 
+#if WANT_FAST_DRAW
+    if(bgtheme->cache != NULL)
+        fd_destroy_cache(bgtheme->cache);
+#endif
+
     free(bgtheme->filepath);
     free(bgtheme);
     return NULL;
@@ -233,37 +242,8 @@ void background_render_bg(bgtheme_t *bgtheme, v2d_t camera_position)
 {
     bglayer_t** layers = bgtheme->layer;
     int layer_count = bgtheme->background_count;
-    double animation_time = bgtheme->animation_time;
-
-#if WANT_FAST_DRAW
-    FAST_DRAW_CACHE* cache = fd_create_cache(bgtheme->draw_count, true, false);
-    int draw_count = 0;
-
-    if(cache != NULL) {
-        render_layers(layers, layer_count, camera_position, animation_time, (void*[]){ cache, &draw_count }, render_with_cache);
-        if(draw_count > bgtheme->draw_count)
-            bgtheme->draw_count = draw_count;
-
-        fd_flush_cache(cache); /* invokes al_draw_indexed_prim() */
-        fd_destroy_cache(cache);
-    }
-
-    /*
-
-    there is overhead (CPU) when invoking al_draw_prim()
-    this is meant for GPU optimization
 
-    [1] https://www.allegro.cc/forums/thread/613609
-    [2] https://www.allegro.cc/forums/thread/614949
-
-    */
-#else
-    image_hold_drawing(true);
-    render_layers(layers, layer_count, camera_position, animation_time, NULL, render_without_cache);
-    image_hold_drawing(false);
-
-    (void)render_with_cache;
-#endif
+    render(bgtheme, layers, layer_count, camera_position);
 }
 
 /*
@@ -274,12 +254,8 @@ void background_render_fg(bgtheme_t *bgtheme, v2d_t camera_position)
 {
     bglayer_t** layers = bgtheme->layer + bgtheme->background_count;
     int layer_count = bgtheme->foreground_count;
-    double animation_time = bgtheme->animation_time;
 
-    /* foregrounds typically have few layers */
-    image_hold_drawing(true);
-    render_layers(layers, layer_count, camera_position, animation_time, NULL, render_without_cache);
-    image_hold_drawing(false);
+    render(bgtheme, layers, layer_count, camera_position);
 }
 
 /*
@@ -520,6 +496,41 @@ void render_layers(bglayer_t* const *layers, int layer_count, v2d_t camera_posit
     }
 }
 
+/* render layers using the best available strategy */
+void render(bgtheme_t* bgtheme, bglayer_t* const *layers, int layer_count, v2d_t camera_position)
+{
+    double animation_time = bgtheme->animation_time;
+
+#if WANT_FAST_DRAW
+    /*
+
+    All the tiles of all layers are accumulated in a vertex array that is
+    submitted with a single call to al_draw_indexed_prim(). FastDraw only
+    flushes earlier if the parent bitmap changes, so the number of draw
+    calls doesn't depend on the screen size nor on the number of tiles.
+
+    The cache is kept across frames to avoid reallocating it.
+
+    [1] https://www.allegro.cc/forums/thread/613609
+    [2] https://www.allegro.cc/forums/thread/614949
+
+    */
+    if(bgtheme->cache != NULL) {
+        render_layers(layers, layer_count, camera_position, animation_time, bgtheme->cache, render_with_cache);
+        image_flush_batch(); /* submit the images drawn before the background */
+        fd_flush_cache(bgtheme->cache); /* invokes al_draw_indexed_prim() */
+        renderstats_end_batch();
+        return;
+    }
+#endif
+
+    image_hold_drawing(true);
+    render_layers(layers, layer_count, camera_position, animation_time, NULL, render_without_cache);
+    image_hold_drawing(false);
+
+    (void)render_with_cache;
+}
+
 /* render an image */
 void render_without_cache(const image_t* image, v2d_t position, void* data)
 {
@@ -530,11 +541,10 @@ void render_without_cache(const image_t* image, v2d_t position, void* data)
 void render_with_cache(const image_t* image, v2d_t position, void* data)
 {
 #if WANT_FAST_DRAW
-    FAST_DRAW_CACHE* cache = (FAST_DRAW_CACHE*)(((void**)data)[0]);
-    int* draw_count = (int*)(((void**)data)[1]);
+    FAST_DRAW_CACHE* cache = (FAST_DRAW_CACHE*)data;
 
     fd_draw_bitmap(cache, IMAGE2BITMAP(image), position.x, position.y);
-    ++(*draw_count);
+    renderstats_count_batched_draw(image_texture(image), 6);
 #endif
 }
 
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include "brick.h"
 #include "player.h"
 #include "actor.h"
@@ -39,10 +40,12 @@
 #include "../util/numeric.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
+#include "../util/darray.h"
 #include "../physics/collisionmask.h"
 #include "../physics/obstacle.h"
 #include "../physics/physicsactor.h"
 #include "../scenes/level.h"
+#include "../scripting/scripting.h"
 
 /* constants */
 #define BRKDATA_MAX             16384 /* up to BRKDATA_MAX bricks per theme are supported */
@@ -74,11 +77,17 @@ struct brickdata_t {
     bricktype_t type;
     brickbehavior_t behavior;
     float behavior_arg[BRICKBEHAVIOR_MAXARGS];
+
+    /* all instances of a brick share the same animation frame at any
+       given time, so we compute it only once per brick type per frame */
+    const animation_t* animation; /* cached animation of the sprite */
+    const image_t* frame; /* current frame of the animation */
+    double frame_time; /* the time at which frame was computed */
 };
 
 /* brick instances */
 struct brick_t { /* a real, concrete brick */
-    const brickdata_t *brick_ref; /* brick metadata */
+    brickdata_t *brick_ref; /* brick metadata; mutable, since it caches the current frame */
     int x, y; /* current position */
     int sx, sy; /* spawn point */
     brickstate_t state; /* brick state: BRS_* */
@@ -113,9 +122,27 @@ static inline obstaclelayer_t get_obstacle_layer(const brick_t* brick);
 static inline int get_image_flags(const brick_t* brick);
 static bool is_player_standing_on_platform(const player_t *player, const brick_t *brk);
 static bool can_be_clipped_out(const brick_t* brick, v2d_t topleft);
-static surgescript_object_t* create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity);
+static void create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity);
+static surgescript_object_t* particle_emitter();
 static int brickdata_count = 0; /* size of brickdata[] */
 static brickdata_t* brickdata[BRKDATA_MAX]; /* brick data */
+static surgescript_objecthandle_t emitter_handle = 0; /* the BrickParticles object of the level */
+
+/* brick pool: bricks are allocated in contiguous blocks, so that bricks
+   created together (e.g., the bricks of a level or of a streamed chunk)
+   are close together in memory when we sweep over them */
+#define BRICKPOOL_BLOCK_SIZE 1024 /* number of bricks per block */
+typedef union brickslot_t brickslot_t;
+union brickslot_t {
+    brick_t brick; /* a brick in use */
+    brickslot_t* next; /* the next free slot */
+};
+STATIC_DARRAY(brickslot_t*, brickpool_block); /* blocks of BRICKPOOL_BLOCK_SIZE slots */
+static brickslot_t* brickpool_free_slot = NULL; /* a linked list of free slots */
+static int brickpool_used_slots = 0; /* number of bricks in use */
+static brick_t* brickpool_alloc();
+static void brickpool_free(brick_t* brick);
+static void brickpool_release();
 
 /* utilities */
 #define ROUND(x)   (int)(((x)>=0.0f)?((x)+0.5f):((x)-0.5f))
@@ -181,6 +208,9 @@ void brickset_unload()
         brickdata[i] = brickdata_delete(brickdata[i]);
     brickdata_count = 0;
 
+    /* release the memory of the bricks if none is in use */
+    brickpool_release();
+
     logfile_message("The brickset has been unloaded.");
 }
 
@@ -214,7 +244,7 @@ int brickset_loaded()
  */
 brick_t* brick_create(int id, v2d_t position, bricklayer_t layer, brickflip_t flip_flags)
 {
-    brick_t *b = mallocx(sizeof *b);
+    brick_t *b = brickpool_alloc();
     int i;
 
     b->brick_ref = brickdata_get(id);
@@ -243,7 +273,7 @@ brick_t* brick_create(int id, v2d_t position, bricklayer_t layer, brickflip_t fl
 brick_t* brick_destroy(brick_t *brk)
 {
     destroy_obstacle(brk->obstacle);
-    free(brk);
+    brickpool_free(brk);
     return NULL;
 }
 
@@ -1036,24 +1066,98 @@ float brick_zindex_preview(int id)
     return -1.0f;
 }
 
+/*
+ * brick_size_preview()
+ * The size, in pixels, of the brick having the given id
+ */
+v2d_t brick_size_preview(int id)
+{
+    if(id >= 0 && id < brickdata_count) {
+        if(brickdata[id] != NULL)
+            return v2d_new(brickdata[id]->image_width, brickdata[id]->image_height);
+    }
+    return v2d_new(0, 0);
+}
+
 
 
 
 
 /* === private stuff === */
 
+/* Allocates a brick from the pool */
+brick_t* brickpool_alloc()
+{
+    brickslot_t* slot;
+
+    /* allocate a new block if there are no free slots */
+    if(brickpool_free_slot == NULL) {
+        brickslot_t* block = mallocx(BRICKPOOL_BLOCK_SIZE * sizeof(*block));
+
+        /* link the slots in memory order */
+        for(int i = 0; i < BRICKPOOL_BLOCK_SIZE - 1; i++)
+            block[i].next = &block[i + 1];
+        block[BRICKPOOL_BLOCK_SIZE - 1].next = NULL;
+
+        if(brickpool_block == NULL)
+            darray_init(brickpool_block);
+        darray_push(brickpool_block, block);
+
+        brickpool_free_slot = block;
+    }
+
+    /* pick a free slot */
+    slot = brickpool_free_slot;
+    brickpool_free_slot = slot->next;
+    brickpool_used_slots++;
+
+    return &(slot->brick);
+}
+
+/* Returns a brick to the pool */
+void brickpool_free(brick_t* brick)
+{
+    brickslot_t* slot = (brickslot_t*)brick;
+
+    slot->next = brickpool_free_slot;
+    brickpool_free_slot = slot;
+    brickpool_used_slots--;
+}
+
+/* Releases the memory of the pool, provided that no bricks are in use */
+void brickpool_release()
+{
+    if(brickpool_block == NULL || brickpool_used_slots > 0)
+        return;
+
+    for(int i = darray_length(brickpool_block) - 1; i >= 0; i--)
+        free(brickpool_block[i]);
+    darray_release(brickpool_block);
+
+    brickpool_free_slot = NULL;
+}
+
 /* Animates a brick */
 void animate_brick(brick_t *brk)
 {
-    const spriteinfo_t *sprite = brk->brick_ref->data;
+    brickdata_t *dat = brk->brick_ref;
+    double now = timer_get_elapsed();
 
     /* fake brick? */
-    if(sprite == NULL)
+    if(dat->data == NULL)
         return;
 
-    /* animate */
-    const animation_t* anim = spriteinfo_get_animation(sprite, 0);
-    brk->image = animation_image_at_time(anim, timer_get_elapsed());
+    /* compute the current frame of this brick type only once per frame */
+    if(dat->frame_time != now) {
+        if(dat->animation == NULL)
+            dat->animation = spriteinfo_get_animation(dat->data, 0);
+
+        dat->frame = animation_image_at_time(dat->animation, now);
+        dat->frame_time = now;
+    }
+
+    /* share it with this instance */
+    brk->image = dat->frame;
 }
 
 /* Checks if the player is standing on top of a platform */
@@ -1083,53 +1187,30 @@ bool can_be_clipped_out(const brick_t* brick, v2d_t topleft)
 }
 
 /* create a brick particle */
-surgescript_object_t* create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity)
+void create_particle(const brick_t* brick, int source_x, int source_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    surgescript_object_t* emitter = particle_emitter();
+
+    if(emitter != NULL)
+        scripting_brickparticles_emit(emitter, brick_id(brick), source_x, source_y, width, height, position, velocity);
+}
+
+/* get the emitter of brick particles, spawning it if necessary */
+surgescript_object_t* particle_emitter()
 {
-    /* create the particle */
-    surgescript_object_t* particle = level_create_object("BrickParticle", position);
-
-    /* create auxiliary variables */
-    surgescript_var_t* id = surgescript_var_create();
-    surgescript_var_t* x = surgescript_var_create();
-    surgescript_var_t* y = surgescript_var_create();
-    surgescript_var_t* w = surgescript_var_create();
-    surgescript_var_t* h = surgescript_var_create();
-
-    /* call particle.setBrick(brick_id, source_x, source_y, width, height) */
-    const surgescript_var_t* args1[] = {
-        surgescript_var_set_number(id, brick_id(brick)),
-        surgescript_var_set_number(x, source_x),
-        surgescript_var_set_number(y, source_y),
-        surgescript_var_set_number(w, width),
-        surgescript_var_set_number(h, height)
-    };
-    surgescript_object_call_function(particle, "setBrick", args1, 5, NULL);
-
-    /* call particle.setVelocity(xvel, yvel) */
-    const surgescript_var_t* args2[] = {
-        surgescript_var_set_number(x, velocity.x),
-        surgescript_var_set_number(y, velocity.y)
-    };
-    surgescript_object_call_function(particle, "setVelocity", args2, 2, NULL);
-
-    /* call particle.set_zindex(zindex) */
-    /*
-    // the zindex of the brick is already set by setBrick()
-    const surgescript_var_t* args3[] = {
-        surgescript_var_set_number(x, 1.0)
-    };
-    surgescript_object_call_function(particle, "set_zindex", args3, 1, NULL);
-    */
-
-    /* release auxiliary variables */
-    surgescript_var_destroy(h);
-    surgescript_var_destroy(w);
-    surgescript_var_destroy(y);
-    surgescript_var_destroy(x);
-    surgescript_var_destroy(id);
-
-    /* return the particle */
-    return particle;
+    surgescript_objectmanager_t* manager = surgescript_vm_objectmanager(surgescript_vm());
+
+    /* reuse the existing emitter */
+    if(surgescript_objectmanager_exists(manager, emitter_handle)) {
+        surgescript_object_t* emitter = surgescript_objectmanager_get(manager, emitter_handle);
+        if(!surgescript_object_is_killed(emitter) && strcmp(surgescript_object_name(emitter), "BrickParticles") == 0)
+            return emitter;
+    }
+
+    /* spawn a new emitter */
+    surgescript_object_t* emitter = level_create_object("BrickParticles", v2d_new(0, 0));
+    emitter_handle = (emitter != NULL) ? surgescript_object_handle(emitter) : 0;
+    return emitter;
 }
 
 
@@ -1142,6 +1223,9 @@ brickdata_t* brickdata_new(int brick_id)
     obj->id = brick_id;
     obj->data = NULL;
     obj->image = NULL;
+    obj->animation = NULL;
+    obj->frame = NULL;
+    obj->frame_time = -1.0;
     obj->image_width = 0;
     obj->image_height = 0;
     obj->mask = NULL;
@@ -1365,6 +1449,9 @@ int traverse_brick_attributes(const parsetree_statement_t *stmt, void *brickdata
         if(dat->data != NULL)
             spriteinfo_destroy(dat->data);
         dat->data = spriteinfo_create(nanoparser_get_program(p1));
+        dat->animation = NULL;
+        dat->frame = NULL;
+        dat->frame_time = -1.0;
     }
     else
         fatal_error("Can't read brick attributes: unknown identifier '%s'", identifier);
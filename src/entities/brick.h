@@ -127,5 +127,6 @@ const struct image_t* brick_image_preview(int id); /* image of the brick having
 bricktype_t brick_type_preview(int id); /* the type of the brick having the given id */
 brickbehavior_t brick_behavior_preview(int id); /* the behavior of the brick having the given id */
 float brick_zindex_preview(int id); /* the zindex of the brick having the given id */
+v2d_t brick_size_preview(int id); /* the size, in pixels, of the brick having the given id */
 
 #endif
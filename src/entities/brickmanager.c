@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "brickmanager.h"
 #include "brick.h"
 #include "../util/util.h"
@@ -32,7 +33,10 @@
 typedef struct brickrect_t brickrect_t;
 typedef struct heightsampler_t heightsampler_t;
 typedef struct brickbucket_t brickbucket_t;
+typedef struct brickcell_t brickcell_t;
 typedef struct brickiteratorstate_t brickiteratorstate_t;
+typedef struct brickrecord_t brickrecord_t;
+typedef struct brickchunk_t brickchunk_t;
 
 /* A rectangle in world space */
 struct brickrect_t
@@ -61,24 +65,79 @@ struct brickbucket_t
     /* a vector of bricks */
     DARRAY(brick_t*, brick);
 
+    /* hot fields of the bricks, stored as parallel arrays: brick[i] has
+       spawn point (x[i], y[i]), size (w[i], h[i]), and so on. Sweeps over
+       a bucket read these instead of dereferencing each brick. None of
+       them change during the lifetime of a brick */
+    DARRAY(int, x);
+    DARRAY(int, y);
+    DARRAY(int, w);
+    DARRAY(int, h);
+    DARRAY(uint8_t, behavior); /* brickbehavior_t */
+    DARRAY(const struct obstacle_t*, obstacle); /* may be NULL */
+
     /* a destructor of individual bricks */
     brick_t* (*brick_dtor)(brick_t*);
 };
 
+/* A cell of the spatial grid */
+struct brickcell_t
+{
+    /* a bucket of static bricks, or NULL if there are none */
+    brickbucket_t* bucket;
+
+    /* a bucket of materialized streamed bricks, or NULL if there are none */
+    brickbucket_t* streamed_bucket;
+};
+
+/* A compact description of a static brick that may not exist yet */
+struct brickrecord_t
+{
+    int id; /* brick id */
+    int x, y; /* spawn point */
+    uint8_t layer; /* bricklayer_t */
+    uint8_t flip; /* brickflip_t */
+};
+
+/* A chunk is a large cell of the world whose static bricks are streamed:
+   they are created when the chunk gets near the ROI (the chunk becomes
+   materialized) and destroyed when the chunk goes far away from it */
+struct brickchunk_t
+{
+    /* the streamed bricks of this chunk */
+    DARRAY(brickrecord_t, record);
+
+    /* position of the chunk in world space */
+    int left;
+    int top;
+
+    /* are the bricks of this chunk currently created? */
+    bool is_materialized;
+};
+
 /* Brick Manager */
 struct brickmanager_t
 {
-    /* The Brick Manager is implemented with a spatial hash table mapped to a
-       linear map table */
+    /* The Brick Manager is implemented with a spatial grid of cells of
+       GRID_SIZE x GRID_SIZE pixels. The grid is a dense 2D array that
+       grows with the world. Outlandish worlds use a sparse hash table of
+       cells instead, so that we don't waste memory */
 
-    /* a hash table of brick buckets that are allocated lazily */
-    fasthash_t* hashtable;
+    /* dense grid: cell (col, row) is grid[row * grid_cols + col];
+       this is NULL if the grid is sparse */
+    brickcell_t* grid;
+    int grid_cols;
+    int grid_rows;
+
+    /* sparse grid: a hash table of cells that are allocated lazily;
+       this is NULL if the grid is dense */
+    fasthash_t* sparse_grid;
 
     /* a special bucket that is included in all queries regardless of the ROI */
     brickbucket_t* awake_bucket;
 
-    /* references to all allocated buckets (for quick access) */
-    DARRAY(const brickbucket_t*, bucket_ref);
+    /* all allocated buckets; the buckets are owned by this vector */
+    DARRAY(brickbucket_t*, bucket_ref);
 
     /* current region of interest */
     brickrect_t roi;
@@ -92,6 +151,23 @@ struct brickmanager_t
 
     /* height sampler */
     heightsampler_t* sampler;
+
+    /* streaming: a hash table of chunks of static bricks that are created
+       on demand. Materialized bricks are stored in the streamed buckets of
+       the cells of the grid */
+    fasthash_t* chunktable;
+
+    /* references to all allocated chunks (for quick access) */
+    DARRAY(brickchunk_t*, chunk_ref);
+
+    /* references to all materialized chunks */
+    DARRAY(brickchunk_t*, materialized_chunk);
+
+    /* number of brick records stored in chunks */
+    int record_count;
+
+    /* largest width or height of a streamed brick */
+    int max_record_size;
 };
 
 /* Iterator state */
@@ -110,18 +186,42 @@ struct brickiteratorstate_t
     brickbucket_t* own_bucket;
 };
 
+/* Query phases */
+enum {
+    QUERY_CELL_BUCKET,          /* visiting the bucket of static bricks of a cell */
+    QUERY_CELL_STREAMED_BUCKET, /* visiting the bucket of streamed bricks of a cell */
+    QUERY_AWAKE_BUCKET,         /* visiting the awake bucket */
+    QUERY_DONE                  /* there are no more bricks */
+};
+
 /* Utilities */
-#define GRID_SIZE 256 /* width and height of a cell of the spatial hash; this impacts the number of fasthash queries per frame (quadratically), as well as the number of returned bricks */
+#define GRID_SIZE 256 /* width and height of a cell of the spatial grid; this impacts the number of visited cells per frame (quadratically), as well as the number of returned bricks */
+#define INITIAL_GRID_SIZE 16 /* initial number of columns and rows of the dense grid */
+#define MAX_DENSE_CELLS (1 << 19) /* if a world needs more cells than this, we use a sparse grid */
 #define SAMPLER_WIDTH 128 /* width of the fixed-size intervals of the sampler */
 #define SAMPLER_MAX_INDEX 16384 /* >= MAX_LEVEL_WIDTH / SAMPLER_WIDTH */
-
-static inline uint64_t position_to_hash(int x, int y);
-static inline uint64_t brick2hash(const brick_t* brick);
+#define CHUNK_SIZE (8 * GRID_SIZE) /* width and height of a chunk of streamed bricks; must be a multiple of GRID_SIZE */
+#define CHUNK_MARGIN (CHUNK_SIZE / 2) /* chunks are released only when they are this far away from the ROI, so that we don't recreate bricks back and forth */
+
+static inline int position_to_cell(int coordinate);
+static inline void brick_to_cell(const brick_t* brick, int* col, int* row);
+static inline uint64_t cell_to_hash(int col, int row);
+static inline uint64_t position_to_chunk_hash(int x, int y);
+
+static inline const brickcell_t* find_cell(const brickmanager_t* manager, int col, int row);
+static brickcell_t* find_or_create_cell(brickmanager_t* manager, int col, int row);
+static void resize_dense_grid(brickmanager_t* manager, int cols, int rows);
+static void make_grid_sparse(brickmanager_t* manager);
+static void cell_dtor_adapter(void* cell);
+static inline void roi_to_cells(const brickrect_t* roi, int* first_col, int* first_row, int* last_col, int* last_row);
+static brickbucket_t* bucket_of_brick(brickmanager_t* manager, const brick_t* brick, bool streamed);
+static const brickbucket_t* query_next_entry(brickquery_t* query, int* index);
+static void start_query(const brickmanager_t* manager, brickquery_t* query, bool moving_only);
 
 static brickbucket_t* bucket_ctor(brick_t* (*brick_dtor)(brick_t*));
 static brickbucket_t* bucket_dtor(brickbucket_t* bucket);
-static void bucket_dtor_adapter(void* bucket);
 static inline void bucket_add(brickbucket_t* bucket, brick_t* brick);
+static inline void bucket_remove(brickbucket_t* bucket, int index);
 static int bucket_wash(brickbucket_t* bucket);
 static void bucket_clear(brickbucket_t* bucket);
 static inline bool bucket_is_empty(const brickbucket_t* bucket);
@@ -134,10 +234,20 @@ static bool brickiteratorstate_has_next(void* s);
 static heightsampler_t* sampler_ctor();
 static heightsampler_t* sampler_dtor(heightsampler_t* sampler);
 static void sampler_clear(heightsampler_t* sampler);
-static void sampler_add(heightsampler_t* sampler, const brick_t* brick);
+static void sampler_add(heightsampler_t* sampler, v2d_t spawn_point, v2d_t size);
 static int sampler_query(heightsampler_t* sampler, int left, int right);
 
-static void update_world_size(brickmanager_t* manager, const brick_t* brick);
+static void update_world_size(brickmanager_t* manager, v2d_t spawn_point, v2d_t size);
+
+static brickchunk_t* chunk_ctor(int left, int top);
+static brickchunk_t* chunk_dtor(brickchunk_t* chunk);
+static void chunk_dtor_adapter(void* chunk);
+static void materialize_chunk(brickmanager_t* manager, brickchunk_t* chunk);
+static void dematerialize_chunk(brickmanager_t* manager, brickchunk_t* chunk);
+static void materialize_chunks_inside_roi(brickmanager_t* manager);
+static void dematerialize_chunks_far_from_roi(brickmanager_t* manager);
+static int streaming_margin(const brickmanager_t* manager);
+static bool is_chunk_near_roi(const brickchunk_t* chunk, const brickrect_t* roi, int margin);
 
 static bool is_brick_inside_roi(const brick_t* brick, const brickrect_t* roi);
 static void filter_bricks_inside_roi(brickbucket_t* out_bucket, const brickbucket_t* in_bucket, const brickrect_t* roi);
@@ -165,12 +275,23 @@ brickmanager_t* brickmanager_create()
 {
     brickmanager_t* manager = mallocx(sizeof *manager);
 
-    manager->hashtable = fasthash_create(bucket_dtor_adapter, 12);
+    manager->grid = NULL;
+    manager->grid_cols = 0;
+    manager->grid_rows = 0;
+    manager->sparse_grid = NULL;
+    resize_dense_grid(manager, INITIAL_GRID_SIZE, INITIAL_GRID_SIZE);
+
     manager->awake_bucket = bucket_ctor(brick_destroy);
     darray_init(manager->bucket_ref);
     darray_push(manager->bucket_ref, manager->awake_bucket);
     manager->sampler = sampler_ctor();
 
+    manager->chunktable = fasthash_create(chunk_dtor_adapter, 8);
+    darray_init(manager->chunk_ref);
+    darray_init(manager->materialized_chunk);
+    manager->record_count = 0;
+    manager->max_record_size = 0;
+
     manager->roi = (brickrect_t){ 0, 0, 0, 0 };
     manager->brick_count = 0;
     manager->world_width = 1;
@@ -185,10 +306,21 @@ brickmanager_t* brickmanager_create()
  */
 brickmanager_t* brickmanager_destroy(brickmanager_t* manager)
 {
+    darray_release(manager->materialized_chunk); /* a vector of references only */
+    darray_release(manager->chunk_ref); /* a vector of references only */
+    fasthash_destroy(manager->chunktable);
     sampler_dtor(manager->sampler);
-    darray_release(manager->bucket_ref); /* a vector of references only */
-    bucket_dtor(manager->awake_bucket);
-    fasthash_destroy(manager->hashtable);
+
+    /* destroy all buckets, including the awake bucket */
+    for(int i = darray_length(manager->bucket_ref) - 1; i >= 0; i--)
+        bucket_dtor(manager->bucket_ref[i]);
+    darray_release(manager->bucket_ref);
+
+    /* destroy the grid */
+    if(manager->sparse_grid != NULL)
+        fasthash_destroy(manager->sparse_grid);
+    if(manager->grid != NULL)
+        free(manager->grid);
 
     free(manager);
     return NULL;
@@ -207,15 +339,7 @@ void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick)
     if(!is_moving_brick) {
 
         /* find the appropriate bucket for the brick */
-        uint64_t key = brick2hash(brick);
-        bucket = fasthash_get(manager->hashtable, key);
-
-        /* lazily allocate a new bucket if one doesn't exist */
-        if(bucket == NULL) {
-            bucket = bucket_ctor(brick_destroy);
-            fasthash_put(manager->hashtable, key, bucket);
-            darray_push(manager->bucket_ref, bucket);
-        }
+        bucket = bucket_of_brick(manager, brick, false);
 
     }
     else {
@@ -232,10 +356,106 @@ void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick)
     manager->brick_count++;
 
     /* update the size of the world */
-    update_world_size(manager, brick);
+    update_world_size(manager, brick_spawnpoint(brick), brick_size(brick));
 
     /* update the height sampler */
-    sampler_add(manager->sampler, brick);
+    sampler_add(manager->sampler, brick_spawnpoint(brick), brick_size(brick));
+}
+
+/*
+ * brickmanager_add_streamed_brick()
+ * Adds a static brick that will only be created when it gets near the ROI.
+ * Bricks that aren't static are created immediately.
+ */
+void brickmanager_add_streamed_brick(brickmanager_t* manager, int id, v2d_t position, bricklayer_t layer, brickflip_t flip)
+{
+    /* only static bricks can be streamed; other bricks have state */
+    if(brick_behavior_preview(id) != BRB_DEFAULT) {
+        brickmanager_add_brick(manager, brick_create(id, position, layer, flip));
+        return;
+    }
+
+    /* find the chunk of the brick, using the same criterion of brick_to_cell() */
+    v2d_t size = brick_size_preview(id);
+    int center_x = position.x + size.x * 0.5f;
+    int center_y = position.y + size.y * 0.5f;
+    uint64_t key = position_to_chunk_hash(center_x, center_y);
+    brickchunk_t* chunk = fasthash_get(manager->chunktable, key);
+
+    /* lazily allocate a new chunk if one doesn't exist */
+    if(chunk == NULL) {
+        int left = (max(center_x, 0) / CHUNK_SIZE) * CHUNK_SIZE;
+        int top = (max(center_y, 0) / CHUNK_SIZE) * CHUNK_SIZE;
+        chunk = chunk_ctor(left, top);
+        fasthash_put(manager->chunktable, key, chunk);
+        darray_push(manager->chunk_ref, chunk);
+    }
+
+    /* store the record */
+    brickrecord_t record = {
+        .id = id,
+        .x = position.x,
+        .y = position.y,
+        .layer = layer,
+        .flip = flip
+    };
+    darray_push(chunk->record, record);
+    manager->record_count++;
+    manager->max_record_size = max(manager->max_record_size, (int)max(size.x, size.y));
+
+    /* if the chunk is materialized, create the brick right away */
+    if(chunk->is_materialized) {
+        brick_t* brick = brick_create(id, position, layer, flip);
+        bucket_add(bucket_of_brick(manager, brick, true), brick);
+    }
+
+    /* update stats */
+    manager->brick_count++;
+    update_world_size(manager, position, size);
+    sampler_add(manager->sampler, position, size);
+}
+
+/*
+ * brickmanager_stop_streaming()
+ * Creates all streamed bricks, turning them into regular bricks.
+ * This is used by the level editor, which needs access to all bricks.
+ */
+void brickmanager_stop_streaming(brickmanager_t* manager)
+{
+    if(manager->record_count == 0)
+        return;
+
+    /* dematerialize all chunks, so that no brick gets created twice */
+    for(int c = 0; c < darray_length(manager->materialized_chunk); c++)
+        dematerialize_chunk(manager, manager->materialized_chunk[c]);
+    darray_clear(manager->materialized_chunk);
+
+    /* create regular bricks */
+    for(int c = 0; c < darray_length(manager->chunk_ref); c++) {
+        brickchunk_t* chunk = manager->chunk_ref[c];
+
+        for(int i = 0; i < darray_length(chunk->record); i++) {
+            const brickrecord_t* record = &(chunk->record[i]);
+            brick_t* brick = brick_create(record->id, v2d_new(record->x, record->y), record->layer, record->flip);
+            brickmanager_add_brick(manager, brick);
+        }
+
+        darray_clear(chunk->record);
+    }
+
+    /* the new bricks have already been counted */
+    manager->brick_count -= manager->record_count;
+    manager->record_count = 0;
+    manager->max_record_size = 0;
+}
+
+/*
+ * brickmanager_is_streaming()
+ * Are there any streamed bricks?
+ */
+bool brickmanager_is_streaming(const brickmanager_t* manager)
+{
+    return manager->record_count > 0;
 }
 
 /*
@@ -248,6 +468,15 @@ void brickmanager_remove_all_bricks(brickmanager_t* manager)
     for(int i = 0; i < darray_length(manager->bucket_ref); i++)
         bucket_clear((brickbucket_t*)manager->bucket_ref[i]);
 
+    /* clear all chunks; their bricks were stored in the buckets */
+    for(int c = 0; c < darray_length(manager->chunk_ref); c++) {
+        darray_clear(manager->chunk_ref[c]->record);
+        manager->chunk_ref[c]->is_materialized = false;
+    }
+    darray_clear(manager->materialized_chunk);
+    manager->record_count = 0;
+    manager->max_record_size = 0;
+
     /* reset the sampler */
     sampler_clear(manager->sampler);
 
@@ -265,28 +494,25 @@ void brickmanager_update(brickmanager_t* manager)
 {
     /* remove dead bricks inside (any bucket that intersects with) the ROI */
     int cnt = 0; /* we'll count the number of removed bricks */
-    int left = manager->roi.left;
-    int top = manager->roi.top;
-    int right = manager->roi.right;
-    int bottom = manager->roi.bottom;
-
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
+    int first_col, first_row, last_col, last_row;
 
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
-            brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+    roi_to_cells(&(manager->roi), &first_col, &first_row, &last_col, &last_row);
+    for(int row = first_row; row <= last_row; row++) {
+        for(int col = first_col; col <= last_col; col++) {
+            const brickcell_t* cell = find_cell(manager, col, row);
 
             /* wash the bucket if it exists */
-            if(bucket != NULL)
-                cnt += bucket_wash(bucket);
+            if(cell != NULL && cell->bucket != NULL)
+                cnt += bucket_wash(cell->bucket);
         }
     }
 
     /* remove dead bricks stored in the awake bucket */
     cnt += bucket_wash(manager->awake_bucket);
 
+    /* release the streamed bricks that are far away from the ROI */
+    dematerialize_chunks_far_from_roi(manager);
+
     /* update the brick count */
     manager->brick_count -= cnt;
 
@@ -356,10 +582,26 @@ void brickmanager_recalculate_world_size(brickmanager_t* manager)
         const brickbucket_t* bucket = manager->bucket_ref[b];
 
         for(int i = 0; i < darray_length(bucket->brick); i++) {
-            const brick_t* brick = bucket->brick[i];
+            v2d_t spawn_point = v2d_new(bucket->x[i], bucket->y[i]);
+            v2d_t size = v2d_new(bucket->w[i], bucket->h[i]);
+
+            update_world_size(manager, spawn_point, size);
+            sampler_add(manager->sampler, spawn_point, size);
+        }
+    }
+
+    /* iterate over all streamed bricks; materialized bricks are considered
+       twice, but that doesn't change the results */
+    for(int c = 0; c < darray_length(manager->chunk_ref); c++) {
+        const brickchunk_t* chunk = manager->chunk_ref[c];
+
+        for(int i = 0; i < darray_length(chunk->record); i++) {
+            const brickrecord_t* record = &(chunk->record[i]);
+            v2d_t spawn_point = v2d_new(record->x, record->y);
+            v2d_t size = brick_size_preview(record->id);
 
-            update_world_size(manager, brick);
-            sampler_add(manager->sampler, brick);
+            update_world_size(manager, spawn_point, size);
+            sampler_add(manager->sampler, spawn_point, size);
         }
     }
 }
@@ -417,6 +659,9 @@ void brickmanager_set_roi(brickmanager_t* manager, rect_t roi)
     manager->roi.top = y;
     manager->roi.right = x + width - 1;
     manager->roi.bottom = y + height - 1;
+
+    /* create the streamed bricks inside the ROI */
+    materialize_chunks_inside_roi(manager);
 }
 
 /*
@@ -433,23 +678,22 @@ iterator_t* brickmanager_retrieve_active_bricks(const brickmanager_t* manager)
     /* get the ROI */
     const brickrect_t* roi = &(manager->roi);
 
-    /* for each bucket inside the ROI */
-    int left = roi->left;
-    int top = roi->top;
-    int right = roi->right;
-    int bottom = roi->bottom;
+    /* for each cell inside the ROI */
+    int first_col, first_row, last_col, last_row;
+    roi_to_cells(roi, &first_col, &first_row, &last_col, &last_row);
 
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
+    for(int row = first_row; row <= last_row; row++) {
+        for(int col = first_col; col <= last_col; col++) {
+            const brickcell_t* cell = find_cell(manager, col, row);
+            if(cell == NULL)
+                continue;
 
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
-            const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+            /* add the buckets if they exist and if they're not empty */
+            if(cell->bucket != NULL && !bucket_is_empty(cell->bucket))
+                darray_push(state.bucket, cell->bucket);
 
-            /* add the bucket if it exists and if it's not empty */
-            if(bucket != NULL && !bucket_is_empty(bucket))
-                darray_push(state.bucket, bucket);
+            if(cell->streamed_bucket != NULL && !bucket_is_empty(cell->streamed_bucket))
+                darray_push(state.bucket, cell->streamed_bucket);
         }
     }
 
@@ -482,24 +726,19 @@ iterator_t* brickmanager_retrieve_active_moving_bricks(const brickmanager_t* man
     /* get the ROI */
     const brickrect_t* roi = &(manager->roi);
 
-    /* for each bucket inside the ROI */
-    int left = roi->left;
-    int top = roi->top;
-    int right = roi->right;
-    int bottom = roi->bottom;
-
-    right += GRID_SIZE - 1;
-    bottom += GRID_SIZE - 1;
+    /* for each cell inside the ROI */
+    int first_col, first_row, last_col, last_row;
+    roi_to_cells(roi, &first_col, &first_row, &last_col, &last_row);
 
-    for(int y = top; y <= bottom; y += GRID_SIZE) {
-        for(int x = left; x <= right; x += GRID_SIZE) {
-            uint64_t key = position_to_hash(x, y);
-            const brickbucket_t* bucket = fasthash_get(manager->hashtable, key);
+    for(int row = first_row; row <= last_row; row++) {
+        for(int col = first_col; col <= last_col; col++) {
+            const brickcell_t* cell = find_cell(manager, col, row);
 
             /* we must consider bricks with non-default behavior as "moving" */
+            /* (streamed bricks are static, so we skip their buckets) */
             /* we add the bucket if it exists and if it's not empty */
-            if(bucket != NULL && !bucket_is_empty(bucket))
-                filter_non_default_bricks(state.own_bucket, bucket);
+            if(cell != NULL && cell->bucket != NULL && !bucket_is_empty(cell->bucket))
+                filter_non_default_bricks(state.own_bucket, cell->bucket);
         }
     }
 
@@ -520,6 +759,56 @@ iterator_t* brickmanager_retrieve_active_moving_bricks(const brickmanager_t* man
     );
 }
 
+/*
+ * brickmanager_query_active_bricks()
+ * Starts a non-allocating query of the bricks inside the current ROI.
+ * Use brickmanager_query_next() to get the bricks. The Brick Manager
+ * must not be modified while the query is in progress.
+ */
+void brickmanager_query_active_bricks(const brickmanager_t* manager, brickquery_t* query)
+{
+    start_query(manager, query, false);
+}
+
+/*
+ * brickmanager_query_active_moving_bricks()
+ * Starts a non-allocating query of the moving bricks inside the current ROI
+ */
+void brickmanager_query_active_moving_bricks(const brickmanager_t* manager, brickquery_t* query)
+{
+    start_query(manager, query, true);
+}
+
+/*
+ * brickmanager_query_next()
+ * Gets the next brick of a query, or NULL if there are no more bricks
+ */
+brick_t* brickmanager_query_next(brickquery_t* query)
+{
+    int index;
+    const brickbucket_t* bucket = query_next_entry(query, &index);
+
+    return bucket != NULL ? bucket->brick[index] : NULL;
+}
+
+/*
+ * brickmanager_query_next_obstacle()
+ * Gets the obstacle of the next brick of a query that has one, or NULL
+ * if there are no more such bricks. The bricks aren't dereferenced.
+ */
+const struct obstacle_t* brickmanager_query_next_obstacle(brickquery_t* query)
+{
+    int index;
+    const brickbucket_t* bucket;
+
+    while((bucket = query_next_entry(query, &index)) != NULL) {
+        if(bucket->obstacle[index] != NULL)
+            return bucket->obstacle[index];
+    }
+
+    return NULL;
+}
+
 /*
  * brickmanager_retrieve_all_bricks()
  * Retrieves all bricks
@@ -601,9 +890,178 @@ brick_list_t* brickmanager_release_list(brick_list_t* list)
  */
 
 
-/* hashing utilities */
+/* grid utilities */
+
+int position_to_cell(int coordinate)
+{
+    return max(coordinate, 0) / GRID_SIZE;
+}
 
-uint64_t position_to_hash(int x, int y)
+void brick_to_cell(const brick_t* brick, int* col, int* row)
+{
+    /* the spawn point does not change !!!
+       the position may change and we do not keep track of position changes */
+    v2d_t topleft = brick_spawnpoint(brick);
+    v2d_t size = brick_size(brick);
+
+    int center_x = topleft.x + size.x * 0.5f;
+    int center_y = topleft.y + size.y * 0.5f;
+
+    *col = position_to_cell(center_x);
+    *row = position_to_cell(center_y);
+}
+
+uint64_t cell_to_hash(int col, int row)
+{
+    return (((uint64_t)col) << 32) | ((uint64_t)row);
+}
+
+void roi_to_cells(const brickrect_t* roi, int* first_col, int* first_row, int* last_col, int* last_row)
+{
+    /* bricks are stored in the cells of their centers, so we visit
+       an additional column and an additional row */
+    *first_col = position_to_cell(roi->left);
+    *first_row = position_to_cell(roi->top);
+    *last_col = position_to_cell(roi->right + GRID_SIZE - 1);
+    *last_row = position_to_cell(roi->bottom + GRID_SIZE - 1);
+}
+
+const brickcell_t* find_cell(const brickmanager_t* manager, int col, int row)
+{
+    /* dense grid: a straight array access */
+    if(manager->grid != NULL) {
+        if(col < manager->grid_cols && row < manager->grid_rows)
+            return &(manager->grid[row * manager->grid_cols + col]);
+
+        return NULL;
+    }
+
+    /* sparse grid */
+    return fasthash_get(manager->sparse_grid, cell_to_hash(col, row));
+}
+
+brickcell_t* find_or_create_cell(brickmanager_t* manager, int col, int row)
+{
+    /* dense grid */
+    if(manager->grid != NULL) {
+
+        /* grow the grid if necessary */
+        if(col >= manager->grid_cols || row >= manager->grid_rows) {
+            int cols = manager->grid_cols, rows = manager->grid_rows;
+
+            /* grow geometrically, so that we don't resize the grid too often */
+            if(col >= cols)
+                cols = max(col + 1, 2 * manager->grid_cols);
+            if(row >= rows)
+                rows = max(row + 1, 2 * manager->grid_rows);
+
+            /* don't grow beyond what's needed if the grid gets too large */
+            if((int64_t)cols * (int64_t)rows > MAX_DENSE_CELLS) {
+                cols = max(col + 1, manager->grid_cols);
+                rows = max(row + 1, manager->grid_rows);
+            }
+
+            /* fallback to a sparse grid if the world is outlandish */
+            if((int64_t)cols * (int64_t)rows > MAX_DENSE_CELLS)
+                make_grid_sparse(manager);
+            else
+                resize_dense_grid(manager, cols, rows);
+        }
+
+        /* a straight array access */
+        if(manager->grid != NULL)
+            return &(manager->grid[row * manager->grid_cols + col]);
+
+    }
+
+    /* sparse grid: lazily allocate a new cell if one doesn't exist */
+    uint64_t key = cell_to_hash(col, row);
+    brickcell_t* cell = fasthash_get(manager->sparse_grid, key);
+
+    if(cell == NULL) {
+        cell = mallocx(sizeof *cell);
+        cell->bucket = NULL;
+        cell->streamed_bucket = NULL;
+        fasthash_put(manager->sparse_grid, key, cell);
+    }
+
+    return cell;
+}
+
+void resize_dense_grid(brickmanager_t* manager, int cols, int rows)
+{
+    brickcell_t* grid = mallocx(cols * rows * sizeof(*grid));
+
+    /* copy the existing cells and clear the new ones */
+    for(int row = 0; row < rows; row++) {
+        for(int col = 0; col < cols; col++) {
+            brickcell_t* cell = &(grid[row * cols + col]);
+
+            if(col < manager->grid_cols && row < manager->grid_rows)
+                *cell = manager->grid[row * manager->grid_cols + col];
+            else
+                cell->bucket = cell->streamed_bucket = NULL;
+        }
+    }
+
+    /* replace the grid */
+    if(manager->grid != NULL)
+        free(manager->grid);
+
+    manager->grid = grid;
+    manager->grid_cols = cols;
+    manager->grid_rows = rows;
+}
+
+void make_grid_sparse(brickmanager_t* manager)
+{
+    /* move the non-empty cells of the dense grid to a hash table */
+    manager->sparse_grid = fasthash_create(cell_dtor_adapter, 12);
+
+    for(int row = 0; row < manager->grid_rows; row++) {
+        for(int col = 0; col < manager->grid_cols; col++) {
+            const brickcell_t* cell = &(manager->grid[row * manager->grid_cols + col]);
+
+            if(cell->bucket != NULL || cell->streamed_bucket != NULL) {
+                brickcell_t* sparse_cell = mallocx(sizeof *sparse_cell);
+                *sparse_cell = *cell;
+                fasthash_put(manager->sparse_grid, cell_to_hash(col, row), sparse_cell);
+            }
+        }
+    }
+
+    /* release the dense grid */
+    free(manager->grid);
+    manager->grid = NULL;
+    manager->grid_cols = 0;
+    manager->grid_rows = 0;
+}
+
+void cell_dtor_adapter(void* cell)
+{
+    /* the buckets are owned by the Brick Manager */
+    free(cell);
+}
+
+brickbucket_t* bucket_of_brick(brickmanager_t* manager, const brick_t* brick, bool streamed)
+{
+    int col, row;
+
+    /* find the cell of the brick */
+    brick_to_cell(brick, &col, &row);
+    brickcell_t* cell = find_or_create_cell(manager, col, row);
+
+    /* lazily allocate a new bucket if one doesn't exist */
+    brickbucket_t** bucket = streamed ? &(cell->streamed_bucket) : &(cell->bucket);
+    if(*bucket == NULL) {
+        *bucket = bucket_ctor(brick_destroy);
+        darray_push(manager->bucket_ref, *bucket);
+    }
+
+    return *bucket;
+}
+
+uint64_t position_to_chunk_hash(int x, int y)
 {
     if(x < 0)
         x = 0;
@@ -611,23 +1069,115 @@ uint64_t position_to_hash(int x, int y)
     if(y < 0)
         y = 0;
 
-    x /= GRID_SIZE;
-    y /= GRID_SIZE;
+    x /= CHUNK_SIZE;
+    y /= CHUNK_SIZE;
 
     return (((uint64_t)x) << 32) | ((uint64_t)y);
 }
 
-uint64_t brick2hash(const brick_t* brick)
+
+
+
+/* queries */
+
+/* finds the next brick of a query. Returns its bucket and writes its
+   index to the output parameter, or returns NULL if there are no more bricks */
+const brickbucket_t* query_next_entry(brickquery_t* query, int* index)
 {
-    /* the spawn point does not change !!!
-       the position may change and we do not keep track of position changes */
-    v2d_t topleft = brick_spawnpoint(brick);
-    v2d_t size = brick_size(brick);
+    const brickmanager_t* manager = query->manager;
 
-    int center_x = topleft.x + size.x * 0.5f;
-    int center_y = topleft.y + size.y * 0.5f;
+    for(;;) {
+        const brickbucket_t* bucket = NULL;
+
+        /* pick the current bucket */
+        switch(query->phase) {
+            case QUERY_CELL_BUCKET:
+                bucket = query->cell != NULL ? query->cell->bucket : NULL;
+                break;
+
+            case QUERY_CELL_STREAMED_BUCKET:
+                bucket = query->cell != NULL ? query->cell->streamed_bucket : NULL;
+                break;
+
+            case QUERY_AWAKE_BUCKET:
+                bucket = manager->awake_bucket;
+                break;
+
+            default:
+                return NULL; /* we're done */
+        }
+
+        /* find the next brick of the bucket that passes the filter */
+        if(bucket != NULL) {
+            int length = darray_length(bucket->brick);
+
+            if(query->phase == QUERY_AWAKE_BUCKET) {
+                /* awake bricks may be far away from the ROI. Their
+                   position changes, so we must look at the bricks */
+                while(query->index < length) {
+                    int i = query->index++;
+                    if(is_brick_inside_roi(bucket->brick[i], &(manager->roi))) {
+                        *index = i;
+                        return bucket;
+                    }
+                }
+            }
+            else if(query->moving_only) {
+                /* we must consider bricks with non-default behavior as "moving" */
+                while(query->index < length) {
+                    int i = query->index++;
+                    if(bucket->behavior[i] != BRB_DEFAULT) {
+                        *index = i;
+                        return bucket;
+                    }
+                }
+            }
+            else if(query->index < length) {
+                *index = query->index++;
+                return bucket;
+            }
+        }
 
-    return position_to_hash(center_x, center_y);
+        /* advance to the next bucket */
+        query->index = 0;
+        if(query->phase == QUERY_CELL_BUCKET && !query->moving_only) {
+            /* streamed bricks are static */
+            query->phase = QUERY_CELL_STREAMED_BUCKET;
+        }
+        else if(query->phase == QUERY_AWAKE_BUCKET) {
+            query->phase = QUERY_DONE;
+        }
+        else {
+            /* move to the next cell */
+            if(++(query->col) > query->last_col) {
+                query->col = query->first_col;
+                query->row++;
+            }
+
+            /* after visiting all cells, we visit the awake bucket */
+            if(query->row <= query->last_row) {
+                query->phase = QUERY_CELL_BUCKET;
+                query->cell = find_cell(manager, query->col, query->row);
+            }
+            else
+                query->phase = QUERY_AWAKE_BUCKET;
+        }
+    }
+}
+
+void start_query(const brickmanager_t* manager, brickquery_t* query, bool moving_only)
+{
+    int first_row;
+
+    roi_to_cells(&(manager->roi), &(query->first_col), &first_row, &(query->last_col), &(query->last_row));
+
+    query->manager = manager;
+    query->col = query->first_col;
+    query->row = first_row;
+    query->cell = find_cell(manager, query->col, query->row);
+    query->phase = QUERY_CELL_BUCKET;
+    query->index = 0;
+    query->moving_only = moving_only;
 }
 
 
@@ -640,6 +1190,12 @@ brickbucket_t* bucket_ctor(brick_t* (*brick_dtor)(brick_t*))
     brickbucket_t* bucket = mallocx(sizeof *bucket);
 
     darray_init(bucket->brick);
+    darray_init(bucket->x);
+    darray_init(bucket->y);
+    darray_init(bucket->w);
+    darray_init(bucket->h);
+    darray_init(bucket->behavior);
+    darray_init(bucket->obstacle);
     bucket->brick_dtor = brick_dtor;
 
     return bucket;
@@ -652,6 +1208,12 @@ brickbucket_t* bucket_dtor(brickbucket_t* bucket)
         bucket->brick_dtor(bucket->brick[i]);
 
     /* release the bucket */
+    darray_release(bucket->obstacle);
+    darray_release(bucket->behavior);
+    darray_release(bucket->h);
+    darray_release(bucket->w);
+    darray_release(bucket->y);
+    darray_release(bucket->x);
     darray_release(bucket->brick);
     free(bucket);
 
@@ -659,14 +1221,29 @@ brickbucket_t* bucket_dtor(brickbucket_t* bucket)
     return NULL;
 }
 
-void bucket_dtor_adapter(void* bucket)
+void bucket_add(brickbucket_t* bucket, brick_t* brick)
 {
-    bucket_dtor((brickbucket_t*)bucket);
+    v2d_t spawn_point = brick_spawnpoint(brick);
+    v2d_t size = brick_size(brick);
+
+    darray_push(bucket->brick, brick);
+    darray_push(bucket->x, spawn_point.x);
+    darray_push(bucket->y, spawn_point.y);
+    darray_push(bucket->w, size.x);
+    darray_push(bucket->h, size.y);
+    darray_push(bucket->behavior, brick_behavior(brick));
+    darray_push(bucket->obstacle, brick_obstacle(brick));
 }
 
-void bucket_add(brickbucket_t* bucket, brick_t* brick)
+void bucket_remove(brickbucket_t* bucket, int index)
 {
-    darray_push(bucket->brick, brick);
+    darray_remove(bucket->brick, index);
+    darray_remove(bucket->x, index);
+    darray_remove(bucket->y, index);
+    darray_remove(bucket->w, index);
+    darray_remove(bucket->h, index);
+    darray_remove(bucket->behavior, index);
+    darray_remove(bucket->obstacle, index);
 }
 
 int bucket_wash(brickbucket_t* bucket)
@@ -677,7 +1254,7 @@ int bucket_wash(brickbucket_t* bucket)
     for(int i = darray_length(bucket->brick) - 1; i >= 0; i--) {
         if(!brick_is_alive(bucket->brick[i])) {
             bucket->brick_dtor(bucket->brick[i]);
-            darray_remove(bucket->brick, i);
+            bucket_remove(bucket, i);
             count++;
         }
     }
@@ -692,6 +1269,12 @@ void bucket_clear(brickbucket_t* bucket)
         bucket->brick_dtor(bucket->brick[i]);
 
     darray_clear(bucket->brick);
+    darray_clear(bucket->x);
+    darray_clear(bucket->y);
+    darray_clear(bucket->w);
+    darray_clear(bucket->h);
+    darray_clear(bucket->behavior);
+    darray_clear(bucket->obstacle);
 }
 
 bool bucket_is_empty(const brickbucket_t* bucket)
@@ -830,11 +1413,8 @@ void sampler_clear(heightsampler_t* sampler)
     darray_push(sampler->smooth_height_at, 0);
 }
 
-void sampler_add(heightsampler_t* sampler, const brick_t* brick)
+void sampler_add(heightsampler_t* sampler, v2d_t spawn_point, v2d_t size)
 {
-    v2d_t spawn_point = brick_spawnpoint(brick);
-    v2d_t size = brick_size(brick);
-
     int center_x = spawn_point.x + size.x * 0.5f;
     if(center_x < 0)
         center_x = 0;
@@ -904,11 +1484,8 @@ int sampler_query(heightsampler_t* sampler, int left, int right)
 
 /* world size */
 
-void update_world_size(brickmanager_t* manager, const brick_t* brick)
+void update_world_size(brickmanager_t* manager, v2d_t spawn_point, v2d_t size)
 {
-    v2d_t spawn_point = brick_spawnpoint(brick);
-    v2d_t size = brick_size(brick);
-
     int right = spawn_point.x + size.x;
     if(right > manager->world_width)
         manager->world_width = right;
@@ -920,6 +1497,140 @@ void update_world_size(brickmanager_t* manager, const brick_t* brick)
 
 
 
+/* streaming */
+
+brickchunk_t* chunk_ctor(int left, int top)
+{
+    brickchunk_t* chunk = mallocx(sizeof *chunk);
+
+    darray_init(chunk->record);
+    chunk->left = left;
+    chunk->top = top;
+    chunk->is_materialized = false;
+
+    return chunk;
+}
+
+brickchunk_t* chunk_dtor(brickchunk_t* chunk)
+{
+    /* the materialized bricks are owned by the buckets */
+    darray_release(chunk->record);
+    free(chunk);
+
+    return NULL;
+}
+
+void chunk_dtor_adapter(void* chunk)
+{
+    chunk_dtor((brickchunk_t*)chunk);
+}
+
+void materialize_chunk(brickmanager_t* manager, brickchunk_t* chunk)
+{
+    /* create the bricks of the chunk */
+    for(int i = 0; i < darray_length(chunk->record); i++) {
+        const brickrecord_t* record = &(chunk->record[i]);
+        brick_t* brick = brick_create(record->id, v2d_new(record->x, record->y), record->layer, record->flip);
+
+        /* we don't update the stats, because streamed bricks
+           are counted when they are recorded */
+        bucket_add(bucket_of_brick(manager, brick, true), brick);
+    }
+
+    /* done */
+    chunk->is_materialized = true;
+}
+
+void dematerialize_chunk(brickmanager_t* manager, brickchunk_t* chunk)
+{
+    /* the buckets of the streamed bricks of a chunk are inside the chunk,
+       because CHUNK_SIZE is a multiple of GRID_SIZE */
+    int first_col = position_to_cell(chunk->left);
+    int first_row = position_to_cell(chunk->top);
+    int last_col = position_to_cell(chunk->left + CHUNK_SIZE - 1);
+    int last_row = position_to_cell(chunk->top + CHUNK_SIZE - 1);
+
+    for(int row = first_row; row <= last_row; row++) {
+        for(int col = first_col; col <= last_col; col++) {
+            const brickcell_t* cell = find_cell(manager, col, row);
+
+            /* destroy the bricks of the bucket */
+            if(cell != NULL && cell->streamed_bucket != NULL)
+                bucket_clear(cell->streamed_bucket);
+        }
+    }
+
+    /* done */
+    chunk->is_materialized = false;
+}
+
+void materialize_chunks_inside_roi(brickmanager_t* manager)
+{
+    /* nothing to do */
+    if(manager->record_count == 0)
+        return;
+
+    /* bricks are stored in the chunk of their center, so a brick may
+       overlap the ROI even if its chunk doesn't. Extend the ROI by the
+       size of the largest streamed brick, but not by less than a cell,
+       since the queries also visit the cells touching the ROI */
+    const brickrect_t* roi = &(manager->roi);
+    int margin = streaming_margin(manager);
+
+    /* for each chunk inside the extended ROI. Start at the chunk grid,
+       so that we visit each chunk overlapping it exactly once */
+    int left = (max(roi->left - margin, 0) / CHUNK_SIZE) * CHUNK_SIZE;
+    int top = (max(roi->top - margin, 0) / CHUNK_SIZE) * CHUNK_SIZE;
+    int right = roi->right + margin;
+    int bottom = roi->bottom + margin;
+
+    for(int y = top; y <= bottom; y += CHUNK_SIZE) {
+        for(int x = left; x <= right; x += CHUNK_SIZE) {
+            uint64_t key = position_to_chunk_hash(x, y);
+            brickchunk_t* chunk = fasthash_get(manager->chunktable, key);
+
+            /* materialize the chunk if it exists and if it's not materialized yet */
+            if(chunk != NULL && !chunk->is_materialized) {
+                materialize_chunk(manager, chunk);
+                darray_push(manager->materialized_chunk, chunk);
+            }
+        }
+    }
+}
+
+void dematerialize_chunks_far_from_roi(brickmanager_t* manager)
+{
+    /* dematerialize the chunks that are far away from the ROI */
+    for(int c = darray_length(manager->materialized_chunk) - 1; c >= 0; c--) {
+        brickchunk_t* chunk = manager->materialized_chunk[c];
+
+        if(!is_chunk_near_roi(chunk, &(manager->roi), streaming_margin(manager) + CHUNK_MARGIN)) {
+            dematerialize_chunk(manager, chunk);
+            darray_remove(manager->materialized_chunk, c);
+        }
+    }
+}
+
+int streaming_margin(const brickmanager_t* manager)
+{
+    return max(manager->max_record_size, GRID_SIZE);
+}
+
+bool is_chunk_near_roi(const brickchunk_t* chunk, const brickrect_t* roi, int margin)
+{
+    int left = chunk->left;
+    int top = chunk->top;
+    int right = chunk->left + CHUNK_SIZE - 1;
+    int bottom = chunk->top + CHUNK_SIZE - 1;
+
+    return !(
+        right < roi->left - margin || left > roi->right + margin ||
+        bottom < roi->top - margin || top > roi->bottom + margin
+    );
+}
+
+
+
 /* ROI & filtering */
 
 bool is_brick_inside_roi(const brick_t* brick, const brickrect_t* roi)
@@ -952,10 +1663,8 @@ void filter_bricks_inside_roi(brickbucket_t* out_bucket, const brickbucket_t* in
 void filter_non_default_bricks(brickbucket_t* out_bucket, const brickbucket_t* in_bucket)
 {
     for(int i = 0; i < darray_length(in_bucket->brick); i++) {
-        brick_t* brick = in_bucket->brick[i];
-
-        if(brick_behavior(brick) != BRB_DEFAULT)
-            bucket_add(out_bucket, brick); /* add a reference to the output bucket */
+        if(in_bucket->behavior[i] != BRB_DEFAULT)
+            bucket_add(out_bucket, in_bucket->brick[i]); /* add a reference to the output bucket */
     }
 }
 
@@ -21,14 +21,32 @@
 #ifndef _BRICKMANAGER_H
 #define _BRICKMANAGER_H
 
+#include <stdbool.h>
 #include "../util/rect.h"
+#include "brick.h"
 
 /* forward declarations */
 typedef struct brickmanager_t brickmanager_t;
+typedef struct brickquery_t brickquery_t;
 struct brickmanager_t;
+struct brickcell_t;
 struct brick_list_t;
 struct brick_t;
 struct iterator_t;
+struct obstacle_t;
+
+/* A query is a non-allocating iterator over bricks. It's meant to be
+   allocated on the stack. Its fields are private. */
+struct brickquery_t
+{
+    const brickmanager_t* manager;
+    const struct brickcell_t* cell; /* current cell */
+    int col, row; /* current position in the grid */
+    int first_col, last_col, last_row; /* cells of the ROI */
+    int phase; /* what are we visiting? */
+    int index; /* index of the next brick of the current bucket */
+    bool moving_only; /* retrieve moving bricks only? */
+};
 
 /* public API */
 brickmanager_t* brickmanager_create();
@@ -40,12 +58,23 @@ void brickmanager_add_brick(brickmanager_t* manager, struct brick_t* brick);
 void brickmanager_remove_all_bricks(brickmanager_t* manager);
 int brickmanager_number_of_bricks(const brickmanager_t* manager);
 
+/* streaming */
+void brickmanager_add_streamed_brick(brickmanager_t* manager, int id, v2d_t position, bricklayer_t layer, brickflip_t flip); /* the brick will be created when it gets near the ROI */
+void brickmanager_stop_streaming(brickmanager_t* manager); /* create all streamed bricks, so that they become regular bricks */
+bool brickmanager_is_streaming(const brickmanager_t* manager); /* are there any streamed bricks? */
+
 /* retrieval */
 void brickmanager_set_roi(brickmanager_t* manager, rect_t roi); /* set region of interest (ROI) */
 struct iterator_t* brickmanager_retrieve_active_bricks(const brickmanager_t* manager); /* efficient retrieval based on a ROI */
 struct iterator_t* brickmanager_retrieve_active_moving_bricks(const brickmanager_t* manager); /* retrieve moving bricks within the ROI */
 struct iterator_t* brickmanager_retrieve_all_bricks(const brickmanager_t* manager);
 
+/* non-allocating retrieval */
+void brickmanager_query_active_bricks(const brickmanager_t* manager, brickquery_t* query); /* bricks inside the ROI */
+void brickmanager_query_active_moving_bricks(const brickmanager_t* manager, brickquery_t* query); /* moving bricks inside the ROI */
+struct brick_t* brickmanager_query_next(brickquery_t* query); /* returns NULL if there are no more bricks */
+const struct obstacle_t* brickmanager_query_next_obstacle(brickquery_t* query); /* obstacles of the bricks; returns NULL if there are no more */
+
 /* world size */
 void brickmanager_world_size(const brickmanager_t* manager, int* world_width, int* world_height);
 int brickmanager_world_height_at_interval(const brickmanager_t* manager, int left_xpos, int right_xpos); /* coordinates are inclusive */
@@ -20,6 +20,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 
 #include "item.h"
@@ -76,10 +77,15 @@ static void door_close(item_t *door);
 static item_t* switch_create();
 static item_t* endsign_create();
 static item_t* explosion_create();
+static void explosion_step(const item_t *item, itemstep_t *step);
 static item_t* flyingtext_create();
+static void flyingtext_step(const item_t *item, itemstep_t *step);
+static void flyingtext_commit(item_t *item, const itemstep_t *step);
 static item_t* goalsign_create();
 static item_t* icon_create();
 static void icon_change_animation(item_t *item, int anim_id);
+static void icon_step(const item_t *item, itemstep_t *step);
+static void icon_commit(item_t *item, const itemstep_t *step);
 static item_t* lifebox_create();
 static item_t* collectiblebox_create();
 static item_t* starbox_create();
@@ -603,6 +609,94 @@ void item_update(item_t *item, player_t **team, int team_size, brick_list_t *bri
 }
 
 
+
+/*
+ * item_is_self_contained()
+ * The update of a self-contained item touches only the item itself: it doesn't
+ * read the players, the bricks, the lists or any global state other than the
+ * timer, and no other item or object reads it. Such an update is split in two
+ * phases: item_prepare_step(), which may run in parallel with the others, and
+ * item_commit_step(), which runs on the main thread
+ */
+bool item_is_self_contained(const item_t *item)
+{
+    switch(item->type) {
+        case IT_CRUSHEDBOX:
+        case IT_ICON:
+        case IT_EXPLOSION:
+        case IT_FLYINGTEXT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+
+/*
+ * item_prepare_step()
+ * Computes the next state of a self-contained item without modifying
+ * anything. This is thread-safe. Steps of the same item computed from
+ * the same state are bit-identical, so they can be compared with memcmp()
+ */
+void item_prepare_step(const item_t *item, itemstep_t *step)
+{
+    /* zero the padding */
+    memset(step, 0, sizeof(*step));
+
+    /* by default, nothing changes */
+    step->state = item->state;
+    step->position = item->actor->position;
+
+    switch(item->type) {
+        case IT_CRUSHEDBOX:
+            break;
+
+        case IT_ICON:
+            icon_step(item, step);
+            break;
+
+        case IT_EXPLOSION:
+            explosion_step(item, step);
+            break;
+
+        case IT_FLYINGTEXT:
+            flyingtext_step(item, step);
+            break;
+
+        default:
+            fatal_error("Can't prepare the step of item %d: it's not self-contained", item->type);
+            break;
+    }
+}
+
+
+
+/*
+ * item_commit_step()
+ * Applies a step computed by item_prepare_step(). Call it on the main thread
+ */
+void item_commit_step(item_t *item, const itemstep_t *step)
+{
+    item->state = step->state;
+    item->actor->position = step->position;
+
+    switch(item->type) {
+        case IT_ICON:
+            icon_commit(item, step);
+            break;
+
+        case IT_FLYINGTEXT:
+            flyingtext_commit(item, step);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
 /* ============ private utilities ============== */
 
 /*
@@ -2324,9 +2418,17 @@ void explosion_release(item_t* item)
 
 
 void explosion_update(item_t* item, player_t** team, int team_size, brick_list_t* brick_list, item_list_t* item_list, enemy_list_t* enemy_list)
+{
+    itemstep_t step;
+
+    item_prepare_step(item, &step);
+    item_commit_step(item, &step);
+}
+
+void explosion_step(const item_t *item, itemstep_t *step)
 {
     if(actor_animation_finished(item->actor))
-        item->state = IS_DEAD;
+        step->state = IS_DEAD;
 }
 
 
@@ -2414,15 +2516,30 @@ void flyingtext_release(item_t* item)
 
 void flyingtext_update(item_t* item, player_t** team, int team_size, brick_list_t* brick_list, item_list_t* item_list, enemy_list_t* enemy_list)
 {
-    flyingtext_t *me = (flyingtext_t*)item;
+    itemstep_t step;
+
+    item_prepare_step(item, &step);
+    item_commit_step(item, &step);
+}
+
+void flyingtext_step(const item_t *item, itemstep_t *step)
+{
+    const flyingtext_t *me = (const flyingtext_t*)item;
     float dt = timer_get_delta();
 
-    me->elapsed_time += dt;
-    if(me->elapsed_time < 0.5f)
-        item->actor->position.y -= 100.0f * dt;
-    else if(me->elapsed_time > 2.0f)
-        item->state = IS_DEAD;
+    step->elapsed_time = me->elapsed_time + dt;
+    if(step->elapsed_time < 0.5f)
+        step->position.y -= 100.0f * dt;
+    else if(step->elapsed_time > 2.0f)
+        step->state = IS_DEAD;
+}
 
+void flyingtext_commit(item_t *item, const itemstep_t *step)
+{
+    flyingtext_t *me = (flyingtext_t*)item;
+
+    /* fonts aren't thread-safe */
+    me->elapsed_time = step->elapsed_time;
     font_set_position(me->font, v2d_subtract(item->actor->position, v2d_new(me->textsize.x/2, me->textsize.y/2)));
 }
 
@@ -2566,19 +2683,27 @@ void icon_release(item_t* item)
 
 void icon_update(item_t* item, player_t** team, int team_size, brick_list_t* brick_list, item_list_t* item_list, enemy_list_t* enemy_list)
 {
-    icon_t *me = (icon_t*)item;
-    actor_t *act = item->actor;
+    itemstep_t step;
+
+    item_prepare_step(item, &step);
+    item_commit_step(item, &step);
+}
+
+void icon_step(const item_t *item, itemstep_t *step)
+{
+    const icon_t *me = (const icon_t*)item;
     float dt = timer_get_delta();
 
-    me->elapsed_time += dt;
-    if(me->elapsed_time < 1.0f) {
+    step->elapsed_time = me->elapsed_time + dt;
+    if(step->elapsed_time < 1.0f) {
         /* rise */
-        act->position.y -= 40.0f * dt;
+        step->position.y -= 40.0f * dt;
     }
-    else if(me->elapsed_time >= 2.5f) {
+    else if(step->elapsed_time >= 2.5f) {
         #if 0
         /* death */
         int i, j;
+        const actor_t *act = item->actor;
         int x = (int)(act->position.x-act->hot_spot.x);
         int y = (int)(act->position.y-act->hot_spot.y);
         image_t *img = actor_image(act);
@@ -2600,10 +2725,16 @@ void icon_update(item_t* item, player_t** team, int team_size, brick_list_t* bri
         #endif
 
         /* done */
-        item->state = IS_DEAD;
+        step->state = IS_DEAD;
     }
 }
 
+void icon_commit(item_t *item, const itemstep_t *step)
+{
+    icon_t *me = (icon_t*)item;
+    me->elapsed_time = step->elapsed_time;
+}
+
 
 void icon_render(item_t* item, v2d_t camera_position)
 {
@@ -21,6 +21,7 @@
 #ifndef _ITEM_H
 #define _ITEM_H
 
+#include <stdbool.h>
 #include "../../util/v2d.h"
 
 /* item list */
@@ -147,6 +148,14 @@ struct item_t {
     struct collisionmask_t* mask; /* collision mask */
 };
 
+/* the next state of a self-contained item, computed without modifying the item */
+typedef struct itemstep_t itemstep_t;
+struct itemstep_t {
+    itemstate_t state; /* state of the item */
+    v2d_t position; /* position of the actor */
+    float elapsed_time; /* clock of the item, if it has one */
+};
+
 /* linked list of items */
 struct item_list_t {
     item_t *data;
@@ -159,6 +168,11 @@ item_t* item_destroy(item_t *item);
 void item_update(item_t *item, struct player_t** team, int team_size, struct brick_list_t *brick_list, struct item_list_t *item_list, struct enemy_list_t *enemy_list);
 void item_render(item_t *item, v2d_t camera_position);
 
+/* two-phase update of self-contained items */
+bool item_is_self_contained(const item_t *item); /* does the update of the item touch only the item itself? */
+void item_prepare_step(const item_t *item, itemstep_t *step); /* computes the next state of a self-contained item; thread-safe */
+void item_commit_step(item_t *item, const itemstep_t *step); /* applies a step computed by item_prepare_step() */
+
 /* item-specific functions (legacy stuff) */
 void bouncingcollectible_set_velocity(item_t *item, v2d_t velocity);
 void flyingtext_set_text(item_t *item, const char *fmt, ...);
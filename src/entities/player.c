@@ -75,6 +75,7 @@ static void update_shield(player_t *player);
 static void update_animation(player_t *player);
 static void update_animation_speed(player_t *player);
 static void physics_adapter(player_t *player, const obstaclemap_t* obstaclemap);
+static void update_logic(player_t *player);
 static float smooth_angle(const physicsactor_t* pa, float current_angle);
 static bool require_angle_to_be_zero(physicsactorstate_t state, movmode_t movmode);
 static inline float delta_angle(float alpha, float beta);
@@ -197,196 +198,40 @@ player_t* player_destroy(player_t *player)
  */
 void player_update(player_t *player, const obstaclemap_t* obstaclemap)
 {
-    actor_t *act = player->actor;
-    physicsactor_t *pa = player->pa;
-    float padding = 16.0f, eps = 1e-5;
-    float dt = timer_get_delta();
-
-    /* if the player movement is enabled... */
-    if(!player->disable_movement) {
-
-        /* run physics simulation */
+    /* run physics simulation */
+    if(!player->disable_movement)
         physics_adapter(player, obstaclemap);
 
-        /* read new position */
-        v2d_t position = player_position(player);
-
-        /* enter / leave water */
-        /* FIXME scripting flag */
-        if(position.y >= level_waterlevel()) {
-            if(!player->underwater)
-                player_enter_water(player);
-        }
-        else {
-            if(player->underwater)
-                player_leave_water(player);
-        }
-
-        /* underwater logic */
-        if(player->underwater) {
-            /* disable turbo */
-            player_set_turbo(player, FALSE);
-
-            /* disable some shields */
-            if(player->shield_type == SH_FIRESHIELD || player->shield_type == SH_THUNDERSHIELD) {
-                if(!player_is_invincible(player))
-                    player_hit(player, 0.0f);
-                else
-                    player->shield_type = SH_NONE;
-            }
-
-            /* timer countdown */
-            if(player->shield_type != SH_WATERSHIELD && !player_is_winning(player) && (
-                position.y < level_waterlevel() || /* forced underwater via scripting OR... */
-                is_head_underwater(player)         /* the head of the player is underwater */
-            ))
-                player->underwater_timer += dt;
-            else
-                player->underwater_timer = 0.0f;
-
-            /* drowning */
-            if(player_seconds_remaining_to_drown(player) <= 0.0f)
-                player_drown(player);
-        }
-
-        /* the player is blinking */
-        if(player->blinking) {
-            player->blink_timer += dt;
-
-            if(player->blink_timer >= player->blink_visibility_timer + 0.06f) {
-                player->blink_visibility_timer = player->blink_timer;
-                act->visible = !act->visible;
-            }
-
-            if(player->blink_timer >= PLAYER_MAX_BLINK)
-                player_set_blinking(player, FALSE);
-        }
-
-        /* invincibility stars */
-        if(player->invincible) {
-            /* update timer & finish */
-            player->invincibility_timer += dt;
-            if(player->invincibility_timer >= PLAYER_INVINCIBILITY_TIME)
-                player_set_invincible(player, FALSE);
-        }
-
-        /* turbo speed */
-        if(player->turbo) {
-            /* update timer & finish */
-            player->turbo_timer += dt;
-            if(player->turbo_timer >= PLAYER_TURBO_TIME)
-                player_set_turbo(player, FALSE);
-        }
-
-        /* pitfalls */
-        if(position.y >= level_height_at(position.x))
-            player_kill(player);
-
-        /* winning pose */
-        if(level_has_been_cleared())
-            physicsactor_enable_winning_pose(pa);
-
-        /* rolling misc */
-        if(!player_is_midair(player))
-            player->thrown_while_rolling = FALSE;
-        else if(player_ysp(player) < 0.0f && player_is_rolling(player))
-            player->thrown_while_rolling = TRUE;
-
-        /* misc */
-        player->on_movable_platform = FALSE;
-
-        /* the focused player can't get off the boundaries of the camera
-           (when boundaries are enabled) */
-        if(player_has_focus(player)) {
-            v2d_t cam_topleft = camera_clip(v2d_new(0, 0));
-            v2d_t cam_bottomright = camera_clip(level_size());
-
-            /* lock horizontally */
-            if(position.x > cam_bottomright.x - padding + eps) {
-                player_set_speed(player, player_speed(player) * 0.5f);
-                player_set_xpos(player, cam_bottomright.x - padding);
-                position = player_position(player); /* update position */
-            }
-            else if(position.x < cam_topleft.x + padding - eps) {
-                player_set_speed(player, player_speed(player) * 0.5f);
-                player_set_xpos(player, cam_topleft.x + padding);
-                position = player_position(player);
-            }
-
-            /* lock on top; won't prevent pits */
-            if(!player_is_dying(player)) {
-                if(position.y < cam_topleft.y + padding - eps) {
-                    player_set_ysp(player, player_ysp(player) * 0.5f);
-                    player_set_ypos(player, cam_topleft.y + padding);
-                    position = player_position(player);
-                }
-            }
-        }
-
-        /* modes of gameplay */
-        switch(mode) {
-
-            /* cooperative play */
-            case PM_COOPERATIVE: {
-                /* am I hurt? Gotta have the focus */
-                if(player_is_getting_hit(player) || player_is_dying(player)) {
-                    if(!player_has_focus(player))
-                        player_focus(player);
-                }
-                break;
-            }
-
-            /* classic mode */
-            case PM_CLASSIC: {
-                /* make non-focused players invulnerable, immortal and secondary.
-                   we continuously update the flags (both on and off) because we
-                   take character switching into account. */
-                int has_focus = player_has_focus(player);
-                player_set_invulnerable(player, !has_focus);
-                player_set_immortal(player, !has_focus);
-                player_set_secondary(player, !has_focus);
-                break;
-            }
-
-        }
-    }
-#if 0
-    else {
-        /* if the player is frozen...? */
-    }
-#endif
+    /* update the rest */
+    update_logic(player);
+}
 
-    /* can't leave the world */
-    v2d_t position = player_position(player);
 
-    if(position.x < padding - eps) {
-        player_set_speed(player, player_speed(player) * 0.5f);
-        player_set_xpos(player, padding);
-        position = player_position(player); /* update position */
-    }
-    else if(position.x > level_size().x - padding + eps) {
-        player_set_speed(player, player_speed(player) * 0.5f);
-        player_set_xpos(player, level_size().x - padding);
-        position = player_position(player);
-    }
-
-    if(position.y < padding - eps) {
-        player_set_ysp(player, player_ysp(player) * 0.5f);
-        player_set_ypos(player, padding);
-        position = player_position(player);
+/*
+ * player_update_physics()
+ * Runs the physics simulation of the player, holding its events. This touches
+ * only the player and reads the (locked) obstacle map, so that different
+ * players may be updated in parallel. Call player_finish_update() afterwards
+ */
+void player_update_physics(player_t *player, const obstaclemap_t* obstaclemap)
+{
+    if(!player->disable_movement) {
+        physicsactor_hold_events(player->pa, true);
+        physics_adapter(player, obstaclemap);
+        physicsactor_hold_events(player->pa, false);
     }
+}
 
-    /* invincibility stars */
-    if(player->invincible)
-        animate_invincibility_stars(player);
-
-    /* shield */
-    if(player->shield_type != SH_NONE)
-        update_shield(player);
 
-    /* restart the level if dead */
-    if(player_is_dying(player))
-        run_dying_logic(player);
+/*
+ * player_finish_update()
+ * Notifies the events held by player_update_physics() and updates the rest
+ * of the player. This must be called on the main thread
+ */
+void player_finish_update(player_t *player)
+{
+    physicsactor_flush_events(player->pa);
+    update_logic(player);
 }
 
 
@@ -1724,6 +1569,198 @@ void physics_adapter(player_t *player, const obstaclemap_t* obstaclemap)
     act->angle = smooth_angle(pa, act->angle);
 }
 
+/* updates the player after running the physics simulation */
+void update_logic(player_t *player)
+{
+    actor_t *act = player->actor;
+    physicsactor_t *pa = player->pa;
+    float padding = 16.0f, eps = 1e-5;
+    float dt = timer_get_delta();
+
+    /* if the player movement is enabled... */
+    if(!player->disable_movement) {
+
+        /* read new position */
+        v2d_t position = player_position(player);
+
+        /* enter / leave water */
+        /* FIXME scripting flag */
+        if(position.y >= level_waterlevel()) {
+            if(!player->underwater)
+                player_enter_water(player);
+        }
+        else {
+            if(player->underwater)
+                player_leave_water(player);
+        }
+
+        /* underwater logic */
+        if(player->underwater) {
+            /* disable turbo */
+            player_set_turbo(player, FALSE);
+
+            /* disable some shields */
+            if(player->shield_type == SH_FIRESHIELD || player->shield_type == SH_THUNDERSHIELD) {
+                if(!player_is_invincible(player))
+                    player_hit(player, 0.0f);
+                else
+                    player->shield_type = SH_NONE;
+            }
+
+            /* timer countdown */
+            if(player->shield_type != SH_WATERSHIELD && !player_is_winning(player) && (
+                position.y < level_waterlevel() || /* forced underwater via scripting OR... */
+                is_head_underwater(player)         /* the head of the player is underwater */
+            ))
+                player->underwater_timer += dt;
+            else
+                player->underwater_timer = 0.0f;
+
+            /* drowning */
+            if(player_seconds_remaining_to_drown(player) <= 0.0f)
+                player_drown(player);
+        }
+
+        /* the player is blinking */
+        if(player->blinking) {
+            player->blink_timer += dt;
+
+            if(player->blink_timer >= player->blink_visibility_timer + 0.06f) {
+                player->blink_visibility_timer = player->blink_timer;
+                act->visible = !act->visible;
+            }
+
+            if(player->blink_timer >= PLAYER_MAX_BLINK)
+                player_set_blinking(player, FALSE);
+        }
+
+        /* invincibility stars */
+        if(player->invincible) {
+            /* update timer & finish */
+            player->invincibility_timer += dt;
+            if(player->invincibility_timer >= PLAYER_INVINCIBILITY_TIME)
+                player_set_invincible(player, FALSE);
+        }
+
+        /* turbo speed */
+        if(player->turbo) {
+            /* update timer & finish */
+            player->turbo_timer += dt;
+            if(player->turbo_timer >= PLAYER_TURBO_TIME)
+                player_set_turbo(player, FALSE);
+        }
+
+        /* pitfalls */
+        if(position.y >= level_height_at(position.x))
+            player_kill(player);
+
+        /* winning pose */
+        if(level_has_been_cleared())
+            physicsactor_enable_winning_pose(pa);
+
+        /* rolling misc */
+        if(!player_is_midair(player))
+            player->thrown_while_rolling = FALSE;
+        else if(player_ysp(player) < 0.0f && player_is_rolling(player))
+            player->thrown_while_rolling = TRUE;
+
+        /* misc */
+        player->on_movable_platform = FALSE;
+
+        /* the focused player can't get off the boundaries of the camera
+           (when boundaries are enabled) */
+        if(player_has_focus(player)) {
+            v2d_t cam_topleft = camera_clip(v2d_new(0, 0));
+            v2d_t cam_bottomright = camera_clip(level_size());
+
+            /* lock horizontally */
+            if(position.x > cam_bottomright.x - padding + eps) {
+                player_set_speed(player, player_speed(player) * 0.5f);
+                player_set_xpos(player, cam_bottomright.x - padding);
+                position = player_position(player); /* update position */
+            }
+            else if(position.x < cam_topleft.x + padding - eps) {
+                player_set_speed(player, player_speed(player) * 0.5f);
+                player_set_xpos(player, cam_topleft.x + padding);
+                position = player_position(player);
+            }
+
+            /* lock on top; won't prevent pits */
+            if(!player_is_dying(player)) {
+                if(position.y < cam_topleft.y + padding - eps) {
+                    player_set_ysp(player, player_ysp(player) * 0.5f);
+                    player_set_ypos(player, cam_topleft.y + padding);
+                    position = player_position(player);
+                }
+            }
+        }
+
+        /* modes of gameplay */
+        switch(mode) {
+
+            /* cooperative play */
+            case PM_COOPERATIVE: {
+                /* am I hurt? Gotta have the focus */
+                if(player_is_getting_hit(player) || player_is_dying(player)) {
+                    if(!player_has_focus(player))
+                        player_focus(player);
+                }
+                break;
+            }
+
+            /* classic mode */
+            case PM_CLASSIC: {
+                /* make non-focused players invulnerable, immortal and secondary.
+                   we continuously update the flags (both on and off) because we
+                   take character switching into account. */
+                int has_focus = player_has_focus(player);
+                player_set_invulnerable(player, !has_focus);
+                player_set_immortal(player, !has_focus);
+                player_set_secondary(player, !has_focus);
+                break;
+            }
+
+        }
+    }
+#if 0
+    else {
+        /* if the player is frozen...? */
+    }
+#endif
+
+    /* can't leave the world */
+    v2d_t position = player_position(player);
+
+    if(position.x < padding - eps) {
+        player_set_speed(player, player_speed(player) * 0.5f);
+        player_set_xpos(player, padding);
+        position = player_position(player); /* update position */
+    }
+    else if(position.x > level_size().x - padding + eps) {
+        player_set_speed(player, player_speed(player) * 0.5f);
+        player_set_xpos(player, level_size().x - padding);
+        position = player_position(player);
+    }
+
+    if(position.y < padding - eps) {
+        player_set_ysp(player, player_ysp(player) * 0.5f);
+        player_set_ypos(player, padding);
+        position = player_position(player);
+    }
+
+    /* invincibility stars */
+    if(player->invincible)
+        animate_invincibility_stars(player);
+
+    /* shield */
+    if(player->shield_type != SH_NONE)
+        update_shield(player);
+
+    /* restart the level if dead */
+    if(player_is_dying(player))
+        run_dying_logic(player);
+}
+
 /* angle interpolation */
 float smooth_angle(const physicsactor_t* pa, float current_angle)
 {
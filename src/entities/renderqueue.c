@@ -376,6 +376,7 @@ static const char fs_glsl_with_alpha_testing[] = ""
 #define REPORT_BEGIN()            do { if(want_report) REPORT_CLEAR(); } while(0)
 #define REPORT_END()              (void)0
 static bool want_report = false;
+static unsigned uniform_upload_count = 0; /* uniform uploads as of the last frame */
 
 /* utilities */
 #define ZINDEX_OFFSET(n)          (0.000001f * (float)(n)) /* ZINDEX_OFFSET(1) is the mininum zindex offset */
@@ -387,6 +388,8 @@ static int cmp_fun(const void* i, const void* j);
 static int cmp_zbuf_fun(const void* i, const void* j);
 static inline float brick_zindex_offset(const brick_t *brick);
 static void enqueue(const renderqueue_entry_t* entry);
+static void enqueue_described(const renderqueue_entry_t* entry, float zindex, texturehandle_t texture, bool is_translucent);
+static renderqueue_entry_t* push(const renderqueue_entry_t* entry);
 static const char* random_path(char prefix);
 
 /* internal data */
@@ -564,7 +567,7 @@ void renderqueue_end()
     REPORT("Depth test: % 3s", use_depth_buffer ? "yes" : "no");
 
     /* clear the screen */
-    al_clear_to_color(al_map_rgb_f(0.0f, 0.0f, 0.0f));
+    image_clear(color_rgb(0, 0, 0));
 
     /* use the shader of the render queue */
     if(internal_shader != NULL)
@@ -581,6 +584,7 @@ void renderqueue_end()
     if(use_depth_buffer) {
 
         /* enable the depth test */
+        image_flush_batch();
         al_set_render_state(ALLEGRO_DEPTH_FUNCTION, ALLEGRO_RENDER_LESS_EQUAL);
         al_set_render_state(ALLEGRO_WRITE_MASK, ALLEGRO_MASK_DEPTH | ALLEGRO_MASK_RGBA); /* write to the framebuffer and to the depth buffer */
         al_set_render_state(ALLEGRO_DEPTH_TEST, 1);
@@ -652,8 +656,10 @@ void renderqueue_end()
             /* we've rendered all opaque objects. Now we're going to render
                the translucent ones. Let's disable depth writes and render
                back-to-front. */
-            if(j == translucent_start)
+            if(j == translucent_start) {
+                image_flush_batch();
                 al_set_render_state(ALLEGRO_WRITE_MASK, ALLEGRO_MASK_RGBA);
+            }
 
             /* set z to a value in [0,1] according to the z-order of the entry */
             float z = 1.0f - (float)sorted_buffer[j]->zorder / (float)(buffer_size - 1);
@@ -685,6 +691,7 @@ void renderqueue_end()
         al_use_transform(&ztransform);
 
         /* disable the depth test */
+        image_flush_batch();
         al_set_render_state(ALLEGRO_DEPTH_TEST, 0);
 
     }
@@ -706,7 +713,9 @@ void renderqueue_end()
     float savings = 1.0f - (float)batch_count / (float)buffer_size;
     REPORT("Total     :=%3d", buffer_size);
     REPORT("Batches   : %3d %.2f", batch_count, 100.0f * savings);
+    REPORT("Uniforms  : %3u", shader_uniform_upload_count() - uniform_upload_count); /* uploads per frame */
     REPORT_END();
+    uniform_upload_count = shader_uniform_upload_count();
 
     /* go back to the default shader */
     if(internal_shader != NULL)
@@ -872,6 +881,15 @@ void renderqueue_enqueue_ssobject(surgescript_object_t* object)
     if(!surgescript_object_has_tag(object, "renderable"))
         return;
 
+    /* built-in renderables describe themselves without calling the VM */
+    renderabledesc_t desc;
+    if(scripting_util_describe_renderable(object, &desc)) {
+        if(desc.visible)
+            enqueue_described(&entry, desc.zindex, desc.has_texture ? desc.texture : NO_TEXTURE, desc.is_translucent);
+
+        return;
+    }
+
     /* don't enqueue invisible renderables */
     if(surgescript_object_has_function(object, "get_visible")) {
         surgescript_var_t* ret = surgescript_var_create();
@@ -929,6 +947,13 @@ void renderqueue_enqueue_ssobject_gizmo(surgescript_object_t* object)
     if(!surgescript_object_has_tag(object, "gizmo"))
         return;
 
+    /* built-in gizmos describe themselves without calling the VM */
+    renderabledesc_t desc;
+    if(scripting_util_describe_renderable(object, &desc)) {
+        enqueue_described(&entry, ZINDEX_LARGE + desc.zindex, NO_TEXTURE, false); /* see zindex_ssobject_gizmo() */
+        return;
+    }
+
     /* enqueue */
     enqueue(&entry);
 }
@@ -1022,6 +1047,31 @@ bool renderqueue_toggle_stats_report()
 
 /* enqueues an entry */
 void enqueue(const renderqueue_entry_t* entry)
+{
+    renderqueue_entry_t* e = push(entry);
+
+    /* cache the values of the new entry for purposes of comparison to other entries */
+    e->cached.zindex = e->vtable->zindex(e->renderable);
+    e->cached.type = e->vtable->type(e->renderable);
+    e->cached.ypos = e->vtable->ypos(e->renderable);
+    e->cached.texture = e->vtable->texture(e->renderable);
+    e->cached.is_translucent = e->vtable->is_translucent(e->renderable);
+}
+
+/* enqueue an entry whose zindex, texture and translucency are known in advance */
+void enqueue_described(const renderqueue_entry_t* entry, float zindex, texturehandle_t texture, bool is_translucent)
+{
+    renderqueue_entry_t* e = push(entry);
+
+    e->cached.zindex = zindex;
+    e->cached.type = e->vtable->type(e->renderable);
+    e->cached.ypos = e->vtable->ypos(e->renderable);
+    e->cached.texture = texture;
+    e->cached.is_translucent = is_translucent;
+}
+
+/* add an entry to the buffer, returning the stored entry */
+renderqueue_entry_t* push(const renderqueue_entry_t* entry)
 {
     /* grow the buffer if necessary */
     if(buffer_size == buffer_capacity) {
@@ -1042,12 +1092,7 @@ void enqueue(const renderqueue_entry_t* entry)
     sorted_indices[buffer_size] = buffer_size;
     buffer_size++;
 
-    /* cache the values of the new entry for purposes of comparison to other entries */
-    e->cached.zindex = e->vtable->zindex(e->renderable);
-    e->cached.type = e->vtable->type(e->renderable);
-    e->cached.ypos = e->vtable->ypos(e->renderable);
-    e->cached.texture = e->vtable->texture(e->renderable);
-    e->cached.is_translucent = e->vtable->is_translucent(e->renderable);
+    return e;
 }
 
 /* compares two entries of the render queue */
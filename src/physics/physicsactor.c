@@ -30,6 +30,7 @@
 #include "../core/timer.h"
 #include "../util/numeric.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 
 typedef struct physicsactorobserverlist_t physicsactorobserverlist_t;
 
@@ -99,6 +100,8 @@ struct physicsactor_t
     obstaclelayer_t layer; /* current layer */
     input_t* input; /* input device */
     physicsactorobserverlist_t* observers; /* observers */
+    bool holding_events; /* queue the events instead of notifying the observers? */
+    DARRAY(physicsactorevent_t, held_events); /* events waiting for physicsactor_flush_events() */
 
     sensor_t* A_normal; /* sensors */
     sensor_t* B_normal;
@@ -327,6 +330,8 @@ physicsactor_t* physicsactor_create(v2d_t position)
 
     pa->input = input_create_computer();
     pa->observers = NULL;
+    pa->holding_events = false;
+    darray_init(pa->held_events);
 
     pa->midair = true;
     pa->was_midair = true;
@@ -413,6 +418,7 @@ physicsactor_t* physicsactor_destroy(physicsactor_t *pa)
     sensor_destroy(pa->M_rollflatgnd);
     sensor_destroy(pa->N_rollflatgnd);
 
+    darray_release(pa->held_events);
     destroy_observers(pa->observers);
     input_destroy(pa->input);
     free(pa);
@@ -563,6 +569,28 @@ void physicsactor_subscribe(physicsactor_t* pa, void (*callback)(physicsactor_t*
     );
 }
 
+void physicsactor_hold_events(physicsactor_t* pa, bool hold)
+{
+    /* while the events are held, physicsactor_update() touches only the
+       physics actor, so that different actors may be updated in parallel */
+    pa->holding_events = hold;
+}
+
+void physicsactor_flush_events(physicsactor_t* pa)
+{
+    /* notify the observers of the held events, in the order they happened */
+    for(int i = 0; i < darray_length(pa->held_events); i++) {
+        physicsactorobserverlist_t* observer = pa->observers;
+
+        while(observer != NULL) {
+            observer->callback(pa, pa->held_events[i], observer->context);
+            observer = observer->next;
+        }
+    }
+
+    darray_clear(pa->held_events);
+}
+
 physicsactorstate_t physicsactor_get_state(const physicsactor_t *pa)
 {
     return pa->state;
@@ -2459,6 +2487,12 @@ void notify_observers(physicsactor_t* pa, physicsactorevent_t event)
 {
     physicsactorobserverlist_t* observer = pa->observers;
 
+    /* the events are held; notify later */
+    if(pa->holding_events) {
+        darray_push(pa->held_events, event);
+        return;
+    }
+
     while(observer != NULL) {
         observer->callback(pa, event, observer->context);
         observer = observer->next;
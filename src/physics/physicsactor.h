@@ -106,6 +106,8 @@ void physicsactor_render_sensors(const physicsactor_t *pa, v2d_t camera_position
 void physicsactor_capture_input(physicsactor_t *pa, const struct input_t *in); /* call before physicsactor_update() */
 void physicsactor_reset_model_parameters(physicsactor_t* pa);
 void physicsactor_subscribe(physicsactor_t* pa, void (*callback)(physicsactor_t*,physicsactorevent_t,void*), void* context);
+void physicsactor_hold_events(physicsactor_t* pa, bool hold); /* if held, the events are queued instead of being notified to the observers */
+void physicsactor_flush_events(physicsactor_t* pa); /* notify the observers of the held events */
 
 bool physicsactor_is_facing_right(const physicsactor_t *pa);
 bool physicsactor_is_touching_ceiling(const physicsactor_t *pa);
@@ -49,6 +49,9 @@
 #include "../core/nanoparser.h"
 #include "../core/font.h"
 #include "../core/prefs.h"
+#include "../core/prefetch.h"
+#include "../core/jobs.h"
+#include "../core/quest.h"
 #include "../util/darray.h"
 #include "../util/numeric.h"
 #include "../util/rect.h"
@@ -99,6 +102,39 @@ static void update_dialogregions();
 
 
 
+/* ------------------------
+ * Legacy items
+ *
+ * The update of the legacy
+ * items has two phases. The
+ * items that touch the
+ * players, the bricks or
+ * each other are updated
+ * serially. Self-contained
+ * items compute their next
+ * state in parallel, which
+ * is then committed on the
+ * main thread
+ * ------------------------ */
+/* constants */
+#define SELFCONTAINED_MIN_BATCH 32 /* smaller batches are prepared on the main thread */
+#define SELFCONTAINED_CHUNK_SIZE 8 /* number of items picked by a thread at a time */
+
+/* internal data */
+typedef struct selfcontaineditem_t selfcontaineditem_t;
+struct selfcontaineditem_t {
+    item_t* item;
+    itemstep_t step; /* computed in the parallel phase */
+};
+STATIC_DARRAY(selfcontaineditem_t, self_contained_items); /* the batch of the current frame */
+
+/* internal methods */
+static void update_self_contained_items();
+static void prepare_self_contained_items(int first, int last, void* data); /* thread-safe */
+static void verify_self_contained_items();
+
+
+
 /* ------------------------
  * Setup objects
  * ------------------------ */
@@ -144,6 +180,10 @@ static v2d_t spawn_point;
 static player_t *team[TEAM_MAX]; /* players */
 static int team_size; /* size of team[] */
 static player_t *player; /* reference to the current player */
+static player_t *updating_player[TEAM_MAX]; /* players being updated in this frame */
+static void update_players(bool got_dying_player);
+static bool must_update_player(const player_t* p, bool got_dying_player);
+static void update_physics_of_players(int first, int last, void* data); /* thread-safe */
 
 /* level state */
 typedef struct levelstate_t levelstate_t;
@@ -167,6 +207,10 @@ static const int ROI_MARGIN_RENDER_ENTITY = ROI_MARGIN_UPDATE_ENTITY; /* use the
 static const int ROI_MARGIN_RENDER_BRICK = 128;
 static const int ROI_MARGIN_EDITOR = 128;
 
+/* brick streaming: static bricks of large levels are created on demand */
+static const int STREAMING_MIN_BRICKS = 10000; /* levels with at least this many bricks are streamed */
+static int brick_count_hint; /* number of bricks of the level, counted when reading the header */
+
 /* internal data */
 static float level_timer;
 static music_t *music;
@@ -203,6 +247,8 @@ static void level_unload();
 static int level_save(const char *filepath);
 static bool level_interpret_header_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void *data);
 static bool level_interpret_body_line(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char** param, void *data);
+static bool level_interpret_brick(const char *filepath, int fileline, const levparser_brick_t *brick, void *data);
+static bool level_interpret_entity(const char *filepath, int fileline, const levparser_entity_t *entity, void *data);
 static bool level_save_ssobject(surgescript_object_t* object, void* param);
 
 /* internal methods */
@@ -488,6 +534,7 @@ void level_load(const char *filepath)
     requires[1] = GAME_VERSION_SUB;
     requires[2] = GAME_VERSION_WIP;
     readonly = FALSE;
+    brick_count_hint = 0;
 
     /* clear pointers */
     backgroundtheme = NULL;
@@ -498,6 +545,11 @@ void level_load(const char *filepath)
     for(int i = 0; i < TEAM_MAX; i++)
         team[i] = NULL;
 
+    /* decode the assets used by this level in the background (if we
+       haven't started already) and record which assets it touches */
+    prefetch_start(filepath);
+    prefetch_start_recording(filepath);
+
     /* initialize the water effect */
     waterfx_init();
 
@@ -505,10 +557,15 @@ void level_load(const char *filepath)
     surgescript_object_t* level_manager = scripting_util_surgeengine_component(surgescript_vm(), "LevelManager");
     surgescript_object_call_function(level_manager, "onLevelLoad", NULL, 0, NULL);
 
-    /* read the header of the level file */
-    if(!levparser_parse(filepath, NULL, level_interpret_header_line))
+    /* compile the level file (or read it from the cache) */
+    compiledlevel_t* compiled_level = levparser_compile(filepath);
+    if(compiled_level == NULL)
         fatal_error("Can\'t open level file \"%s\".", filepath);
 
+    /* read the header of the level file */
+    levparser_replay(compiled_level, NULL, level_interpret_header_line, NULL, NULL);
+    brick_count_hint += levparser_brick_count(compiled_level);
+
     /* load the music */
     music_stop(); /* stop any music that's playing */
     music = *musicfile ? music_load(musicfile) : NULL;
@@ -528,7 +585,10 @@ void level_load(const char *filepath)
 
     /* read the body of the level file;
        load bricks & entities */
-    levparser_parse(filepath, NULL, level_interpret_body_line);
+    if(brick_count_hint >= STREAMING_MIN_BRICKS)
+        logfile_message("Streaming %d bricks...", brick_count_hint);
+    levparser_replay(compiled_level, NULL, level_interpret_body_line, level_interpret_brick, level_interpret_entity);
+    compiled_level = levparser_destroy_compiled(compiled_level);
 
     /* recompute the level size */
     update_level_size();
@@ -536,6 +596,10 @@ void level_load(const char *filepath)
     /* spawn setup objects */
     spawn_setup_objects();
 
+    /* write the prefetch manifest & discard unused assets */
+    prefetch_stop_recording();
+    prefetch_cancel();
+
     /* success! */
     logfile_message("The level has been loaded.");
 }
@@ -991,6 +1055,9 @@ bool level_interpret_header_line(const char* filepath, int fileline, levparser_c
     }
 
     case LEVCOMMAND_BRICK:
+        /* well-formed bricks are packed and counted by the level parser */
+        break;
+
     case LEVCOMMAND_ENTITY:
     case LEVCOMMAND_LEGACYOBJECT:
     case LEVCOMMAND_LEGACYITEM:
@@ -1007,64 +1074,64 @@ bool level_interpret_header_line(const char* filepath, int fileline, levparser_c
 }
 
 /*
- * level_interpret_body_line()
- * Interprets a line of the body of the .lev file
+ * level_interpret_brick()
+ * Creates a brick of the body of the .lev file
  */
-bool level_interpret_body_line(const char* filepath, int fileline, levparser_command_t command, const char* command_name, int param_count, const char** param, void* data)
+bool level_interpret_brick(const char* filepath, int fileline, const levparser_brick_t* brick, void* data)
 {
-    switch(command) {
-    case LEVCOMMAND_BRICK: {
-        if(param_count >= 3 && param_count <= 5) {
-            if(*theme != '\0') {
-                bricklayer_t layer = BRL_DEFAULT;
-                brickflip_t flip = BRF_NOFLIP;
-                int id = atoi(param[0]);
-                int x = atoi(param[1]);
-                int y = atoi(param[2]);
-
-                for(int j = 3; j < param_count; j++) {
-                    if(layer == BRL_DEFAULT && brick_util_layercode(param[j]) != BRL_DEFAULT)
-                        layer = brick_util_layercode(param[j]);
-                    else if(flip == BRF_NOFLIP && brick_util_flipcode(param[j]) != BRF_NOFLIP)
-                        flip = brick_util_flipcode(param[j]);
-                }
-
-                if(brick_exists(id))
-                    level_create_brick(id, v2d_new(x,y), layer, flip);
-                else
-                    logfile_message("Level loader - invalid brick: %d", id);
-            }
-            else
-                logfile_message("Level loader - warning: cannot create a new brick if the theme is not defined");
-        }
+    if(*theme != '\0') {
+        if(!brick_exists(brick->id))
+            logfile_message("Level loader - invalid brick: %d", brick->id);
+        else if(brick_count_hint >= STREAMING_MIN_BRICKS)
+            brickmanager_add_streamed_brick(brick_manager, brick->id, v2d_new(brick->x, brick->y), (bricklayer_t)brick->layer, (brickflip_t)brick->flip);
         else
-            logfile_message("Level loader - command '%s' expects three, four or five parameters: id, xpos, ypos [, layer_name [, flip_flags]]", command_name);
-
-        break;
+            level_create_brick(brick->id, v2d_new(brick->x, brick->y), (bricklayer_t)brick->layer, (brickflip_t)brick->flip);
     }
+    else
+        logfile_message("Level loader - warning: cannot create a new brick if the theme is not defined");
 
-    case LEVCOMMAND_ENTITY: {
-        if(param_count == 3 || param_count == 4) {
-            const char* name = param[0];
-            int x = atoi(param[1]);
-            int y = atoi(param[2]);
-            if(!is_setup_object(name)) {
-                surgescript_object_t* obj = level_create_object(name, v2d_new(x, y));
-                if(obj != NULL) {
-                    if(!surgescript_object_has_tag(obj, "entity"))
-                        fatal_error("Level loader - can't spawn \"%s\": object is not an entity", name);
-                    else if(param_count > 3 && entity_info_exists(obj))
-                        entity_info_set_id(obj, str_to_x64(param[3]));
-                }
-                else
-                    logfile_message("Level loader - can't spawn \"%s\": entity doesn't exist", name);
-            }
+    /* continue reading */
+    return true;
+}
+
+/*
+ * level_interpret_entity()
+ * Spawns an entity of the body of the .lev file
+ */
+bool level_interpret_entity(const char* filepath, int fileline, const levparser_entity_t* entity, void* data)
+{
+    if(!is_setup_object(entity->name)) {
+        surgescript_object_t* obj = level_create_object(entity->name, v2d_new(entity->x, entity->y));
+        if(obj != NULL) {
+            if(!surgescript_object_has_tag(obj, "entity"))
+                fatal_error("Level loader - can't spawn \"%s\": object is not an entity", entity->name);
+            else if(entity->has_id && entity_info_exists(obj))
+                entity_info_set_id(obj, entity->id);
         }
         else
-            logfile_message("Level loader - command '%s' expects three or four parameters: name, xpos, ypos [, id]", command_name);
+            logfile_message("Level loader - can't spawn \"%s\": entity doesn't exist", entity->name);
+    }
+
+    /* continue reading */
+    return true;
+}
 
+/*
+ * level_interpret_body_line()
+ * Interprets a line of the body of the .lev file
+ */
+bool level_interpret_body_line(const char* filepath, int fileline, levparser_command_t command, const char* command_name, int param_count, const char** param, void* data)
+{
+    switch(command) {
+    case LEVCOMMAND_BRICK:
+        /* well-formed bricks are given to level_interpret_brick() */
+        logfile_message("Level loader - command '%s' expects three, four or five parameters: id, xpos, ypos [, layer_name [, flip_flags]]", command_name);
+        break;
+
+    case LEVCOMMAND_ENTITY:
+        /* well-formed entities are given to level_interpret_entity() */
+        logfile_message("Level loader - command '%s' expects three or four parameters: name, xpos, ypos [, id]", command_name);
         break;
-    }
 
     case LEVCOMMAND_LEGACYOBJECT: {
         if(param_count == 3) {
@@ -1207,6 +1274,7 @@ void level_init(void *path_to_lev_file)
     camera_init();
     entitymanager_init();
     create_obstaclemap();
+    darray_init(self_contained_items);
 
     /* load level file */
     level_load(filepath);
@@ -1269,6 +1337,7 @@ void level_release()
     cached_level_ssobject = NULL;
     cached_entity_manager = NULL;
 
+    darray_release(self_contained_items);
     destroy_obstaclemap();
     entitymanager_release();
     camera_release();
@@ -1469,8 +1538,13 @@ void level_update()
         int always_active = inode->data->always_active;
 
         if(inside_playarea || always_active) {
-            /* update this item */
-            item_update(inode->data, team, team_size, major_bricks, major_items, major_enemies);
+            /* update this item. Self-contained items are updated later, in two phases */
+            if(item_is_self_contained(inode->data)) {
+                selfcontaineditem_t entry = { .item = inode->data };
+                darray_push(self_contained_items, entry);
+            }
+            else
+                item_update(inode->data, team, team_size, major_bricks, major_items, major_enemies);
         }
         else if(!inside_playarea) {
             /* this item is outside the screen... (and it's not always active) */
@@ -1481,6 +1555,9 @@ void level_update()
         }
     }
 
+    /* update the self-contained legacy items */
+    update_self_contained_items();
+
     /* update legacy objects */
     for(enode = major_enemies; enode != NULL; enode = enode->next) {
         float x = enode->data->actor->position.x;
@@ -1504,14 +1581,14 @@ void level_update()
     }
 
     /* update bricks */
-    iterator_t* brick_iterator = brickmanager_retrieve_active_moving_bricks(brick_manager);
-    while(iterator_has_next(brick_iterator)) {
+    brickquery_t brick_query;
+    brick_t* brick;
+    brickmanager_query_active_moving_bricks(brick_manager, &brick_query);
+    while((brick = brickmanager_query_next(&brick_query)) != NULL) {
         /* no need to update static bricks.
            We won't even retrieve them! */
-        brick_t* brick = iterator_next(brick_iterator);
         brick_update(brick, team, team_size);
     }
-    iterator_destroy(brick_iterator);
 
     /* update obstacle map */
     update_obstaclemap(major_items, major_enemies);
@@ -1526,22 +1603,8 @@ void level_update()
     update_ssobjects();
 
     /* update players */
-    if(brickmanager_number_of_bricks(brick_manager) > 0) {
-        for(i = 0; i < team_size; i++) {
-            const image_t* image = actor_image(team[i]->actor);
-            v2d_t position = player_position(team[i]);
-            float x = position.x;
-            float y = position.y;
-            float w = image_width(image);
-            float h = image_height(image);
-
-            /* updating... */
-            if(inside_screen(x, y, w, h, DEFAULT_MARGIN/4) || player_is_dying(team[i]) || y < 0) {
-                if(!got_dying_player || player_is_dying(team[i]) || player_is_getting_hit(team[i]))
-                    player_update(team[i], obstaclemap);
-            }
-        }
-    }
+    if(brickmanager_number_of_bricks(brick_manager) > 0)
+        update_players(got_dying_player);
 
     /* some objects are attached to the player... */
     for(enode = major_enemies; enode != NULL; enode = enode->next) {
@@ -1732,6 +1795,9 @@ void level_change(const char* path_to_lev_file)
     str_cpy(file, path_to_lev_file, sizeof(file));
     must_load_another_level = TRUE;
     logfile_message("Changing level to '%s'...", path_to_lev_file);
+
+    /* start loading the next level in the background */
+    prefetch_start(path_to_lev_file);
 }
 
 
@@ -2050,6 +2116,12 @@ void level_clear(actor_t *end_sign)
     else
         level_set_camera_focus(player->actor);
 
+    /* start loading the next level of the quest while
+       the level cleared animation is being played */
+    const quest_t* quest = quest_current();
+    if(quest != NULL && quest_entry_is_level(quest, quest_next_level()))
+        prefetch_start(quest_entry_path(quest, quest_next_level()));
+
     /* success! */
     level_hide_dialogbox();
     level_cleared = TRUE;
@@ -2435,33 +2507,33 @@ void update_music()
 /* renders the bricks */
 void render_bricks()
 {
-    iterator_t* it = brickmanager_retrieve_active_bricks(brick_manager);
-    while(iterator_has_next(it)) {
-        brick_t* brick = iterator_next(it);
+    brickquery_t query;
+    brick_t* brick;
 
+    brickmanager_query_active_bricks(brick_manager, &query);
+    while((brick = brickmanager_query_next(&query)) != NULL) {
         renderqueue_enqueue_brick(brick);
 
         if(must_render_brick_masks)
             renderqueue_enqueue_brick_mask(brick);
     }
-    iterator_destroy(it);
 }
 
 
 /* renders the bricks (level editor) */
 void render_bricks_debug()
 {
-    iterator_t* it = brickmanager_retrieve_active_bricks(brick_manager);
-    while(iterator_has_next(it)) {
-        brick_t* brick = iterator_next(it);
+    brickquery_t query;
+    brick_t* brick;
 
+    brickmanager_query_active_bricks(brick_manager, &query);
+    while((brick = brickmanager_query_next(&query)) != NULL) {
         renderqueue_enqueue_brick_debug(brick);
         renderqueue_enqueue_brick_path(brick);
 
         if(must_render_brick_masks)
             renderqueue_enqueue_brick_mask(brick);
     }
-    iterator_destroy(it);
 }
 
 
@@ -2610,6 +2682,117 @@ void update_dialogregions()
 
 
 
+/* legacy items */
+
+/* updates the batch of self-contained legacy items collected in the serial phase.
+   Their next state is prepared in parallel and committed in list order */
+void update_self_contained_items()
+{
+    int count = darray_length(self_contained_items);
+
+    /* parallel phase. Small batches aren't worth spawning work for */
+    if(count < SELFCONTAINED_MIN_BATCH)
+        prepare_self_contained_items(0, count, NULL);
+    else
+        jobs_parallel_for(count, SELFCONTAINED_CHUNK_SIZE, prepare_self_contained_items, NULL);
+
+    /* replay test */
+    if(jobs_is_verifying())
+        verify_self_contained_items();
+
+    /* serial phase */
+    for(int i = 0; i < count; i++)
+        item_commit_step(self_contained_items[i].item, &(self_contained_items[i].step));
+
+    darray_clear(self_contained_items);
+}
+
+/* prepares the steps of the self-contained items in the [first, last) range of the batch */
+void prepare_self_contained_items(int first, int last, void* data)
+{
+    (void)data;
+
+    for(int i = first; i < last; i++)
+        item_prepare_step(self_contained_items[i].item, &(self_contained_items[i].step));
+}
+
+/* replays the parallel phase serially and checks that the steps are bit-identical */
+void verify_self_contained_items()
+{
+    for(int i = 0; i < darray_length(self_contained_items); i++) {
+        const selfcontaineditem_t* entry = &(self_contained_items[i]);
+        itemstep_t step;
+
+        item_prepare_step(entry->item, &step);
+        if(0 != memcmp(&step, &(entry->step), sizeof(step)))
+            fatal_error("The parallel update of legacy item %d (type %d) doesn't match its serial replay", i, entry->item->type);
+    }
+}
+
+
+
+
+
+/* players */
+
+/* updates the players near the camera, as well as the dying ones */
+void update_players(bool got_dying_player)
+{
+    int count = 0;
+
+    /* a single player is updated as usual */
+    if(team_size == 1 || jobs_thread_count() == 1) {
+        for(int i = 0; i < team_size; i++) {
+            if(must_update_player(team[i], got_dying_player))
+                player_update(team[i], obstaclemap);
+        }
+
+        return;
+    }
+
+    /* select the players that will be updated */
+    for(int i = 0; i < team_size; i++) {
+        if(must_update_player(team[i], got_dying_player))
+            updating_player[count++] = team[i];
+    }
+
+    /* run the physics simulation in parallel. The obstacle map is locked */
+    jobs_parallel_for(count, 1, update_physics_of_players, NULL);
+
+    /* notify the events of the physics and update the rest, in order */
+    for(int i = 0; i < count; i++)
+        player_finish_update(updating_player[i]);
+}
+
+/* should we update the given player in this frame? */
+bool must_update_player(const player_t* p, bool got_dying_player)
+{
+    const image_t* image = actor_image(p->actor);
+    v2d_t position = player_position(p);
+    float x = position.x;
+    float y = position.y;
+    float w = image_width(image);
+    float h = image_height(image);
+
+    if(inside_screen(x, y, w, h, DEFAULT_MARGIN/4) || player_is_dying(p) || y < 0)
+        return !got_dying_player || player_is_dying(p) || player_is_getting_hit(p);
+
+    return false;
+}
+
+/* runs the physics simulation of the selected players in the [first, last) range */
+void update_physics_of_players(int first, int last, void* data)
+{
+    (void)data;
+
+    for(int i = first; i < last; i++)
+        player_update_physics(updating_player[i], obstaclemap);
+}
+
+
+
+
+
 /* setup objects */
 
 /* empty list? */
@@ -2757,15 +2940,11 @@ void update_obstaclemap(const item_list_t* item_list, const object_list_t* objec
     clear_obstaclemap();
 
     /* add bricks */
-    iterator_t* brick_iterator = brickmanager_retrieve_active_bricks(brick_manager);
-    while(iterator_has_next(brick_iterator)) {
-        const brick_t* brick = iterator_next(brick_iterator);
-        const obstacle_t* obstacle = brick_obstacle(brick);
-
-        if(obstacle != NULL)
-            obstaclemap_add(obstaclemap, obstacle);
-    }
-    iterator_destroy(brick_iterator);
+    brickquery_t brick_query;
+    const obstacle_t* obstacle;
+    brickmanager_query_active_bricks(brick_manager, &brick_query);
+    while((obstacle = brickmanager_query_next_obstacle(&brick_query)) != NULL)
+        obstaclemap_add(obstaclemap, obstacle);
 
     /* add brick-like objects */
     iterator_t* bricklike_iterator = entitymanager_bricklike_iterator(entitymanager_ssobject());
@@ -3545,8 +3724,7 @@ void editor_update()
 
                 iterator_t* it = entitymanager_activeentities_iterator(entity_manager);
                 while(iterator_has_next(it)) {
-                    surgescript_var_t** var = iterator_next(it);
-                    surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(*var);
+                    surgescript_objecthandle_t entity_handle = *((surgescript_objecthandle_t*)iterator_next(it));
 
                     if(surgescript_objectmanager_exists(manager, entity_handle)) {
                         surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
@@ -3698,6 +3876,12 @@ void editor_enable()
     editor_previous_videomode = video_get_mode();
     video_set_mode(VIDEOMODE_FILL);
 
+    /* the editor needs access to all bricks */
+    if(brickmanager_is_streaming(brick_manager)) {
+        logfile_message("Creating all streamed bricks...");
+        brickmanager_stop_streaming(brick_manager);
+    }
+
     /* activating the editor */
     editor_action_init();
     editor_enabled = true;
@@ -4552,8 +4736,7 @@ void editor_tooltip_update()
         /* locate a target (onmouseover) */
         iterator_t* it = entitymanager_activeentities_iterator(entity_manager);
         while(iterator_has_next(it)) {
-            surgescript_var_t** var = iterator_next(it);
-            surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(*var);
+            surgescript_objecthandle_t entity_handle = *((surgescript_objecthandle_t*)iterator_next(it));
 
             if(surgescript_objectmanager_exists(manager, entity_handle)) {
                 surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
@@ -24,16 +24,82 @@
 #include <stdint.h>
 #include "levparser.h"
 #include "../../core/asset.h"
+#include "../../core/global.h"
+#include "../../core/logfile.h"
+#include "../../entities/brick.h"
 #include "../../util/util.h"
+#include "../../util/darray.h"
 #include "../../util/stringutil.h"
 #include "../../util/djb2.h"
+#include "../../util/fasthash.h"
 
 /* helpers */
 #define LINE_MAXLEN 1024
 #define MAX_PARAMS 16
 static bool parse_line(const char* filepath, int fileline, char* line, void* data, levparser_callback_t callback);
+static int tokenize_line(char* line, char** identifier, char** param);
 static inline levparser_command_t find_command(const char* command_name);
 
+/* compiled levels */
+typedef struct compiledline_t compiledline_t;
+
+typedef struct compiledentity_t compiledentity_t;
+
+/* a line of the .lev file that has been tokenized. Well-formed bricks
+   and entities are packed: their parameters are decoded in advance */
+struct compiledline_t
+{
+    int fileline; /* line number in the .lev file */
+    int command; /* levparser_command_t */
+    int param_count; /* number of parameters, or PACKED_LINE */
+    uint32_t offset; /* offset of the command name in the string table, which the parameters follow; or index of a packed brick or entity */
+};
+
+/* a packed entity */
+struct compiledentity_t
+{
+    uint32_t name_offset; /* offset of the class name in the string table */
+    int x, y;
+    uint64_t id;
+    bool has_id;
+};
+
+/* a .lev file that has been compiled */
+struct compiledlevel_t
+{
+    char* filepath; /* full path to the .lev file */
+    DARRAY(compiledline_t, line); /* lines in file order, excluding comments and empty lines */
+    DARRAY(char, string); /* string table: NUL-terminated command names, parameters & entity names */
+    DARRAY(levparser_brick_t, brick); /* packed bricks */
+    DARRAY(compiledentity_t, entity); /* packed entities */
+};
+
+#define PACKED_LINE -1 /* param_count of a packed line */
+static compiledlevel_t* create_compiled_level(const char* filepath);
+static compiledlevel_t* compile_level(const char* filepath, const char* source, size_t source_size);
+static bool pack_brick(compiledlevel_t* level, int param_count, char** param);
+static bool pack_entity(compiledlevel_t* level, int param_count, char** param, fasthash_t* interned_names);
+static uint32_t add_string(compiledlevel_t* level, const char* str);
+static char* read_file(const char* fullpath, size_t* size);
+
+/* binary cache of compiled levels. All numbers are little-endian */
+#define CACHE_FOLDER "cache/levels"
+#define CACHE_MAGIC "SURGELVC"
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_HEADER_SIZE 72 /* magic (8), format version (4), engine version (32), source size (4), source hash (8), line count (4), brick count (4), entity count (4), string table size (4) */
+#define CACHE_LINE_SIZE 16 /* fileline (4), command (4), param count (4), offset (4) */
+#define CACHE_BRICK_SIZE 16 /* id (4), x (4), y (4), layer (1), flip (1), padding (2) */
+#define CACHE_ENTITY_SIZE 24 /* name offset (4), x (4), y (4), has id (4), id (8) */
+static compiledlevel_t* read_cache(const char* filepath, const char* cache_path, uint64_t source_hash, size_t source_size);
+static compiledlevel_t* decode_cache(const char* filepath, const uint8_t* data, size_t size, uint64_t source_hash, size_t source_size);
+static bool write_cache(const compiledlevel_t* level, const char* cache_path, uint64_t source_hash, size_t source_size);
+static const char* cache_path(const char* path_to_lev_file, char* buffer, size_t buffer_size);
+static uint64_t hash_bytes(const char* data, size_t size);
+static inline void write_u32(uint8_t* dst, uint32_t value);
+static inline void write_u64(uint8_t* dst, uint64_t value);
+static inline uint32_t read_u32(const uint8_t* src);
+static inline uint64_t read_u64(const uint8_t* src);
+
 /* identifiers */
 static const uint64_t NAME = DJB2("name");
 static const uint64_t AUTHOR = DJB2("author");
@@ -99,6 +165,127 @@ bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callbac
 
 
 
+/*
+ * levparser_compile()
+ * Compiles a .lev file, so that it can be interpreted quickly (possibly more
+ * than once) with levparser_replay(). Bricks and entities are packed, with
+ * their parameters decoded. The compiled file is cached in the user-modifiable
+ * data folder and is invalidated when the hash of the .lev changes.
+ * Returns NULL if the .lev file can't be read
+ */
+compiledlevel_t* levparser_compile(const char* path_to_lev_file)
+{
+    compiledlevel_t* level;
+    char path[64];
+    size_t source_size;
+    char* source;
+
+    /* read the level file with a single read */
+    const char* fullpath = asset_path(path_to_lev_file);
+    if(NULL == (source = read_file(fullpath, &source_size)))
+        return NULL; /* error */
+
+    /* find the compiled file in the cache */
+    uint64_t source_hash = hash_bytes(source, source_size);
+    cache_path(path_to_lev_file, path, sizeof(path));
+    if(NULL != (level = read_cache(fullpath, path, source_hash, source_size))) {
+        free(source);
+        return level;
+    }
+
+    /* compile the level file and cache it */
+    level = compile_level(fullpath, source, source_size);
+    if(!write_cache(level, path, source_hash, source_size))
+        logfile_message("Level parser - can't cache \"%s\"", path_to_lev_file);
+
+    /* done! */
+    free(source);
+    return level;
+}
+
+/*
+ * levparser_replay()
+ * Interprets a compiled .lev file in file order. Packed bricks and entities
+ * are given to brick_callback and to entity_callback, or skipped if these are
+ * NULL; all other lines are given to callback. If a callback returns false,
+ * the replay will stop
+ */
+void levparser_replay(const compiledlevel_t* level, void* data, levparser_callback_t callback, levparser_brick_callback_t brick_callback, levparser_entity_callback_t entity_callback)
+{
+    const char* param[MAX_PARAMS];
+
+    for(int i = 0; i < darray_length(level->line); i++) {
+        const compiledline_t* line = &(level->line[i]);
+
+        /* packed bricks */
+        if(line->param_count == PACKED_LINE && line->command == LEVCOMMAND_BRICK) {
+            if(brick_callback != NULL && !brick_callback(level->filepath, line->fileline, &(level->brick[line->offset]), data))
+                break;
+
+            continue;
+        }
+
+        /* packed entities */
+        if(line->param_count == PACKED_LINE) {
+            if(entity_callback != NULL) {
+                const compiledentity_t* packed = &(level->entity[line->offset]);
+                levparser_entity_t entity = {
+                    .name = level->string + packed->name_offset,
+                    .x = packed->x,
+                    .y = packed->y,
+                    .id = packed->id,
+                    .has_id = packed->has_id
+                };
+
+                if(!entity_callback(level->filepath, line->fileline, &entity, data))
+                    break;
+            }
+
+            continue;
+        }
+
+        /* the parameters follow the command name in the string table */
+        const char* command_name = level->string + line->offset;
+        const char* p = command_name;
+        for(int j = 0; j < line->param_count; j++) {
+            p += strlen(p) + 1;
+            param[j] = p;
+        }
+
+        /* interpret the line */
+        if(!callback(level->filepath, line->fileline, (levparser_command_t)line->command, command_name, line->param_count, param, data))
+            break;
+    }
+}
+
+/*
+ * levparser_brick_count()
+ * The number of packed bricks of a compiled .lev file
+ */
+int levparser_brick_count(const compiledlevel_t* level)
+{
+    return darray_length(level->brick);
+}
+
+/*
+ * levparser_destroy_compiled()
+ * Destroys a compiled .lev file
+ */
+compiledlevel_t* levparser_destroy_compiled(compiledlevel_t* level)
+{
+    darray_release(level->entity);
+    darray_release(level->brick);
+    darray_release(level->string);
+    darray_release(level->line);
+    free(level->filepath);
+    free(level);
+
+    return NULL;
+}
+
+
+
+
 /*
  *
  * private
@@ -108,20 +295,35 @@ bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callbac
 /* parse a line from the .lev file */
 bool parse_line(const char* filepath, int fileline, char* line, void* data, levparser_callback_t callback)
 {
-    char *p, *identifier, *param[MAX_PARAMS];
+    char *identifier, *param[MAX_PARAMS];
+    int param_count;
+
+    /* tokenize the line */
+    if((param_count = tokenize_line(line, &identifier, param)) < 0)
+        return true; /* the line is empty or a comment */
+
+    /* interpret the line */
+    return callback(filepath, fileline, find_command(identifier), identifier, param_count, (const char**)param, data);
+}
+
+/* tokenize a line from the .lev file, modifying it. Returns the number of
+   parameters, or -1 if the line is an empty string or a comment */
+int tokenize_line(char* line, char** identifier, char** param)
+{
+    char *p;
 
     /* skip spaces */
     for(p = line; *p && isspace((int)*p); p++);
     if(*p == '\0')
-        return true; /* the line is an empty string */
+        return -1; /* the line is an empty string */
 
     /* reading the identifier */
-    for(identifier = p; *p && !isspace((int)*p); p++);
+    for(*identifier = p; *p && !isspace((int)*p); p++);
     if(*p)
         *(p++) = '\0';
 
-    if((identifier[0] == '/' && identifier[1] == '/') || identifier[0] == '#')
-        return true; /* the line is a comment */
+    if(((*identifier)[0] == '/' && (*identifier)[1] == '/') || (*identifier)[0] == '#')
+        return -1; /* the line is a comment */
 
     /* skip spaces */
     for(; *p && isspace((int)*p); p++);
@@ -143,7 +345,7 @@ bool parse_line(const char* filepath, int fileline, char* line, void* data, levp
 
         #if 0
         /* debug */
-        printf("|%s|\n", identifier);
+        printf("|%s|\n", *identifier);
         printf("|%s|\n", arg);
         puts("----");
         #endif
@@ -155,8 +357,8 @@ bool parse_line(const char* filepath, int fileline, char* line, void* data, levp
         for(; *p && isspace((int)*p); p++);
     }
 
-    /* interpret the line */
-    return callback(filepath, fileline, find_command(identifier), identifier, param_count, (const char**)param, data);
+    /* done */
+    return param_count;
 }
 
 /* map a command string to a command enum */
@@ -234,4 +436,448 @@ levparser_command_t find_command(const char* command_name)
         default:
             return LEVCOMMAND_UNKNOWN;
     }
-}
\ No newline at end of file
+}
+
+/* create an empty compiled level */
+compiledlevel_t* create_compiled_level(const char* filepath)
+{
+    compiledlevel_t* level = mallocx(sizeof *level);
+
+    level->filepath = str_dup(filepath);
+    darray_init(level->line);
+    darray_init(level->string);
+    darray_init(level->brick);
+    darray_init(level->entity);
+
+    return level;
+}
+
+/* compile a .lev file that has been read into memory */
+compiledlevel_t* compile_level(const char* filepath, const char* source, size_t source_size)
+{
+    compiledlevel_t* level = create_compiled_level(filepath);
+    fasthash_t* interned_names = fasthash_create(free, 8);
+    char line[LINE_MAXLEN], *identifier, *param[MAX_PARAMS];
+    size_t pos = 0;
+    int ln = 0;
+
+    while(pos < source_size) {
+
+        /* read a line just like al_fgets() would */
+        size_t len = 0;
+        while(pos < source_size && len < sizeof(line) - 1) {
+            if((line[len++] = source[pos++]) == '\n')
+                break;
+        }
+        line[len] = '\0';
+        ++ln;
+
+        /* tokenize the line */
+        int param_count = tokenize_line(line, &identifier, param);
+        if(param_count < 0)
+            continue; /* the line is empty or a comment */
+
+        /* pack well-formed bricks and entities */
+        levparser_command_t command = find_command(identifier);
+        if(command == LEVCOMMAND_BRICK && pack_brick(level, param_count, param)) {
+            compiledline_t packed_line = {
+                .fileline = ln,
+                .command = command,
+                .param_count = PACKED_LINE,
+                .offset = darray_length(level->brick) - 1
+            };
+            darray_push(level->line, packed_line);
+            continue;
+        }
+        else if(command == LEVCOMMAND_ENTITY && pack_entity(level, param_count, param, interned_names)) {
+            compiledline_t packed_line = {
+                .fileline = ln,
+                .command = command,
+                .param_count = PACKED_LINE,
+                .offset = darray_length(level->entity) - 1
+            };
+            darray_push(level->line, packed_line);
+            continue;
+        }
+
+        /* store the tokenized line */
+        compiledline_t compiled_line = {
+            .fileline = ln,
+            .command = command,
+            .param_count = param_count,
+            .offset = darray_length(level->string)
+        };
+        darray_push(level->line, compiled_line);
+
+        /* store the command name and the parameters in the string table */
+        for(int j = -1; j < param_count; j++)
+            add_string(level, (j < 0) ? identifier : param[j]);
+    }
+
+    fasthash_destroy(interned_names);
+    return level;
+}
+
+/* pack a brick: id, xpos, ypos [, layer_name [, flip_flags]]. Returns false if the line is malformed */
+bool pack_brick(compiledlevel_t* level, int param_count, char** param)
+{
+    levparser_brick_t brick = {
+        .layer = BRL_DEFAULT,
+        .flip = BRF_NOFLIP
+    };
+
+    if(param_count < 3 || param_count > 5)
+        return false;
+
+    brick.id = atoi(param[0]);
+    brick.x = atoi(param[1]);
+    brick.y = atoi(param[2]);
+
+    for(int j = 3; j < param_count; j++) {
+        if(brick.layer == BRL_DEFAULT && brick_util_layercode(param[j]) != BRL_DEFAULT)
+            brick.layer = brick_util_layercode(param[j]);
+        else if(brick.flip == BRF_NOFLIP && brick_util_flipcode(param[j]) != BRF_NOFLIP)
+            brick.flip = brick_util_flipcode(param[j]);
+    }
+
+    darray_push(level->brick, brick);
+    return true;
+}
+
+/* pack an entity: name, xpos, ypos [, id]. The names are stored once per
+   class in the string table. Returns false if the line is malformed */
+bool pack_entity(compiledlevel_t* level, int param_count, char** param, fasthash_t* interned_names)
+{
+    compiledentity_t entity;
+    uint64_t name_hash = djb2(param[0]);
+    uint32_t* name_offset;
+
+    if(param_count != 3 && param_count != 4)
+        return false;
+
+    /* intern the name. Names with colliding hashes are simply stored again */
+    name_offset = fasthash_get(interned_names, name_hash);
+    if(name_offset != NULL && 0 == strcmp(level->string + *name_offset, param[0])) {
+        entity.name_offset = *name_offset;
+    }
+    else {
+        entity.name_offset = add_string(level, param[0]);
+        if(name_offset == NULL) {
+            name_offset = mallocx(sizeof *name_offset);
+            *name_offset = entity.name_offset;
+            fasthash_put(interned_names, name_hash, name_offset);
+        }
+    }
+
+    entity.x = atoi(param[1]);
+    entity.y = atoi(param[2]);
+    entity.has_id = (param_count > 3);
+    entity.id = entity.has_id ? str_to_x64(param[3]) : 0;
+
+    darray_push(level->entity, entity);
+    return true;
+}
+
+/* append a NUL-terminated string to the string table, returning its offset */
+uint32_t add_string(compiledlevel_t* level, const char* str)
+{
+    uint32_t offset = darray_length(level->string);
+
+    do { darray_push(level->string, *str); } while(*(str++) != '\0');
+
+    return offset;
+}
+
+/* read a compiled .lev file from the cache with a single read, provided that it matches the source */
+compiledlevel_t* read_cache(const char* filepath, const char* cache_path, uint64_t source_hash, size_t source_size)
+{
+    compiledlevel_t* level;
+    ALLEGRO_FILE* fp;
+    uint8_t* data;
+    int64_t size;
+
+    /* open the cache */
+    if(!asset_exists(cache_path))
+        return NULL;
+    if(NULL == (fp = al_fopen(asset_path(cache_path), "rb")))
+        return NULL;
+
+    /* read it with a single read */
+    size = al_fsize(fp);
+    if(size < CACHE_HEADER_SIZE) {
+        al_fclose(fp);
+        return NULL;
+    }
+
+    data = mallocx(size);
+    if(al_fread(fp, data, size) != (size_t)size) {
+        free(data);
+        al_fclose(fp);
+        return NULL;
+    }
+    al_fclose(fp);
+
+    /* decode it */
+    level = decode_cache(filepath, data, size, source_hash, source_size);
+    free(data);
+
+    return level;
+}
+
+/* decode a compiled .lev file. Returns NULL if the data is outdated or corrupted */
+compiledlevel_t* decode_cache(const char* filepath, const uint8_t* data, size_t size, uint64_t source_hash, size_t source_size)
+{
+    char engine_version[32] = { 0 };
+    compiledlevel_t* level;
+
+    /* validate the header */
+    str_cpy(engine_version, GAME_VERSION_STRING, sizeof(engine_version));
+    uint32_t line_count = read_u32(data + 56);
+    uint32_t brick_count = read_u32(data + 60);
+    uint32_t entity_count = read_u32(data + 64);
+    uint32_t string_size = read_u32(data + 68);
+    if(!(
+        memcmp(data, CACHE_MAGIC, 8) == 0 &&
+        read_u32(data + 8) == CACHE_FORMAT_VERSION &&
+        memcmp(data + 12, engine_version, 32) == 0 &&
+        read_u32(data + 44) == (uint32_t)source_size &&
+        read_u64(data + 48) == source_hash &&
+        (uint64_t)CACHE_HEADER_SIZE +
+            (uint64_t)line_count * CACHE_LINE_SIZE +
+            (uint64_t)brick_count * CACHE_BRICK_SIZE +
+            (uint64_t)entity_count * CACHE_ENTITY_SIZE +
+            string_size == (uint64_t)size &&
+        (string_size == 0 || data[size - 1] == '\0')
+    ))
+        return NULL;
+
+    const uint8_t* line_data = data + CACHE_HEADER_SIZE;
+    const uint8_t* brick_data = line_data + line_count * CACHE_LINE_SIZE;
+    const uint8_t* entity_data = brick_data + brick_count * CACHE_BRICK_SIZE;
+    const char* string_table = (const char*)(entity_data + entity_count * CACHE_ENTITY_SIZE);
+
+    level = create_compiled_level(filepath);
+
+    /* read the string table */
+    for(uint32_t i = 0; i < string_size; i++)
+        darray_push(level->string, string_table[i]);
+
+    /* read the packed bricks */
+    for(uint32_t i = 0; i < brick_count; i++) {
+        const uint8_t* p = brick_data + i * CACHE_BRICK_SIZE;
+        levparser_brick_t brick = {
+            .id = (int32_t)read_u32(p),
+            .x = (int32_t)read_u32(p + 4),
+            .y = (int32_t)read_u32(p + 8),
+            .layer = p[12],
+            .flip = p[13]
+        };
+
+        darray_push(level->brick, brick);
+    }
+
+    /* read the packed entities */
+    for(uint32_t i = 0; i < entity_count; i++) {
+        const uint8_t* p = entity_data + i * CACHE_ENTITY_SIZE;
+        compiledentity_t entity = {
+            .name_offset = read_u32(p),
+            .x = (int32_t)read_u32(p + 4),
+            .y = (int32_t)read_u32(p + 8),
+            .has_id = (read_u32(p + 12) != 0),
+            .id = read_u64(p + 16)
+        };
+
+        /* reject corrupted files */
+        if(entity.name_offset >= string_size)
+            return levparser_destroy_compiled(level);
+
+        darray_push(level->entity, entity);
+    }
+
+    /* read the lines */
+    for(uint32_t i = 0; i < line_count; i++) {
+        const uint8_t* p = line_data + i * CACHE_LINE_SIZE;
+        compiledline_t line = {
+            .fileline = (int32_t)read_u32(p),
+            .command = (int32_t)read_u32(p + 4),
+            .param_count = (int32_t)read_u32(p + 8),
+            .offset = read_u32(p + 12)
+        };
+
+        /* reject corrupted files */
+        if(line.param_count == PACKED_LINE) {
+            if(line.command == LEVCOMMAND_BRICK ? line.offset >= brick_count : (line.command != LEVCOMMAND_ENTITY || line.offset >= entity_count))
+                return levparser_destroy_compiled(level);
+        }
+        else if(line.param_count < 0 || line.param_count > MAX_PARAMS || line.offset >= string_size)
+            return levparser_destroy_compiled(level);
+        else {
+            /* the parameters of a line must fit in the string table */
+            const char* s = level->string + line.offset;
+            for(int j = 0; j < line.param_count; j++) {
+                s += strlen(s) + 1;
+                if(s >= level->string + string_size)
+                    return levparser_destroy_compiled(level);
+            }
+        }
+
+        darray_push(level->line, line);
+    }
+
+    /* done! */
+    return level;
+}
+
+/* write a compiled .lev file to the cache with a single write */
+bool write_cache(const compiledlevel_t* level, const char* cache_path, uint64_t source_hash, size_t source_size)
+{
+    char engine_version[32] = { 0 };
+    int line_count = darray_length(level->line);
+    int brick_count = darray_length(level->brick);
+    int entity_count = darray_length(level->entity);
+    int string_size = darray_length(level->string);
+    size_t size = CACHE_HEADER_SIZE + line_count * CACHE_LINE_SIZE + brick_count * CACHE_BRICK_SIZE + entity_count * CACHE_ENTITY_SIZE + string_size;
+    ALLEGRO_FILE* fp;
+    bool success;
+
+    /* create the cache folder */
+    if(!asset_mkdir(CACHE_FOLDER))
+        return false;
+
+    /* serialize the header */
+    uint8_t* data = mallocx(size);
+    str_cpy(engine_version, GAME_VERSION_STRING, sizeof(engine_version));
+    memcpy(data, CACHE_MAGIC, 8);
+    write_u32(data + 8, CACHE_FORMAT_VERSION);
+    memcpy(data + 12, engine_version, 32);
+    write_u32(data + 44, source_size);
+    write_u64(data + 48, source_hash);
+    write_u32(data + 56, line_count);
+    write_u32(data + 60, brick_count);
+    write_u32(data + 64, entity_count);
+    write_u32(data + 68, string_size);
+
+    /* serialize the lines */
+    uint8_t* p = data + CACHE_HEADER_SIZE;
+    for(int i = 0; i < line_count; i++, p += CACHE_LINE_SIZE) {
+        write_u32(p, level->line[i].fileline);
+        write_u32(p + 4, level->line[i].command);
+        write_u32(p + 8, level->line[i].param_count);
+        write_u32(p + 12, level->line[i].offset);
+    }
+
+    /* serialize the packed bricks */
+    for(int i = 0; i < brick_count; i++, p += CACHE_BRICK_SIZE) {
+        write_u32(p, level->brick[i].id);
+        write_u32(p + 4, level->brick[i].x);
+        write_u32(p + 8, level->brick[i].y);
+        p[12] = level->brick[i].layer;
+        p[13] = level->brick[i].flip;
+        p[14] = p[15] = 0;
+    }
+
+    /* serialize the packed entities */
+    for(int i = 0; i < entity_count; i++, p += CACHE_ENTITY_SIZE) {
+        write_u32(p, level->entity[i].name_offset);
+        write_u32(p + 4, level->entity[i].x);
+        write_u32(p + 8, level->entity[i].y);
+        write_u32(p + 12, level->entity[i].has_id ? 1 : 0);
+        write_u64(p + 16, level->entity[i].id);
+    }
+
+    /* serialize the string table */
+    memcpy(p, level->string, string_size);
+
+    /* write with a single write */
+    if(NULL == (fp = al_fopen(asset_path(cache_path), "wb"))) {
+        free(data);
+        return false;
+    }
+
+    success = (al_fwrite(fp, data, size) == size);
+    al_fclose(fp);
+
+    free(data);
+    return success;
+}
+
+/* the path of the compiled .lev file in the virtual filesystem */
+const char* cache_path(const char* path_to_lev_file, char* buffer, size_t buffer_size)
+{
+    char hash[20];
+
+    x64_to_str(djb2(path_to_lev_file), hash, sizeof(hash));
+    snprintf(buffer, buffer_size, "%s/%s.bin", CACHE_FOLDER, hash);
+
+    return buffer;
+}
+
+/* read an entire file into a newly allocated buffer. Returns NULL on error */
+char* read_file(const char* fullpath, size_t* size)
+{
+    ALLEGRO_FILE* fp = al_fopen(fullpath, "rb");
+    char* buffer = NULL;
+    size_t capacity, len = 0, n;
+
+    if(fp == NULL)
+        return NULL;
+
+    /* al_fsize() may be unknown; read in chunks if necessary */
+    capacity = al_fsize(fp) > 0 ? (size_t)al_fsize(fp) + 1 : 4096;
+    buffer = mallocx(capacity);
+
+    while((n = al_fread(fp, buffer + len, capacity - len)) > 0) {
+        len += n;
+        if(len == capacity)
+            buffer = reallocx(buffer, (capacity *= 2));
+    }
+
+    al_fclose(fp);
+
+    *size = len;
+    return buffer;
+}
+
+/* djb2 hash of a sequence of bytes */
+uint64_t hash_bytes(const char* data, size_t size)
+{
+    uint64_t hash = 5381;
+
+    for(size_t i = 0; i < size; i++)
+        hash = ((hash << 5) + hash) + (unsigned char)data[i]; /* hash * 33 + c */
+
+    return hash;
+}
+
+/* little-endian serialization */
+void write_u32(uint8_t* dst, uint32_t value)
+{
+    for(int i = 0; i < 4; i++)
+        dst[i] = (value >> (8 * i)) & 0xFF;
+}
+
+void write_u64(uint8_t* dst, uint64_t value)
+{
+    for(int i = 0; i < 8; i++)
+        dst[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint32_t read_u32(const uint8_t* src)
+{
+    uint32_t value = 0;
+
+    for(int i = 0; i < 4; i++)
+        value |= ((uint32_t)src[i]) << (8 * i);
+
+    return value;
+}
+
+uint64_t read_u64(const uint8_t* src)
+{
+    uint64_t value = 0;
+
+    for(int i = 0; i < 8; i++)
+        value |= ((uint64_t)src[i]) << (8 * i);
+
+    return value;
+}
@@ -22,12 +22,43 @@
 #define _LEVPARSER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum levparser_command_t levparser_command_t;
+typedef struct compiledlevel_t compiledlevel_t;
+typedef struct levparser_brick_t levparser_brick_t;
+typedef struct levparser_entity_t levparser_entity_t;
 typedef bool (*levparser_callback_t)(const char *filepath, int fileline, levparser_command_t command, const char *command_name, int param_count, const char **param, void* data);
+typedef bool (*levparser_brick_callback_t)(const char *filepath, int fileline, const levparser_brick_t *brick, void* data);
+typedef bool (*levparser_entity_callback_t)(const char *filepath, int fileline, const levparser_entity_t *entity, void* data);
 
+/* read a .lev file line by line */
 bool levparser_parse(const char* path_to_lev_file, void* data, levparser_callback_t callback);
 
+/* compile a .lev file (using a binary cache) and interpret it later, possibly more than once */
+compiledlevel_t* levparser_compile(const char* path_to_lev_file); /* returns NULL on error */
+void levparser_replay(const compiledlevel_t* level, void* data, levparser_callback_t callback, levparser_brick_callback_t brick_callback, levparser_entity_callback_t entity_callback); /* bricks and entities are skipped if their callbacks are NULL */
+int levparser_brick_count(const compiledlevel_t* level); /* number of packed bricks */
+compiledlevel_t* levparser_destroy_compiled(compiledlevel_t* level);
+
+/* a brick of a compiled level, with its parameters decoded */
+struct levparser_brick_t
+{
+    int id; /* brick id */
+    int x, y; /* spawn point */
+    int layer; /* bricklayer_t */
+    int flip; /* brickflip_t */
+};
+
+/* an entity of a compiled level, with its parameters decoded */
+struct levparser_entity_t
+{
+    const char* name; /* class name; stored once per class */
+    int x, y; /* spawn point */
+    uint64_t id; /* entity id, if has_id is true */
+    bool has_id; /* was an id specified? */
+};
+
 enum levparser_command_t
 {
     LEVCOMMAND_NAME,
@@ -72,6 +72,7 @@ static const surgescript_heapptr_t ANIMATION_ADDR = 3;
 static const surgescript_heapptr_t OFFSET_ADDR = 4;
 static const double DEFAULT_ZINDEX = 0.5;
 static inline surgescript_object_t* get_animation(surgescript_object_t* object);
+static bool is_translucent(surgescript_object_t* object);
 
 /*
  * scripting_register_actor()
@@ -130,6 +131,22 @@ actor_t* scripting_actor_ptr(const surgescript_object_t* object)
     return (actor_t*)surgescript_object_userdata(object);
 }
 
+/*
+ * scripting_actor_describe()
+ * Describes an Actor to the render queue
+ */
+void scripting_actor_describe(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+
+    desc->visible = actor->visible;
+    desc->zindex = surgescript_var_get_number(surgescript_heap_at(heap, ZINDEX_ADDR));
+    desc->has_texture = true;
+    desc->texture = image_texture(actor_image(actor));
+    desc->is_translucent = is_translucent(object);
+}
+
 /* private */
 
 /* main state */
@@ -265,18 +282,7 @@ surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surg
 /* is this renderable translucent? (used by the render queue) */
 surgescript_var_t* fun_getistranslucent(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    actor_t* actor = scripting_actor_ptr(object);
-    bool is_translucent = (actor->alpha < 1.0f); /* doesn't take individual pixels into account */
-
-    if(!is_translucent) {
-        const surgescript_object_t* animation = get_animation(object);
-        const animation_t* anim = scripting_animation_ptr(animation);
-
-        if(animation_has_keyframes(anim)) /* FIXME should be has_keyframes_with_changed_opacity or similar */
-            is_translucent = true;
-    }
-
-    return surgescript_var_set_bool(surgescript_var_create(), is_translucent);
+    return surgescript_var_set_bool(surgescript_var_create(), is_translucent(object));
 }
 
 /* __init: set sprite name */
@@ -538,3 +544,16 @@ surgescript_object_t* get_animation(surgescript_object_t* object)
     surgescript_object_t* animation = surgescript_objectmanager_get(manager, animation_handle);
     return animation;
 }
+
+/* is this actor translucent? */
+bool is_translucent(surgescript_object_t* object)
+{
+    const actor_t* actor = scripting_actor_ptr(object);
+
+    if(actor->alpha < 1.0f) /* doesn't take individual pixels into account */
+        return true;
+
+    const surgescript_object_t* animation = get_animation(object);
+    const animation_t* anim = scripting_animation_ptr(animation);
+    return animation_has_keyframes(anim); /* FIXME should be has_keyframes_with_changed_opacity or similar */
+}
@@ -1,6 +1,6 @@
 /*
  * Open Surge Engine
- * brickparticle.c - scripting system: brick particle
+ * brickparticle.c - scripting system: brick particles
  * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
  * http://opensurge2d.org
  *
@@ -29,14 +29,38 @@
 #include "../entities/camera.h"
 #include "../scenes/level.h"
 
-/* brick particle data */
-typedef struct particledata_t particledata_t;
-struct particledata_t
+/*
+
+BrickParticles is a single emitter that simulates and renders all the
+particles of broken bricks. Particles are stored in a fixed-capacity
+pool laid out as a structure of arrays, and the whole pool is rendered
+with a single entry of the render queue.
+
+Each particle is drawn with the image of its own brick, so a pool may
+mix textures. However, the render queue is told about the texture and
+the filepath of the first particle only. That's just a sorting hint:
+bricks of a brickset typically share the same image. A pool with mixed
+textures still renders correctly, at the cost of texture switches.
+
+*/
+
+/* brick particles */
+#define MAX_PARTICLES 1024 /* capacity of the pool */
+typedef struct particlepool_t particlepool_t;
+struct particlepool_t
 {
-    const image_t* image; /* possibly NULL */
-    int src_x, src_y, width, height;
-    double zindex;
-    v2d_t velocity;
+    int count; /* number of live particles; these are stored in [0, count) */
+    double zindex; /* the largest zindex of the bricks the particles came from */
+
+    /* simulation */
+    float x[MAX_PARTICLES], y[MAX_PARTICLES];
+    float xvel[MAX_PARTICLES], yvel[MAX_PARTICLES];
+
+    /* rendering */
+    const image_t* image[MAX_PARTICLES];
+    struct {
+        short x, y, width, height;
+    } source[MAX_PARTICLES];
 };
 
 /* constants */
@@ -51,12 +75,16 @@ static surgescript_var_t* fun_getfilepathofrenderable(surgescript_object_t* obje
 static surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getistranslucent(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
-static surgescript_var_t* fun_setzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
-static surgescript_var_t* fun_setbrick(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
-static surgescript_var_t* fun_setvelocity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
-static inline particledata_t* get_particledata(const surgescript_object_t* object);
-static particledata_t* create_particledata();
-static particledata_t* destroy_particledata(particledata_t* pd);
+static surgescript_var_t* fun_getcount(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getcapacity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_emit(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_clear(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static inline particlepool_t* get_particlepool(const surgescript_object_t* object);
+static particlepool_t* create_particlepool();
+static particlepool_t* destroy_particlepool(particlepool_t* pool);
+static void emit_particle(particlepool_t* pool, int brick_id, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity);
+static void remove_particle(particlepool_t* pool, int index);
+static const surgescript_object_t* get_vector2(surgescript_objectmanager_t* manager, const surgescript_var_t* var);
 
 
 
@@ -70,26 +98,52 @@ void scripting_register_brickparticle(surgescript_vm_t* vm)
 {
     /* tags */
     surgescript_tagsystem_t* tag_system = surgescript_vm_tagsystem(vm);
-    surgescript_tagsystem_add_tag(tag_system, "BrickParticle", "renderable");
-    surgescript_tagsystem_add_tag(tag_system, "BrickParticle", "entity");
-    surgescript_tagsystem_add_tag(tag_system, "BrickParticle", "private");
-    surgescript_tagsystem_add_tag(tag_system, "BrickParticle", "disposable");
+    surgescript_tagsystem_add_tag(tag_system, "BrickParticles", "renderable");
+    surgescript_tagsystem_add_tag(tag_system, "BrickParticles", "entity");
+    surgescript_tagsystem_add_tag(tag_system, "BrickParticles", "private");
+    surgescript_tagsystem_add_tag(tag_system, "BrickParticles", "awake");
 
     /* methods */
-    surgescript_vm_bind(vm, "BrickParticle", "state:main", fun_main, 0);
-    surgescript_vm_bind(vm, "BrickParticle", "constructor", fun_constructor, 0);
-    surgescript_vm_bind(vm, "BrickParticle", "destructor", fun_destructor, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "state:main", fun_main, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "constructor", fun_constructor, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "destructor", fun_destructor, 0);
 
-    surgescript_vm_bind(vm, "BrickParticle", "setBrick", fun_setbrick, 5);
-    surgescript_vm_bind(vm, "BrickParticle", "setVelocity", fun_setvelocity, 2);
+    surgescript_vm_bind(vm, "BrickParticles", "emit", fun_emit, 7);
+    surgescript_vm_bind(vm, "BrickParticles", "clear", fun_clear, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "get_count", fun_getcount, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "get_capacity", fun_getcapacity, 0);
 
-    surgescript_vm_bind(vm, "BrickParticle", "set_zindex", fun_setzindex, 1);
-    surgescript_vm_bind(vm, "BrickParticle", "get_zindex", fun_getzindex, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "get_zindex", fun_getzindex, 0);
 
-    surgescript_vm_bind(vm, "BrickParticle", "get___filepathOfRenderable", fun_getfilepathofrenderable, 0);
-    surgescript_vm_bind(vm, "BrickParticle", "get___textureHandle", fun_gettexturehandle, 0);
-    surgescript_vm_bind(vm, "BrickParticle", "get___isTranslucent", fun_getistranslucent, 0);
-    surgescript_vm_bind(vm, "BrickParticle", "onRender", fun_onrender, 2);
+    surgescript_vm_bind(vm, "BrickParticles", "get___filepathOfRenderable", fun_getfilepathofrenderable, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "get___textureHandle", fun_gettexturehandle, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "get___isTranslucent", fun_getistranslucent, 0);
+    surgescript_vm_bind(vm, "BrickParticles", "onRender", fun_onrender, 2);
+}
+
+/*
+ * scripting_brickparticles_describe()
+ * Describes the particles to the render queue
+ */
+void scripting_brickparticles_describe(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    const particlepool_t* pool = get_particlepool(object);
+
+    desc->visible = true;
+    desc->zindex = pool->zindex;
+    desc->has_texture = (pool->count > 0); /* bricks of a brickset typically share the same image */
+    desc->texture = (pool->count > 0) ? image_texture(pool->image[0]) : 0;
+    desc->is_translucent = false;
+}
+
+/*
+ * scripting_brickparticles_emit()
+ * Emits a particle showing the given rectangle of a brick image
+ */
+void scripting_brickparticles_emit(surgescript_object_t* emitter, int brick_id, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    particlepool_t* pool = get_particlepool(emitter);
+    emit_particle(pool, brick_id, src_x, src_y, width, height, position, velocity);
 }
 
 
@@ -104,20 +158,30 @@ SurgeScript functions
 /* main state */
 surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_transform_t* transform = surgescript_object_transform(object);
-    particledata_t* pd = get_particledata(object);
+    particlepool_t* pool = get_particlepool(object);
     float dt = timer_get_delta();
-
-    /* update velocity */
     float grv = level_gravity();
-    pd->velocity.y += grv * dt;
 
-    /* update position */
-    float dx = pd->velocity.x * dt;
-    float dy = pd->velocity.y * dt;
-    surgescript_transform_translate2d(transform, dx, dy);
+    /* particles that fall well below the screen are removed
+       (the camera is positioned at the center of the screen) */
+    v2d_t camera = camera_get_position();
+    float bottom = camera.y + video_get_screen_size().y;
+
+    /* update velocities */
+    for(int i = 0; i < pool->count; i++)
+        pool->yvel[i] += grv * dt;
 
-    /* this disposable entity will be removed automatically by the Entity Manager */
+    /* update positions */
+    for(int i = 0; i < pool->count; i++) {
+        pool->x[i] += pool->xvel[i] * dt;
+        pool->y[i] += pool->yvel[i] * dt;
+    }
+
+    /* remove the particles that are gone */
+    for(int i = pool->count - 1; i >= 0; i--) {
+        if(pool->y[i] > bottom)
+            remove_particle(pool, i);
+    }
 
     /* done */
     return NULL;
@@ -128,33 +192,25 @@ surgescript_var_t* fun_onrender(surgescript_object_t* object, const surgescript_
 {
     double camera_x = surgescript_var_get_number(param[0]);
     double camera_y = surgescript_var_get_number(param[1]);
-    v2d_t camera = v2d_new(camera_x, camera_y);
-    v2d_t position = v2d_new(0.0f, 0.0f);
+    const particlepool_t* pool = get_particlepool(object);
 
-    /* nothing to do? */
-    const particledata_t* pd = get_particledata(object);
-    if(pd->image == NULL)
-        return NULL; /* image not yet set */
-
-    /* get position in world space */
-    const surgescript_transform_t* transform = surgescript_object_transform(object);
-    surgescript_transform_getposition2d(transform, &position.x, &position.y);
-
-    /* convert position to screen space */
+    /* convert world space to screen space */
     v2d_t center_of_screen = v2d_multiply(video_get_screen_size(), 0.5f);
-    v2d_t topleft_of_screen = v2d_subtract(camera, center_of_screen);
-    position = v2d_subtract(position, topleft_of_screen);
-
-    /* render */
-    image_blit(
-        pd->image,
-        pd->src_x,
-        pd->src_y,
-        (int)position.x,
-        (int)position.y,
-        pd->width,
-        pd->height
-    );
+    int offset_x = (int)(camera_x - center_of_screen.x);
+    int offset_y = (int)(camera_y - center_of_screen.y);
+
+    /* render all particles in one go */
+    for(int i = 0; i < pool->count; i++) {
+        image_blit(
+            pool->image[i],
+            pool->source[i].x,
+            pool->source[i].y,
+            (int)pool->x[i] - offset_x,
+            (int)pool->y[i] - offset_y,
+            pool->source[i].width,
+            pool->source[i].height
+        );
+    }
 
     /* done */
     return NULL;
@@ -165,7 +221,7 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
 {
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
 
-    /* BrickParticle must be a child of Level */
+    /* BrickParticles must be a child of Level */
     surgescript_objecthandle_t parent_handle = surgescript_object_parent(object);
     const surgescript_object_t* parent = surgescript_objectmanager_get(manager, parent_handle);
     if(strcmp(surgescript_object_name(parent), "Level") != 0) {
@@ -173,9 +229,9 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
         return NULL;
     }
 
-    /* create particle data */
-    particledata_t* pd = create_particledata();
-    surgescript_object_set_userdata(object, pd);
+    /* create the pool of particles */
+    particlepool_t* pool = create_particlepool();
+    surgescript_object_set_userdata(object, pool);
 
     /* done */
     return NULL;
@@ -184,100 +240,93 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
 /* destructor */
 surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    /* destroy particle data */
-    particledata_t* pd = get_particledata(object);
-    destroy_particledata(pd);
+    /* destroy the pool of particles */
+    particlepool_t* pool = get_particlepool(object);
+    destroy_particlepool(pool);
 
     /* done */
     return NULL;
 }
 
-/* set brick */
-surgescript_var_t* fun_setbrick(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+/* emit(brickId, srcX, srcY, width, height, position, velocity): emits a particle
+   showing a rectangle of a brick. position and velocity are Vector2 objects */
+surgescript_var_t* fun_emit(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
+    surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     int brick_id = surgescript_var_get_number(param[0]);
     int src_x = surgescript_var_get_number(param[1]);
     int src_y = surgescript_var_get_number(param[2]);
     int width = surgescript_var_get_number(param[3]);
     int height = surgescript_var_get_number(param[4]);
+    const surgescript_object_t *position, *velocity;
 
-    if(brick_exists(brick_id)) {
-        const image_t* brick_image = brick_image_preview(brick_id);
-        int brick_width = image_width(brick_image);
-        int brick_height = image_height(brick_image);
-        float zindex = brick_zindex_preview(brick_id);
-
-        particledata_t* pd = get_particledata(object);
-        pd->image = brick_image;
-        pd->width = clip(width, 0, brick_width);
-        pd->height = clip(height, 0, brick_height);
-        pd->src_x = clip(src_x, 0, brick_width - pd->width);
-        pd->src_y = clip(src_y, 0, brick_height - pd->height);
-        pd->zindex = max(0.0f, zindex);
+    /* position and velocity must be Vector2 objects */
+    if(NULL == (position = get_vector2(manager, param[5])) || NULL == (velocity = get_vector2(manager, param[6]))) {
+        scripting_error(object, "%s.emit() requires Vector2 objects as position and velocity", surgescript_object_name(object));
+        return NULL;
     }
 
+    particlepool_t* pool = get_particlepool(object);
+    emit_particle(pool, brick_id, src_x, src_y, width, height, scripting_vector2_to_v2d(position), scripting_vector2_to_v2d(velocity));
+
     return NULL;
 }
 
-/* set velocity */
-surgescript_var_t* fun_setvelocity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+/* clear(): removes all particles */
+surgescript_var_t* fun_clear(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    double xvel = surgescript_var_get_number(param[0]);
-    double yvel = surgescript_var_get_number(param[1]);
-
-    particledata_t* pd = get_particledata(object);
-    pd->velocity = v2d_new(xvel, yvel);
-
+    particlepool_t* pool = get_particlepool(object);
+    pool->count = 0;
     return NULL;
 }
 
-/* set zindex */
-surgescript_var_t* fun_setzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+/* the number of live particles */
+surgescript_var_t* fun_getcount(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    double zindex = surgescript_var_get_number(param[0]);
-
-    particledata_t* pd = get_particledata(object);
-    pd->zindex = zindex;
+    const particlepool_t* pool = get_particlepool(object);
+    return surgescript_var_set_number(surgescript_var_create(), pool->count);
+}
 
-    return NULL;
+/* the maximum number of live particles */
+surgescript_var_t* fun_getcapacity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), MAX_PARTICLES);
 }
 
 /* get zindex */
 surgescript_var_t* fun_getzindex(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    return surgescript_var_set_number(surgescript_var_create(), pd->zindex);
+    const particlepool_t* pool = get_particlepool(object);
+    return surgescript_var_set_number(surgescript_var_create(), pool->zindex);
 }
 
 /* the filepath of this renderable (used by the render queue) */
 surgescript_var_t* fun_getfilepathofrenderable(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    const image_t* image = pd->image;
+    const particlepool_t* pool = get_particlepool(object);
 
-    /* image already set? */
-    if(image != NULL) {
-        const char* filepath = image_filepath(image);
+    /* bricks of a brickset typically share the same image */
+    if(pool->count > 0) {
+        const char* filepath = image_filepath(pool->image[0]);
         return surgescript_var_set_string(surgescript_var_create(), filepath);
     }
 
-    /* image not yet set */
-    return surgescript_var_set_string(surgescript_var_create(), "<brick-particle>");
+    /* no particles */
+    return surgescript_var_set_string(surgescript_var_create(), "<brick-particles>");
 }
 
 /* the texture handle of this renderable (used by the render queue) */
 surgescript_var_t* fun_gettexturehandle(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    const particledata_t* pd = get_particledata(object);
-    const image_t* image = pd->image;
+    const particlepool_t* pool = get_particlepool(object);
 
-    /* image already set? */
-    if(image != NULL) {
-        texturehandle_t tex = image_texture(image);
+    /* bricks of a brickset typically share the same image */
+    if(pool->count > 0) {
+        texturehandle_t tex = image_texture(pool->image[0]);
         return surgescript_var_set_rawbits(surgescript_var_create(), tex);
     }
 
-    /* image not yet set */
+    /* no particles */
     return surgescript_var_set_null(surgescript_var_create());
 }
 
@@ -296,29 +345,88 @@ misc
 
 */
 
-/* get particle data */
-particledata_t* get_particledata(const surgescript_object_t* object)
+/* get the pool of particles */
+particlepool_t* get_particlepool(const surgescript_object_t* object)
 {
-    return (particledata_t*)surgescript_object_userdata(object);
+    return (particlepool_t*)surgescript_object_userdata(object);
 }
 
-/* create particle data */
-particledata_t* create_particledata()
+/* create a pool of particles */
+particlepool_t* create_particlepool()
 {
-    particledata_t* pd = mallocx(sizeof *pd);
+    particlepool_t* pool = mallocx(sizeof *pool);
 
-    pd->image = NULL;
-    pd->src_x = pd->src_y = 0;
-    pd->width = pd->height = 0;
-    pd->zindex = DEFAULT_ZINDEX;
-    pd->velocity = v2d_new(0.0f, 0.0f);
+    pool->count = 0;
+    pool->zindex = DEFAULT_ZINDEX;
 
-    return pd;
+    return pool;
 }
 
-/* destroy particle data */
-particledata_t* destroy_particledata(particledata_t* pd)
+/* destroy a pool of particles */
+particlepool_t* destroy_particlepool(particlepool_t* pool)
 {
-    free(pd);
+    free(pool);
     return NULL;
-}
\ No newline at end of file
+}
+
+/* add a particle to the pool */
+void emit_particle(particlepool_t* pool, int brick_id, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity)
+{
+    /* invalid brick? */
+    if(!brick_exists(brick_id))
+        return;
+
+    /* the pool is full; recycle a particle */
+    if(pool->count == MAX_PARTICLES)
+        remove_particle(pool, 0);
+
+    const image_t* brick_image = brick_image_preview(brick_id);
+    int brick_width = image_width(brick_image);
+    int brick_height = image_height(brick_image);
+    float zindex = brick_zindex_preview(brick_id);
+    int i = pool->count++;
+
+    pool->x[i] = position.x;
+    pool->y[i] = position.y;
+    pool->xvel[i] = velocity.x;
+    pool->yvel[i] = velocity.y;
+
+    pool->image[i] = brick_image;
+    pool->source[i].width = clip(width, 0, brick_width);
+    pool->source[i].height = clip(height, 0, brick_height);
+    pool->source[i].x = clip(src_x, 0, brick_width - pool->source[i].width);
+    pool->source[i].y = clip(src_y, 0, brick_height - pool->source[i].height);
+
+    /* the pool is rendered in a single pass, in front of the bricks it came from */
+    pool->zindex = (i == 0) ? max(0.0f, zindex) : max(pool->zindex, zindex);
+}
+
+/* remove a particle from the pool; the order of the particles is not preserved */
+void remove_particle(particlepool_t* pool, int index)
+{
+    int last = --pool->count;
+
+    pool->x[index] = pool->x[last];
+    pool->y[index] = pool->y[last];
+    pool->xvel[index] = pool->xvel[last];
+    pool->yvel[index] = pool->yvel[last];
+    pool->image[index] = pool->image[last];
+    pool->source[index] = pool->source[last];
+}
+
+/* get the Vector2 object stored in a variable, or NULL if there is no such object */
+const surgescript_object_t* get_vector2(surgescript_objectmanager_t* manager, const surgescript_var_t* var)
+{
+    if(!surgescript_var_is_objecthandle(var))
+        return NULL;
+
+    surgescript_objecthandle_t handle = surgescript_var_get_objecthandle(var);
+    if(!surgescript_objectmanager_exists(manager, handle))
+        return NULL;
+
+    const surgescript_object_t* object = surgescript_objectmanager_get(manager, handle);
+    if(strcmp(surgescript_object_name(object), "Vector2") != 0)
+        return NULL;
+
+    return object;
+}
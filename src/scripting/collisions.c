@@ -195,6 +195,39 @@ void scripting_register_collisions(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "CollisionManager", "__notify", fun_manager_notify, 1);
 }
 
+/*
+ * scripting_collider_describe()
+ * Describes a CollisionBox or a CollisionBall to the render queue
+ */
+void scripting_collider_describe(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    const collider_t* collider = unsafe_get_collider(object);
+
+    desc->visible = (collider->flags & COLLIDER_FLAG_ISVISIBLE) != 0;
+    desc->zindex = 0.5f; /* colliders have no get_zindex() */
+    desc->has_texture = false;
+    desc->texture = 0;
+    desc->is_translucent = false;
+}
+
+/*
+ * scripting_collider_poll()
+ * Registers a collider of a dormant (inactive) entity in the CollisionManager,
+ * as if it were updated. Returns true if the collider was in contact with
+ * another collider in the previous frame. Returns false if object isn't a collider
+ */
+bool scripting_collider_poll(surgescript_object_t* object)
+{
+    if(!is_collider(object))
+        return false;
+
+    collider_t* collider = unsafe_get_collider(object);
+    bool was_colliding = darray_length(collider->curr_collisions) > 0;
+
+    fun_main(object, NULL, 0);
+    return was_colliding;
+}
+
 /* checks if an object is a collider */
 bool is_collider(const surgescript_object_t* object)
 {
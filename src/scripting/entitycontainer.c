@@ -53,6 +53,9 @@ static surgescript_var_t* fun_debug_isindebugmode(surgescript_object_t* object,
 static surgescript_var_t* fun_debug_enterdebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_debug_exitdebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_debug_getdebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+/* C API */
+void entitycontainer_select_active_entities(surgescript_object_t* entity_container, bool skip_inactive_entities, void (*callback)(surgescript_objecthandle_t,void*), void* data);
+
 static surgescript_heapptr_t LEVELOBJECTCONTAINER_ADDR = 0;
 static surgescript_heapptr_t DEBUGMODE_ADDR = 1; /* DebugEntityContainer only */
 static const char DEBUGMODE_OBJECT_NAME[] = "Debug Mode";
@@ -64,8 +67,12 @@ static inline iterator_t* levelobjectcontainer_iterator(const surgescript_object
 static surgescript_objecthandle_t get_level_handle(const surgescript_object_t* entity_container);
 static bool render_subtree_faster(surgescript_object_t* object, void* data);
 static bool render_subtree(surgescript_object_t* object, void* data);
+static void render_dormant_entity(surgescript_object_t* entity, uint32_t object_class, int flags);
 static bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* data);
 static bool notify_entity(surgescript_object_t* entity_or_component, void* data);
+static void select_active_entities(surgescript_object_t* entity_container, bool skip_inactive_entities, bool clip_to_roi, void (*callback)(surgescript_objecthandle_t,void*), void* data);
+static void push_to_array(surgescript_objecthandle_t entity_handle, void* array);
+static bool reset_entity(surgescript_object_t* entity_or_component, void* data);
 static inline v2d_t entity_position(surgescript_object_t* entity);
 static inline bool is_entity_inside_roi(surgescript_object_t* entity_manager, surgescript_object_t* entity);
 static inline bool is_entity_inside_screen(surgescript_object_t* entity_manager, surgescript_object_t* entity);
@@ -150,6 +157,19 @@ void scripting_register_entitycontainer(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "DebugEntityContainer", "get_debugMode", fun_debug_getdebugmode, 0);
 }
 
+/*
+ * entitycontainer_select_active_entities()
+ * Select the entities of an entity container that should be processed,
+ * calling callback(entity_handle, data) for each of them. No SurgeScript
+ * Array is involved. The entities of an EntityContainer are clipped to
+ * the region of interest; those of an awake container are not.
+ */
+void entitycontainer_select_active_entities(surgescript_object_t* entity_container, bool skip_inactive_entities, void (*callback)(surgescript_objecthandle_t,void*), void* data)
+{
+    bool clip_to_roi = (0 == strcmp(surgescript_object_name(entity_container), "EntityContainer"));
+    select_active_entities(entity_container, skip_inactive_entities, clip_to_roi, callback, data);
+}
+
 /* constructor */
 surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -203,6 +223,12 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
         /* is the entity inside the region of interest? */
         if(is_entity_inside_roi(entity_manager, entity)) {
 
+            /* dormant entities are not updated until the EntityManager wakes them up */
+            if(entitymanager_is_entity_dormant(entity_manager, entity_handle)) {
+                surgescript_object_set_active(entity, false);
+                continue;
+            }
+
             /* the entity is active */
             surgescript_object_set_active(entity, true);
 
@@ -213,7 +239,7 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
             surgescript_object_traverse_tree_ex(entity, data, add_to_late_update_queue);
 
         }
-        else if(!surgescript_object_has_tag(entity, "disposable")) {
+        else if(!(entitymanager_get_entity_class(entity_manager, entity_handle) & OBJECTCLASS_DISPOSABLE)) {
 
             /* reset the entity */
             if(
@@ -231,7 +257,7 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
                     surgescript_transform_setposition2d(transform, spawn_point.x, spawn_point.y);
 
                     /* notify the entity and its descendants */
-                    surgescript_object_traverse_tree_ex(entity, "onReset", notify_entity);
+                    surgescript_object_traverse_tree_ex(entity, NULL, reset_entity);
 
                     /* put it to sleep */
                     entitymanager_set_entity_sleeping(entity_manager, entity_handle, true);
@@ -283,17 +309,18 @@ surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_va
         iterator_t* it = levelobjectcontainer_iterator(object);
         while(iterator_has_next(it)) {
             surgescript_object_t* entity = iterator_next(it);
+            surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
 
             /* skip deleted entities */
             if(surgescript_object_is_killed(entity))
                 continue;
 
             /* skip private entities */
-            else if(surgescript_object_has_tag(entity, "private"))
+            else if(entitymanager_get_entity_class(entity_manager, entity_handle) & OBJECTCLASS_PRIVATE)
                 continue;
 
             /* skip detached entities */
-            else if(surgescript_object_has_tag(entity, "detached"))
+            else if(entitymanager_get_entity_class(entity_manager, entity_handle) & OBJECTCLASS_DETACHED)
                 continue;
 
             /* skip entities that can be clipped */
@@ -325,9 +352,18 @@ surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_va
                 continue;
             }
 
-            /* skip inactive entities */
-            else if(!surgescript_object_is_active(entity))
+            /* skip inactive entities, but render the dormant ones */
+            else if(!surgescript_object_is_active(entity)) {
+                if(
+                    entitymanager_is_entity_dormant(entity_manager, entity_handle) && (
+                        !can_clip_entity(entity) ||
+                        (entitymanager_get_entity_class(entity_manager, entity_handle) & (OBJECTCLASS_AWAKE | OBJECTCLASS_DETACHED))
+                    )
+                )
+                    render_dormant_entity(entity, entitymanager_get_entity_class(entity_manager, entity_handle), flags);
+
                 continue;
+            }
 #if 0
             /* skip sleeping entities */
             else if(entitymanager_is_entity_sleeping(entity_manager, entity_handle))
@@ -336,7 +372,7 @@ surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_va
             /* skip entities that can be clipped */
             if(
                 can_clip_entity(entity) &&
-                !(surgescript_object_has_tag(entity, "awake") || surgescript_object_has_tag(entity, "detached"))
+                !(entitymanager_get_entity_class(entity_manager, entity_handle) & (OBJECTCLASS_AWAKE | OBJECTCLASS_DETACHED))
             )
                 continue;
 
@@ -401,7 +437,7 @@ surgescript_var_t* fun_storeentity(surgescript_object_t* object, const surgescri
     surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
 
     /* we guarantee that only entities are stored in this container */
-    if(!surgescript_object_has_tag(entity, "entity")) {
+    if(!(scripting_util_object_class(entity) & OBJECTCLASS_ENTITY)) {
         const char* entity_name = surgescript_object_name(entity);
         const char* container_name = surgescript_object_name(object);
         scripting_error(object, "Can't store non-entity \"%s\" in a \"%s\"", entity_name, container_name);
@@ -467,13 +503,17 @@ surgescript_var_t* fun_bubbleupentities(surgescript_object_t* object, const surg
     /* for each entity */
     iterator_t* it = levelobjectcontainer_iterator(object);
     while(iterator_has_next(it)) {
-        const surgescript_object_t* entity = iterator_next(it);
+        surgescript_object_t* entity = iterator_next(it);
         surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
 
         /* skip entity? */
         if(surgescript_object_is_killed(entity))
             continue;
 
+        /* skip entities that haven't left the sector (e.g., static decorations) */
+        else if(entitytree_sector_contains_entity(sector, entity))
+            continue;
+
         /* call sector.bubbleUp(entity) */
         surgescript_var_set_objecthandle(arg, entity_handle);
         surgescript_object_call_function(sector, "bubbleUp", args, 1, NULL);
@@ -488,40 +528,12 @@ surgescript_var_t* fun_bubbleupentities(surgescript_object_t* object, const surg
 /* select all entities that should be processed and add them to the output array */
 surgescript_var_t* fun_selectactiveentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_object_t* entity_manager = get_entity_manager(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t output_array_handle = surgescript_var_get_objecthandle(param[0]);
     surgescript_object_t* output_array = surgescript_objectmanager_get(manager, output_array_handle);
-    surgescript_var_t* arg = surgescript_var_create();
-    const surgescript_var_t* args[] = { arg };
     bool skip_inactive_entities = surgescript_var_get_bool(param[1]);
 
-    /* for each entity */
-    iterator_t* it = levelobjectcontainer_iterator(object);
-    while(iterator_has_next(it)) {
-        surgescript_object_t* entity = iterator_next(it);
-        surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
-
-        /* skip entity? */
-        if(surgescript_object_is_killed(entity))
-            continue;
-
-        /* skip inactive entities */
-        else if(skip_inactive_entities && !surgescript_object_is_active(entity))
-            continue;
-
-        /* clip it out? */
-        else if(!is_entity_inside_roi(entity_manager, entity))
-            continue;
-
-        /* add the entity to the output array */
-        surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(output_array, "push", args, 1, NULL);
-    }
-    iterator_destroy(it);
-
-    /* done */
-    surgescript_var_destroy(arg);
+    select_active_entities(object, skip_inactive_entities, true, push_to_array, output_array);
     return NULL;
 }
 
@@ -570,6 +582,12 @@ surgescript_var_t* fun_awake_main(surgescript_object_t* object, const surgescrip
             continue;
         }
 
+        /* dormant entities are not updated until the EntityManager wakes them up */
+        if(entitymanager_is_entity_dormant(entity_manager, entity_handle)) {
+            surgescript_object_set_active(entity, false);
+            continue;
+        }
+
         /* the entity must be active */
         surgescript_object_set_active(entity, true);
 
@@ -594,30 +612,9 @@ surgescript_var_t* fun_awake_selectactiveentities(surgescript_object_t* object,
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
     surgescript_objecthandle_t output_array_handle = surgescript_var_get_objecthandle(param[0]);
     surgescript_object_t* output_array = surgescript_objectmanager_get(manager, output_array_handle);
-    surgescript_var_t* arg = surgescript_var_create();
-    const surgescript_var_t* args[] = { arg };
     bool skip_inactive_entities = surgescript_var_get_bool(param[1]);
 
-    /* for each entity */
-    iterator_t* it = levelobjectcontainer_iterator(object);
-    while(iterator_has_next(it)) {
-        surgescript_object_t* entity = iterator_next(it);
-        surgescript_objecthandle_t entity_handle = surgescript_object_handle(entity);
-
-        /* skip entity? */
-        if(surgescript_object_is_killed(entity))
-            continue;
-        else if(skip_inactive_entities && !surgescript_object_is_active(entity))
-            continue;
-
-        /* add entity to the output array */
-        surgescript_var_set_objecthandle(arg, entity_handle);
-        surgescript_object_call_function(output_array, "push", args, 1, NULL);
-    }
-    iterator_destroy(it);
-
-    /* done */
-    surgescript_var_destroy(arg);
+    select_active_entities(object, skip_inactive_entities, false, push_to_array, output_array);
     return NULL;
 }
 
@@ -838,11 +835,11 @@ bool render_subtree_faster(surgescript_object_t* object, void* data)
 {
     /* save processing time:
        renderables must be direct children of entities or entities themselves */
-    if(!(
-        surgescript_object_has_tag(object, "entity")
-     || surgescript_object_has_tag(object, "renderable")
-    /*|| surgescript_object_has_tag(object, "gizmo")*/
-    ))
+    if(!(scripting_util_object_class(object) & (
+        OBJECTCLASS_ENTITY
+     | OBJECTCLASS_RENDERABLE
+    /*| OBJECTCLASS_GIZMO*/
+    )))
         return false;
 
     return render_subtree(object, data);
@@ -852,18 +849,20 @@ bool render_subtree(surgescript_object_t* object, void* data)
 {
     int flags = *((int*)data);
     bool want_gizmos = (0 != (flags & RENDERFLAGS_WANT_GIZMOS));
+    uint32_t object_class;
 
     /* skip inactive objects */
     if(!surgescript_object_is_active(object) || surgescript_object_is_killed(object))
         return false;
 
     /* will render objects tagged "renderable" */
-    if(surgescript_object_has_tag(object, "renderable"))
+    object_class = scripting_util_object_class(object);
+    if(object_class & OBJECTCLASS_RENDERABLE)
         renderqueue_enqueue_ssobject(object);
 
     /* will render objects tagged "gizmo" */
     if(want_gizmos) {
-        if(surgescript_object_has_tag(object, "gizmo"))
+        if(object_class & OBJECTCLASS_GIZMO)
             renderqueue_enqueue_ssobject_gizmo(object);
     }
 
@@ -871,17 +870,40 @@ bool render_subtree(surgescript_object_t* object, void* data)
     return true;
 }
 
+void render_dormant_entity(surgescript_object_t* entity, uint32_t object_class, int flags)
+{
+    /* a dormant entity is inactive, but it's still visible */
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity);
+    bool want_gizmos = (0 != (flags & RENDERFLAGS_WANT_GIZMOS));
+
+    /* render the entity itself */
+    if(object_class & OBJECTCLASS_RENDERABLE)
+        renderqueue_enqueue_ssobject(entity);
+    if(want_gizmos && (object_class & OBJECTCLASS_GIZMO))
+        renderqueue_enqueue_ssobject_gizmo(entity);
+
+    /* render its children, which are still active */
+    int child_count = surgescript_object_child_count(entity);
+    for(int i = 0; i < child_count; i++) {
+        surgescript_objecthandle_t child_handle = surgescript_object_nth_child(entity, i);
+        surgescript_object_t* child = surgescript_objectmanager_get(manager, child_handle);
+        surgescript_object_traverse_tree_ex(child, &flags, want_gizmos ? render_subtree : render_subtree_faster);
+    }
+}
+
 bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* data)
 {
+    uint32_t object_class = scripting_util_object_class(entity_or_component);
+
     /* skip if the object is not an entity */
-    if(!surgescript_object_has_tag(entity_or_component, "entity"))
+    if(!(object_class & OBJECTCLASS_ENTITY))
         return false; /* save processing time; entities that are descendants of non-entities will be skipped */
 
     /* the object is an entity */
     const surgescript_object_t* entity = entity_or_component;
 
     /* does this entity implement lateUpdate() ? */
-    if(surgescript_object_has_function(entity, "lateUpdate")) {
+    if(object_class & OBJECTCLASS_HAS_LATEUPDATE) {
 
         /* get data */
         surgescript_object_t* entity_manager = (surgescript_object_t*)(((void**)data)[0]);
@@ -899,12 +921,48 @@ bool add_to_late_update_queue(surgescript_object_t* entity_or_component, void* d
     return true;
 }
 
+void select_active_entities(surgescript_object_t* entity_container, bool skip_inactive_entities, bool clip_to_roi, void (*callback)(surgescript_objecthandle_t,void*), void* data)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(entity_container);
+
+    /* for each entity */
+    iterator_t* it = levelobjectcontainer_iterator(entity_container);
+    while(iterator_has_next(it)) {
+        surgescript_object_t* entity = iterator_next(it);
+
+        /* skip entity? */
+        if(surgescript_object_is_killed(entity))
+            continue;
+
+        /* skip inactive entities */
+        else if(skip_inactive_entities && !surgescript_object_is_active(entity))
+            continue;
+
+        /* clip it out? */
+        else if(clip_to_roi && !is_entity_inside_roi(entity_manager, entity))
+            continue;
+
+        /* select the entity */
+        callback(surgescript_object_handle(entity), data);
+    }
+    iterator_destroy(it);
+}
+
+void push_to_array(surgescript_objecthandle_t entity_handle, void* array)
+{
+    surgescript_var_t* arg = surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
+    const surgescript_var_t* args[] = { arg };
+
+    surgescript_object_call_function((surgescript_object_t*)array, "push", args, 1, NULL);
+    surgescript_var_destroy(arg);
+}
+
 bool notify_entity(surgescript_object_t* entity_or_component, void* data)
 {
     const char* fun_name = (const char*)data;
 
     /* skip if not entity */
-    if(!surgescript_object_has_tag(entity_or_component, "entity"))
+    if(!(scripting_util_object_class(entity_or_component) & OBJECTCLASS_ENTITY))
         return false; /* save processing time; entities that are descendants of non-entities will be skipped */
 
     /* notify the entity if there is such a function */
@@ -916,6 +974,22 @@ bool notify_entity(surgescript_object_t* entity_or_component, void* data)
     return true;
 }
 
+bool reset_entity(surgescript_object_t* entity_or_component, void* data)
+{
+    uint32_t object_class = scripting_util_object_class(entity_or_component);
+
+    /* skip if not entity */
+    if(!(object_class & OBJECTCLASS_ENTITY))
+        return false;
+
+    /* call onReset() if the entity implements it */
+    if(object_class & OBJECTCLASS_HAS_ONRESET)
+        surgescript_object_call_function(entity_or_component, "onReset", NULL, 0, NULL);
+
+    /* continue iteration */
+    return true;
+}
+
 v2d_t entity_position(surgescript_object_t* entity)
 {
     const surgescript_transform_t* transform = surgescript_object_transform(entity);
@@ -45,20 +45,26 @@
 #include "scripting.h"
 #include "../core/logfile.h"
 #include "../core/video.h"
+#include "../core/timer.h"
 #include "../util/v2d.h"
 #include "../util/darray.h"
 #include "../util/util.h"
 #include "../util/stringutil.h"
 #include "../util/iterator.h"
+#include "../util/djb2.h"
 #include "../scenes/level.h"
 
 typedef struct entityinfo_t entityinfo_t;
 struct entityinfo_t {
     surgescript_objecthandle_t handle; /* hash key: SurgeScript object */
     uint64_t id; /* uniquely identifies the entity in the Level */
+    uint32_t object_class; /* OBJECTCLASS_* flags, computed at spawn time */
     v2d_t spawn_point; /* spawn point */
     bool is_persistent; /* usually placed via level editor; will be saved in the .lev file */
     bool is_sleeping; /* sleeping / inactive? */
+    bool is_dormant; /* put to sleep by the scheduler? dormant entities are not updated, even if inside the ROI */
+    double wakeup_time; /* if positive, a dormant entity wakes up at this time of the EntityManager clock, in seconds */
+    uint64_t wakeup_event; /* if non-zero, a dormant entity wakes up when this event (djb2 hash of its name) fires */
 };
 
 typedef struct entitydb_t entitydb_t;
@@ -80,8 +86,16 @@ struct entitydb_t {
     /* brick-like objects */
     DARRAY(surgescript_objecthandle_t, bricklike_objects);
 
-    /* space partitioning flag */
+    /* active entities */
+    DARRAY(surgescript_objecthandle_t, active_entities); /* selected natively */
+
+    /* dormant entities */
+    DARRAY(surgescript_objecthandle_t, dormant_entities);
+    double time; /* seconds; advanced only when the EntityManager is updated, so it stops when the game is paused */
+
+    /* space partitioning */
     bool dirty_partition;
+    DARRAY(surgescript_objecthandle_t, roi_containers); /* unawake containers inside the ROI; native copy of the unawake container array */
 
 };
 
@@ -103,10 +117,11 @@ bool entitymanager_is_entity_persistent(surgescript_object_t* entity_manager, su
 void entitymanager_set_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_persistent);
 bool entitymanager_is_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_sleeping);
+bool entitymanager_is_entity_dormant(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 bool entitymanager_is_inside_roi(surgescript_object_t* entity_manager, v2d_t position);
 void entitymanager_get_roi(surgescript_object_t* entity_manager, int* top, int* left, int* bottom, int* right);
 arrayiterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manager);
-ssarrayiterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager);
+arrayiterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager);
 
 /* SurgeScript API */
 static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -122,10 +137,15 @@ static surgescript_var_t* fun_entityid(surgescript_object_t* object, const surge
 static surgescript_var_t* fun_findentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_findentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_activeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_activeentitiesview(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setroi(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_addtolateupdatequeue(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_addbricklikeobject(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_notifyentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_sleepentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_sleepentityuntil(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_wakeentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_wakeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_isindebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_enterdebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_exitdebugmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -133,12 +153,21 @@ static surgescript_var_t* fun_getdebugmode(surgescript_object_t* object, const s
 static surgescript_var_t* fun_pausecontainers(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_resumecontainers(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getlevel(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_getlength(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_get(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_iterator(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_hasnext(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_view_next(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static const surgescript_heapptr_t AWAKEENTITYCONTAINER_ADDR = 0;
 static const surgescript_heapptr_t UNAWAKEENTITYCONTAINER_ADDR = 1;
 static const surgescript_heapptr_t DEBUGENTITYCONTAINER_ADDR = 2;
 static const surgescript_heapptr_t ENTITYTREE_ADDR = 3;
 static const surgescript_heapptr_t UNAWAKEENTITYCONTAINERARRAY_ADDR = 4;
 static const surgescript_heapptr_t NOTGARBAGECONTAINER_ADDR = 5;
+static const surgescript_heapptr_t ACTIVEENTITIESVIEW_ADDR = 6;
+static const surgescript_heapptr_t VIEWCURSOR_ADDR = 0; /* heap of ActiveEntitiesView */
 
 /* helpers */
 #define WANT_SPACE_PARTITIONING         1 /* whether or not to optimize unawake entities with space partitioning */
@@ -154,6 +183,16 @@ static bool is_in_debug_mode(surgescript_object_t* entity_manager);
 static void refresh_entity_tree(surgescript_object_t* entity_manager);
 static bool inspect_subtree(const surgescript_object_t* root, bool is_root_entity, const surgescript_objectmanager_t* manager, surgescript_tagsystem_t* tag_system, int depth);
 static void prevent_garbage_collection(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
+static void select_active_entities(surgescript_object_t* entity_manager);
+static void select_active_entity(surgescript_objecthandle_t entity_handle, void* db);
+static void push_active_entities(surgescript_object_t* entity_manager, surgescript_object_t* array);
+static void put_to_sleep(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, double wakeup_time, uint64_t wakeup_event);
+static void wake_up(surgescript_object_t* entity_manager, int dormant_index);
+static void discard_dormant_entry(surgescript_object_t* entity_manager, int dormant_index);
+static void update_dormant_entities(surgescript_object_t* entity_manager);
+static bool poll_colliders(surgescript_object_t* entity);
+static entitydb_t* view_db(surgescript_object_t* view);
+static surgescript_var_t* view_at(surgescript_object_t* view, double index);
 
 
 
@@ -181,7 +220,12 @@ void scripting_register_entitymanager(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "EntityManager", "findEntity", fun_findentity, 1);
     surgescript_vm_bind(vm, "EntityManager", "findEntities", fun_findentities, 1);
     surgescript_vm_bind(vm, "EntityManager", "activeEntities", fun_activeentities, 0);
+    surgescript_vm_bind(vm, "EntityManager", "activeEntitiesView", fun_activeentitiesview, 0);
     surgescript_vm_bind(vm, "EntityManager", "notifyEntities", fun_notifyentities, 1);
+    surgescript_vm_bind(vm, "EntityManager", "sleepEntity", fun_sleepentity, 2);
+    surgescript_vm_bind(vm, "EntityManager", "sleepEntityUntil", fun_sleepentityuntil, 2);
+    surgescript_vm_bind(vm, "EntityManager", "wakeEntity", fun_wakeentity, 1);
+    surgescript_vm_bind(vm, "EntityManager", "wakeEntities", fun_wakeentities, 1);
 
     surgescript_vm_bind(vm, "EntityManager", "isInDebugMode", fun_isindebugmode, 0);
     surgescript_vm_bind(vm, "EntityManager", "enterDebugMode", fun_enterdebugmode, 0);
@@ -192,8 +236,84 @@ void scripting_register_entitymanager(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "EntityManager", "resumeContainers", fun_resumecontainers, 0);
 
     surgescript_vm_bind(vm, "EntityManager", "get_level", fun_getlevel, 0);
+
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "state:main", fun_view_main, 0);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "constructor", fun_view_constructor, 0);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "get_length", fun_view_getlength, 0);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "get", fun_view_get, 1);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "iterator", fun_view_iterator, 0);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "hasNext", fun_view_hasnext, 0);
+    surgescript_vm_bind(vm, "ActiveEntitiesView", "next", fun_view_next, 0);
+}
+
+
+/* ActiveEntitiesView: a read-only view of the current selection of active
+   entities of its parent EntityManager. It's an iterable collection, but
+   it's also its own iterator, so don't nest loops over it */
+
+/* main state */
+surgescript_var_t* fun_view_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return NULL;
+}
+
+/* constructor */
+surgescript_var_t* fun_view_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+
+    ssassert(VIEWCURSOR_ADDR == surgescript_heap_malloc(heap));
+    surgescript_var_set_number(surgescript_heap_at(heap, VIEWCURSOR_ADDR), 0);
+
+    return NULL;
+}
+
+/* the number of active entities in the view */
+surgescript_var_t* fun_view_getlength(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    entitydb_t* db = view_db(object);
+    return surgescript_var_set_number(surgescript_var_create(), darray_length(db->active_entities));
+}
+
+/* get(index): the index-th active entity, or null if the index is out of
+   bounds or if the entity has been destroyed since the selection */
+surgescript_var_t* fun_view_get(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    double index = surgescript_var_get_number(param[0]);
+    return view_at(object, index);
+}
+
+/* get an iterator, i.e., the view itself, positioned at the first entity */
+surgescript_var_t* fun_view_iterator(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+
+    surgescript_var_set_number(surgescript_heap_at(heap, VIEWCURSOR_ADDR), 0);
+    return surgescript_var_set_objecthandle(surgescript_var_create(), surgescript_object_handle(object));
 }
 
+/* are there more entities to iterate over? */
+surgescript_var_t* fun_view_hasnext(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    entitydb_t* db = view_db(object);
+    int cursor = surgescript_var_get_number(surgescript_heap_at(heap, VIEWCURSOR_ADDR));
+
+    return surgescript_var_set_bool(surgescript_var_create(), cursor < darray_length(db->active_entities));
+}
+
+/* get the next entity of the iteration; it's null if the entity has been destroyed */
+surgescript_var_t* fun_view_next(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    surgescript_var_t* cursor_var = surgescript_heap_at(heap, VIEWCURSOR_ADDR);
+    double cursor = surgescript_var_get_number(cursor_var);
+
+    surgescript_var_set_number(cursor_var, cursor + 1);
+    return view_at(object, cursor);
+}
+
+
 
 
 
@@ -208,6 +328,12 @@ surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_
     /* clear the brick-like object list */
     darray_clear(db->bricklike_objects);
 
+    /* advance the clock */
+    db->time += timer_get_delta();
+
+    /* wake up the dormant entities whose time has come */
+    update_dormant_entities(object);
+
     /* FIXME: maybe we should update the awake & detached entities AFTER unawake ones?
        e.g., camera scripts. */
 
@@ -238,6 +364,10 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
 
     darray_init(db->late_update_queue);
     darray_init(db->bricklike_objects);
+    darray_init(db->active_entities);
+    darray_init(db->roi_containers);
+    darray_init(db->dormant_entities);
+    db->time = 0.0;
     db->dirty_partition = false;
 
     db->roi.left = 0;
@@ -254,6 +384,7 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
     ssassert(ENTITYTREE_ADDR == surgescript_heap_malloc(heap));
     ssassert(UNAWAKEENTITYCONTAINERARRAY_ADDR == surgescript_heap_malloc(heap));
     ssassert(NOTGARBAGECONTAINER_ADDR == surgescript_heap_malloc(heap));
+    ssassert(ACTIVEENTITIESVIEW_ADDR == surgescript_heap_malloc(heap));
 
     /* spawn the entity containers */
     surgescript_objecthandle_t this_handle = surgescript_object_handle(object);
@@ -283,6 +414,10 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
     surgescript_objecthandle_t notgarbage_container = surgescript_objectmanager_spawn(manager, this_handle, "PassiveLevelObjectContainer", scripting_levelobjectcontainer_token());
     surgescript_var_set_objecthandle(surgescript_heap_at(heap, NOTGARBAGECONTAINER_ADDR), notgarbage_container);
 
+    /* spawn a read-only view of the active entities */
+    surgescript_objecthandle_t active_entities_view = surgescript_objectmanager_spawn(manager, this_handle, "ActiveEntitiesView", NULL);
+    surgescript_var_set_objecthandle(surgescript_heap_at(heap, ACTIVEENTITIESVIEW_ADDR), active_entities_view);
+
     /* done */
     return NULL;
 }
@@ -293,6 +428,9 @@ surgescript_var_t* fun_destructor(surgescript_object_t* object, const surgescrip
     /* release the database */
     entitydb_t* db = get_db(object);
 
+    darray_release(db->dormant_entities);
+    darray_release(db->roi_containers);
+    darray_release(db->active_entities);
     darray_release(db->bricklike_objects);
     darray_release(db->late_update_queue);
 
@@ -392,17 +530,18 @@ surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescri
     surgescript_transform_t* transform = surgescript_object_transform(entity);
     surgescript_transform_setposition2d(transform, spawn_x, spawn_y); /* already in world space */
 
+    /* compute the capabilities of the class of the entity, if not yet computed */
+    uint32_t entity_class = scripting_util_object_class(entity);
+
     /* generate entity info */
     entityinfo_t* info = entityinfo_ctor((entityinfo_t) {
         .handle = entity_handle,
         .id = generate_entity_id(),
+        .object_class = entity_class,
         .spawn_point = spawn_point,
-        .is_sleeping = !(
-            surgescript_object_has_tag(entity, "awake") ||
-            surgescript_object_has_tag(entity, "detached")
-        ),
+        .is_sleeping = !(entity_class & (OBJECTCLASS_AWAKE | OBJECTCLASS_DETACHED)),
         .is_persistent = !(
-            surgescript_object_has_tag(entity, "private") ||
+            (entity_class & OBJECTCLASS_PRIVATE) ||
             /*surgescript_object_has_tag(entity, "detached") ||*/ /* if it's detached, it's private - see above */
             scripting_level_issetupobjectname(level, entity_name)
         )
@@ -414,10 +553,7 @@ surgescript_var_t* fun_spawnentity(surgescript_object_t* object, const surgescri
     fasthash_put(db->id_to_handle, info->id, handle_ctor(info->handle));
 
     /* decide the entity container: is the new entity awake or not? */
-    bool is_awake = (
-        surgescript_tagsystem_has_tag(tag_system, entity_name, "awake") ||
-        surgescript_tagsystem_has_tag(tag_system, entity_name, "detached")
-    );
+    bool is_awake = (0 != (entity_class & (OBJECTCLASS_AWAKE | OBJECTCLASS_DETACHED)));
     surgescript_objecthandle_t entity_container_handle = surgescript_var_get_objecthandle(
         is_awake ?
         surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR) :
@@ -574,36 +710,33 @@ surgescript_var_t* fun_findentities(surgescript_object_t* object, const surgescr
 /* get active entities: those that are inside the region of interest, as well as the awake (and detached) ones */
 surgescript_var_t* fun_activeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
-    surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-
-    /* selectActiveEntities() takes two parameters: object[] output_array, bool skip_inactive_objects */
-    bool skip_inactive_objects = !(level_editmode() || is_in_debug_mode(object));
     surgescript_objecthandle_t array_handle = surgescript_objectmanager_spawn_array(manager);
-    surgescript_var_t* array_var = surgescript_var_set_objecthandle(surgescript_var_create(), array_handle);
-    surgescript_var_t* skip_inactive_var = surgescript_var_set_bool(surgescript_var_create(), skip_inactive_objects);
-    const surgescript_var_t* args[] = { array_var, skip_inactive_var };
+    surgescript_object_t* array = surgescript_objectmanager_get(manager, array_handle);
 
-    /* get awake entities */
-    surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
-    surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
-    surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
-    surgescript_object_call_function(awake_container, "selectActiveEntities", args, 2, NULL);
+    /* select the active entities natively */
+    select_active_entities(object);
 
-#if WANT_SPACE_PARTITIONING
-    /* get unawakened active entities */
-    foreach_unawake_container_inside_roi(object, "selectActiveEntities", args, 2);
-#else
-    /* get unawakened active entities */
-    surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
-    surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
-    surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-    surgescript_object_call_function(unawake_container, "selectActiveEntities", args, 2, NULL);
-#endif
+    /* the scripts get a fresh array, which they may modify */
+    push_active_entities(object, array);
 
     /* done */
-    surgescript_var_destroy(skip_inactive_var);
-    return array_var;
+    return surgescript_var_set_objecthandle(surgescript_var_create(), array_handle);
+}
+
+/* get active entities without allocating: selects them and returns a read-only
+   view of the selection, which is valid until the next selection. Prefer this
+   over activeEntities() in code that runs every frame */
+surgescript_var_t* fun_activeentitiesview(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    surgescript_var_t* view_var = surgescript_heap_at(heap, ACTIVEENTITIESVIEW_ADDR);
+
+    /* select the active entities natively */
+    select_active_entities(object);
+
+    /* return the view */
+    return surgescript_var_clone(view_var);
 }
 
 /* set the current region of interest (x, y, width, height) in world coordinates */
@@ -729,6 +862,67 @@ surgescript_var_t* fun_notifyentities(surgescript_object_t* object, const surges
     return NULL;
 }
 
+/* put an entity to sleep: it won't be updated until the given number of seconds
+   have passed or until one of its colliders touches something. If seconds <= 0,
+   the entity sleeps until it's woken up by a collision or by wakeEntity() */
+surgescript_var_t* fun_sleepentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    entitydb_t* db = get_db(object);
+    surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(param[0]);
+    double seconds = surgescript_var_get_number(param[1]);
+    double wakeup_time = seconds > 0.0 ? db->time + seconds : 0.0;
+
+    put_to_sleep(object, entity_handle, wakeup_time, 0);
+    return NULL;
+}
+
+/* put an entity to sleep until the given event is fired with wakeEntities(),
+   or until one of its colliders touches something */
+surgescript_var_t* fun_sleepentityuntil(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(param[0]);
+    const char* event_name = surgescript_var_fast_get_string(param[1]);
+    uint64_t wakeup_event = djb2(event_name);
+
+    put_to_sleep(object, entity_handle, 0.0, wakeup_event != 0 ? wakeup_event : 1);
+    return NULL;
+}
+
+/* wake up an entity that was put to sleep */
+surgescript_var_t* fun_wakeentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    entitydb_t* db = get_db(object);
+    surgescript_objecthandle_t entity_handle = surgescript_var_get_objecthandle(param[0]);
+
+    for(int i = darray_length(db->dormant_entities) - 1; i >= 0; i--) {
+        if(db->dormant_entities[i] == entity_handle) {
+            wake_up(object, i);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* fire an event: wake up all entities that sleep until the given event */
+surgescript_var_t* fun_wakeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    entitydb_t* db = get_db(object);
+    const char* event_name = surgescript_var_fast_get_string(param[0]);
+    uint64_t event = djb2(event_name);
+
+    if(event == 0)
+        event = 1;
+
+    for(int i = darray_length(db->dormant_entities) - 1; i >= 0; i--) {
+        const entityinfo_t* info = get_info(db, db->dormant_entities[i]);
+        if(info != NULL && info->wakeup_event == event)
+            wake_up(object, i);
+    }
+
+    return NULL;
+}
+
 /* render the entities */
 surgescript_var_t* fun_render(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -890,6 +1084,16 @@ void entitymanager_remove_entity_info(surgescript_object_t* entity_manager, surg
         entitydb_t* db = get_db(entity_manager);
         uint64_t entity_id = info->id;
 
+        /* the handle may be reused; don't keep it in the list of dormant entities */
+        if(info->is_dormant) {
+            for(int i = darray_length(db->dormant_entities) - 1; i >= 0; i--) {
+                if(db->dormant_entities[i] == entity_handle) {
+                    discard_dormant_entry(entity_manager, i);
+                    break;
+                }
+            }
+        }
+
         fasthash_delete(db->id_to_handle, entity_id);
         fasthash_delete(db->info, entity_handle);
     }
@@ -919,6 +1123,20 @@ void entitymanager_set_entity_id(surgescript_object_t* entity_manager, surgescri
     }
 }
 
+/* get the OBJECTCLASS_* flags of an entity without hashing its name */
+uint32_t entitymanager_get_entity_class(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle)
+{
+    entityinfo_t* info = quick_lookup(entity_manager, entity_handle);
+
+    /* the entity info is missing */
+    if(info == NULL) {
+        surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+        return scripting_util_object_class(surgescript_objectmanager_get(manager, entity_handle));
+    }
+
+    return info->object_class;
+}
+
 /* get the spawn point of an entity */
 v2d_t entitymanager_get_entity_spawn_point(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle)
 {
@@ -956,6 +1174,20 @@ void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, sur
         info->is_sleeping = is_sleeping;
 }
 
+/* is the entity dormant, i.e., put to sleep by the scheduler? */
+bool entitymanager_is_entity_dormant(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle)
+{
+    entitydb_t* db = get_db(entity_manager);
+    entityinfo_t* info;
+
+    /* this gotta be fast when there are no dormant entities */
+    if(darray_length(db->dormant_entities) == 0)
+        return false;
+
+    info = quick_lookup(entity_manager, entity_handle);
+    return info != NULL && info->is_dormant;
+}
+
 /* find entity by ID. This may return a null handle! */
 surgescript_objecthandle_t entitymanager_find_entity_by_id(surgescript_object_t* entity_manager, uint64_t entity_id)
 {
@@ -1011,24 +1243,19 @@ iterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manage
 }
 
 /* create an iterator for iterating over the collection of (handles of) active entities
-   (i.e., awake, inside the ROI...) */
+   (i.e., awake, inside the ROI...). The elements are of type surgescript_objecthandle_t */
 iterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager)
 {
-    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
-
-    /* call entityManager.activeEntities(), which returns a temporary SurgeScript Array */
-    surgescript_var_t* ret = surgescript_var_create();
-    surgescript_object_call_function(entity_manager, "activeEntities", NULL, 0, ret);
-    surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(ret);
-    surgescript_var_destroy(ret);
+    entitydb_t* db = get_db(entity_manager);
 
-    /* sanity check */
-    if(!surgescript_objectmanager_exists(manager, array_handle))
-        return iterator_create_from_array(NULL, 0, 0); /* empty */
+    /* select the active entities without creating a SurgeScript Array */
+    select_active_entities(entity_manager);
 
-    /* iterate over the temporary SurgeScript Array */
-    surgescript_object_t* array = surgescript_objectmanager_get(manager, array_handle);
-    return iterator_create_from_disposable_surgescript_array(array);
+    return iterator_create_from_array(
+        db->active_entities,
+        darray_length(db->active_entities),
+        sizeof *(db->active_entities)
+    );
 }
 
 
@@ -1059,25 +1286,16 @@ entityinfo_t* quick_lookup(surgescript_object_t* entity_manager, surgescript_obj
 /* calls a function on each unawake container inside the region of interest */
 void foreach_unawake_container_inside_roi(surgescript_object_t* entity_manager, const char* fun_name, const surgescript_var_t** param, int num_params)
 {
-    surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
     surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
-
-    /* get the array of unawake containers inside the ROI */
-    surgescript_var_t* array_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINERARRAY_ADDR);
-    surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(array_var);
-    surgescript_object_t* array = surgescript_objectmanager_get(manager, array_handle);
+    entitydb_t* db = get_db(entity_manager);
 
     /* for each unawake container */
-    iterator_t* it = iterator_create_from_surgescript_array(array);
-    while(iterator_has_next(it)) {
-        surgescript_var_t** container_var = iterator_next(it);
-        surgescript_objecthandle_t container_handle = surgescript_var_get_objecthandle(*container_var);
-        surgescript_object_t* container = surgescript_objectmanager_get(manager, container_handle);
+    for(int i = 0; i < darray_length(db->roi_containers); i++) {
+        surgescript_object_t* container = surgescript_objectmanager_get(manager, db->roi_containers[i]);
 
         /* call function */
         surgescript_object_call_function(container, fun_name, param, num_params, NULL);
     }
-    iterator_destroy(it);
 }
 
 /* calls a function on all unawake containers */
@@ -1176,15 +1394,10 @@ void refresh_entity_tree(surgescript_object_t* entity_manager)
     surgescript_object_t* unawake_container_array = surgescript_objectmanager_get(manager, unawake_container_array_handle);
 
     /* bubble up entities (from the previous update cycle) */
-    iterator_t* it = iterator_create_from_surgescript_array(unawake_container_array);
-    while(iterator_has_next(it)) {
-        surgescript_var_t** unawake_container_var = iterator_next(it);
-        surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(*unawake_container_var);
-        surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
-
+    for(int i = 0; i < darray_length(db->roi_containers); i++) {
+        surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, db->roi_containers[i]);
         surgescript_object_call_function(unawake_container, "bubbleUpEntities", NULL, 0, NULL);
     }
-    iterator_destroy(it);
 
     /* update the size of the world */
     v2d_t world_size = level_size();
@@ -1206,18 +1419,31 @@ void refresh_entity_tree(surgescript_object_t* entity_manager)
     surgescript_var_destroy(world_height_var);
     surgescript_var_destroy(world_width_var);
 
-    /* clear the unawake entity container array */
-    surgescript_object_call_function(unawake_container_array, "clear", NULL, 0, NULL);
-
-    /* update the ROI of the entity tree, as well as the unawake container array */
+    /* update the ROI of the entity tree, as well as the unawake container array.
+       The array is left untouched if the ROI intersects the same sectors as before */
     surgescript_var_t* output_array_var = surgescript_var_clone(unawake_container_array_var);
     surgescript_var_t* top_var = surgescript_var_set_number(surgescript_var_create(), db->roi.top);
     surgescript_var_t* left_var = surgescript_var_set_number(surgescript_var_create(), db->roi.left);
     surgescript_var_t* bottom_var = surgescript_var_set_number(surgescript_var_create(), db->roi.bottom);
     surgescript_var_t* right_var = surgescript_var_set_number(surgescript_var_create(), db->roi.right);
 
+    surgescript_var_t* roi_containers_have_changed = surgescript_var_create();
     const surgescript_var_t* args[] = { output_array_var, top_var, left_var, bottom_var, right_var };
-    surgescript_object_call_function(entity_tree, "updateROI", args, 5, NULL);
+    surgescript_object_call_function(entity_tree, "updateROI", args, 5, roi_containers_have_changed);
+
+    /* copy the unawake container array to native storage only if it has changed */
+    if(surgescript_var_get_bool(roi_containers_have_changed)) {
+        darray_clear(db->roi_containers);
+
+        iterator_t* it = iterator_create_from_surgescript_array(unawake_container_array);
+        while(iterator_has_next(it)) {
+            surgescript_var_t** unawake_container_var = iterator_next(it);
+            darray_push(db->roi_containers, surgescript_var_get_objecthandle(*unawake_container_var));
+        }
+        iterator_destroy(it);
+    }
+
+    surgescript_var_destroy(roi_containers_have_changed);
 
     surgescript_var_destroy(right_var);
     surgescript_var_destroy(bottom_var);
@@ -1329,4 +1555,205 @@ void prevent_garbage_collection(surgescript_object_t* entity_manager, surgescrip
     surgescript_var_t* param = surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
     surgescript_object_call_function(container, "addObject", (const surgescript_var_t*[]){ param }, 1, NULL);
     surgescript_var_destroy(param);
-}
\ No newline at end of file
+}
+
+/* select the active entities natively, storing their handles in db->active_entities */
+void select_active_entities(surgescript_object_t* entity_manager)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(entity_manager);
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    bool skip_inactive_entities = !(level_editmode() || is_in_debug_mode(entity_manager));
+    entitydb_t* db = get_db(entity_manager);
+
+    /* clear the previous selection */
+    darray_clear(db->active_entities);
+
+    /* get awake entities */
+    surgescript_var_t* awake_container_var = surgescript_heap_at(heap, AWAKEENTITYCONTAINER_ADDR);
+    surgescript_objecthandle_t awake_container_handle = surgescript_var_get_objecthandle(awake_container_var);
+    surgescript_object_t* awake_container = surgescript_objectmanager_get(manager, awake_container_handle);
+    entitycontainer_select_active_entities(awake_container, skip_inactive_entities, select_active_entity, db);
+
+#if WANT_SPACE_PARTITIONING
+    /* get unawakened active entities */
+    for(int i = 0; i < darray_length(db->roi_containers); i++) {
+        surgescript_object_t* container = surgescript_objectmanager_get(manager, db->roi_containers[i]);
+        entitycontainer_select_active_entities(container, skip_inactive_entities, select_active_entity, db);
+    }
+#else
+    /* get unawakened active entities */
+    surgescript_var_t* unawake_container_var = surgescript_heap_at(heap, UNAWAKEENTITYCONTAINER_ADDR);
+    surgescript_objecthandle_t unawake_container_handle = surgescript_var_get_objecthandle(unawake_container_var);
+    surgescript_object_t* unawake_container = surgescript_objectmanager_get(manager, unawake_container_handle);
+    entitycontainer_select_active_entities(unawake_container, skip_inactive_entities, select_active_entity, db);
+#endif
+}
+
+/* callback of select_active_entities() */
+void select_active_entity(surgescript_objecthandle_t entity_handle, void* db)
+{
+    darray_push(((entitydb_t*)db)->active_entities, entity_handle);
+}
+
+/* push the current selection of active entities to a SurgeScript Array */
+void push_active_entities(surgescript_object_t* entity_manager, surgescript_object_t* array)
+{
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_var_t* arg = surgescript_var_create();
+    const surgescript_var_t* args[] = { arg };
+
+    for(int i = 0; i < darray_length(db->active_entities); i++) {
+        surgescript_var_set_objecthandle(arg, db->active_entities[i]);
+        surgescript_object_call_function(array, "push", args, 1, NULL);
+    }
+
+    surgescript_var_destroy(arg);
+}
+
+/* put an entity to sleep. Dormant entities are not updated by the containers */
+void put_to_sleep(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, double wakeup_time, uint64_t wakeup_event)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    entitydb_t* db = get_db(entity_manager);
+    entityinfo_t* info = quick_lookup(entity_manager, entity_handle);
+
+    /* validate */
+    if(info == NULL || !surgescript_objectmanager_exists(manager, entity_handle))
+        return;
+
+    /* add to the list of dormant entities */
+    if(!info->is_dormant)
+        darray_push(db->dormant_entities, entity_handle);
+
+    /* set the wake-up condition */
+    info->is_dormant = true;
+    info->wakeup_time = wakeup_time;
+    info->wakeup_event = wakeup_event;
+
+    /* deactivate the entity */
+    surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
+    surgescript_object_set_active(entity, false);
+}
+
+/* wake up the dormant entity stored at the given index. The entity will be
+   reactivated by its container in the next frame, if it's inside the ROI */
+void wake_up(surgescript_object_t* entity_manager, int dormant_index)
+{
+    entitydb_t* db = get_db(entity_manager);
+    surgescript_objecthandle_t entity_handle = db->dormant_entities[dormant_index];
+    entityinfo_t* info = get_info(db, entity_handle);
+
+    /* clear the wake-up condition */
+    if(info != NULL) {
+        info->is_dormant = false;
+        info->wakeup_time = 0.0;
+        info->wakeup_event = 0;
+    }
+
+    /* remove from the list */
+    discard_dormant_entry(entity_manager, dormant_index);
+}
+
+/* remove the entry stored at the given index from the list of dormant entities */
+void discard_dormant_entry(surgescript_object_t* entity_manager, int dormant_index)
+{
+    entitydb_t* db = get_db(entity_manager);
+
+    /* swap-remove; order doesn't matter */
+    int last = darray_length(db->dormant_entities) - 1;
+    db->dormant_entities[dormant_index] = db->dormant_entities[last];
+    darray_remove(db->dormant_entities, last);
+}
+
+/* wake up the dormant entities whose timer has expired or whose colliders touch something */
+void update_dormant_entities(surgescript_object_t* entity_manager)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity_manager);
+    entitydb_t* db = get_db(entity_manager);
+    double now = db->time;
+
+    for(int i = darray_length(db->dormant_entities) - 1; i >= 0; i--) {
+        surgescript_objecthandle_t entity_handle = db->dormant_entities[i];
+        const entityinfo_t* info = get_info(db, entity_handle);
+
+        /* discard entities that no longer exist */
+        if(info == NULL || !surgescript_objectmanager_exists(manager, entity_handle)) {
+            wake_up(entity_manager, i);
+            continue;
+        }
+
+        /* discard stale entries */
+        if(!info->is_dormant) {
+            discard_dormant_entry(entity_manager, i);
+            continue;
+        }
+
+        surgescript_object_t* entity = surgescript_objectmanager_get(manager, entity_handle);
+        if(surgescript_object_is_killed(entity)) {
+            wake_up(entity_manager, i);
+            continue;
+        }
+
+        /* has the timer expired? */
+        if(info->wakeup_time > 0.0 && now >= info->wakeup_time) {
+            wake_up(entity_manager, i);
+            continue;
+        }
+
+        /* poll the colliders only if the entity could be updated if it were awake */
+        if(0 == (scripting_util_object_class(entity) & (OBJECTCLASS_AWAKE | OBJECTCLASS_DETACHED))) {
+            if(!entitymanager_is_inside_roi(entity_manager, scripting_util_world_position(entity)))
+                continue;
+        }
+
+        /* did a collider touch something? */
+        if(poll_colliders(entity))
+            wake_up(entity_manager, i);
+    }
+}
+
+/* polls the colliders that are direct children of a dormant entity.
+   Returns true if any of them is in contact with another collider */
+bool poll_colliders(surgescript_object_t* entity)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(entity);
+    int child_count = surgescript_object_child_count(entity);
+    bool is_colliding = false;
+
+    for(int i = 0; i < child_count; i++) {
+        surgescript_objecthandle_t child_handle = surgescript_object_nth_child(entity, i);
+        surgescript_object_t* child = surgescript_objectmanager_get(manager, child_handle);
+
+        /* we don't stop early: all colliders must be registered in the CollisionManager */
+        if(scripting_collider_poll(child))
+            is_colliding = true;
+    }
+
+    return is_colliding;
+}
+
+/* the database of the EntityManager that owns an ActiveEntitiesView */
+entitydb_t* view_db(surgescript_object_t* view)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(view);
+    surgescript_objecthandle_t entity_manager_handle = surgescript_object_parent(view);
+    surgescript_object_t* entity_manager = surgescript_objectmanager_get(manager, entity_manager_handle);
+
+    return get_db(entity_manager);
+}
+
+/* the index-th entity of an ActiveEntitiesView, or NULL if the index is
+   out of bounds or if the entity has been destroyed since the selection */
+surgescript_var_t* view_at(surgescript_object_t* view, double index)
+{
+    surgescript_objectmanager_t* manager = surgescript_object_manager(view);
+    entitydb_t* db = view_db(view);
+
+    if(index >= 0.0 && index < darray_length(db->active_entities)) {
+        surgescript_objecthandle_t entity_handle = db->active_entities[(int)index];
+        if(surgescript_objectmanager_exists(manager, entity_handle))
+            return surgescript_var_set_objecthandle(surgescript_var_create(), entity_handle);
+    }
+
+    return NULL;
+}
@@ -500,6 +500,9 @@ struct sector_t
     const sectorvtable_t* vt;
     int flags;
 
+    sector_t* root; /* the root sector of the tree */
+    sectorrect_t leaf_span; /* root only: leaf sectors (columns & rows) that intersected the ROI last time */
+
     int cached_world_width;
     int cached_world_height;
     sectorrect_t cached_rect; /* depends on the size of the world */
@@ -515,6 +518,7 @@ struct sector_t
 /* sector flags */
 #define SECTOR_HAS_SUBSECTOR(quadrant)  (1 << (quadrant)) /* quadrant = 0, 1, 2, 3 */
 #define SECTOR_IS_LEAF                  (1 << 4)
+#define SECTOR_IS_DIRTY                 (1 << 5) /* root only: the intersecting leaf sectors must be searched again */
 
 /* sector helpers */
 static sector_t* sector_ctor(int index, int world_width, int world_height);
@@ -525,6 +529,8 @@ static sectorrect_t find_sector_rect(sectoraddr_t addr, int world_width, int wor
 static inline bool disjoint_rects(sectorrect_t a, sectorrect_t b);
 static inline bool point_belongs_to_rect(sectorrect_t r, int x, int y);
 static inline bool is_leaf_sector(int index);
+static sectorrect_t find_leaf_span(sectorrect_t roi, int world_width, int world_height);
+static int find_leaf_coordinate(int x, int length);
 
 
 
@@ -555,6 +561,9 @@ static inline sector_t* safe_get_sector(surgescript_object_t* tree_node);
 static surgescript_objecthandle_t spawn_child(surgescript_object_t* object, sectorquadrant_t quadrant);
 static v2d_t get_clipped_position(surgescript_object_t* entity, float world_width, float world_height);
 
+/* C API */
+bool entitytree_sector_contains_entity(surgescript_object_t* tree_node, surgescript_object_t* entity);
+
 static const sectorvtable_t LEAF_VTABLE = {
     .bubble_up = fun_leaf_bubbleup,
     .bubble_down = fun_leaf_bubbledown,
@@ -602,6 +611,19 @@ void scripting_register_entitytree(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "EntityTreeLeaf", "updateWorldSize", fun_leaf_updateworldsize, 2);
 }
 
+/*
+ * entitytree_sector_contains_entity()
+ * Checks if the position of the entity belongs to the sector of a node of the
+ * Entity Tree. If it does, calling bubbleUp(entity) on that node is unnecessary
+ */
+bool entitytree_sector_contains_entity(surgescript_object_t* tree_node, surgescript_object_t* entity)
+{
+    const sector_t* sector = safe_get_sector(tree_node);
+    v2d_t entity_position = get_clipped_position(entity, sector->cached_world_width, sector->cached_world_height);
+
+    return point_belongs_to_rect(sector->cached_rect, entity_position.x, entity_position.y);
+}
+
 /* constructor of a non-leaf node */
 surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -876,12 +898,13 @@ surgescript_var_t* fun_bubbledown(surgescript_object_t* object, const surgescrip
     return NULL;
 }
 
-/* non-leaf-variant of updateROI: find intersecting leaf sectors and put nodes to sleep */
+/* non-leaf-variant of updateROI: find intersecting leaf sectors and put nodes to sleep.
+   When called on the root, the output array is cleared and refilled only if the set of
+   intersecting leaf sectors may have changed; returns true in that case, false otherwise */
 surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
     surgescript_heap_t* heap = surgescript_object_heap(object);
     surgescript_objectmanager_t* manager = surgescript_object_manager(object);
-    /*surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(param[0]);*/ /* ignored */
     double top = surgescript_var_get_number(param[1]);
     double left = surgescript_var_get_number(param[2]);
     double bottom = surgescript_var_get_number(param[3]);
@@ -895,6 +918,23 @@ surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript
         .right = right
     };
 
+    /* skip the search if the ROI intersects the same leaf sectors as before
+       and if no sectors have been allocated since then */
+    if(sector->root == sector) {
+        sectorrect_t leaf_span = find_leaf_span(roi, sector->cached_world_width, sector->cached_world_height);
+
+        if(!(sector->flags & SECTOR_IS_DIRTY) && 0 == memcmp(&leaf_span, &sector->leaf_span, sizeof(leaf_span)))
+            return surgescript_var_set_bool(surgescript_var_create(), false);
+
+        sector->leaf_span = leaf_span;
+        sector->flags &= ~SECTOR_IS_DIRTY;
+
+        /* clear the output array */
+        surgescript_objecthandle_t array_handle = surgescript_var_get_objecthandle(param[0]);
+        surgescript_object_t* array = surgescript_objectmanager_get(manager, array_handle);
+        surgescript_object_call_function(array, "clear", NULL, 0, NULL);
+    }
+
     /* awaken this sector */
     surgescript_object_set_active(object, true);
 
@@ -925,7 +965,7 @@ surgescript_var_t* fun_updateroi(surgescript_object_t* object, const surgescript
     }
 
     /* done */
-    return NULL;
+    return sector->root == sector ? surgescript_var_set_bool(surgescript_var_create(), true) : NULL;
 }
 
 /* leaf-variant of updateROI */
@@ -1034,6 +1074,52 @@ bool point_belongs_to_rect(sectorrect_t r, int x, int y)
     return r.left <= x && x <= r.right && r.top <= y && y <= r.bottom;
 }
 
+/* find the columns (left, right) and the rows (top, bottom) of the leaf sectors that
+   intersect the ROI. Leaf sectors are laid out in a (2^H x 2^H)-grid, H = TREE_HEIGHT */
+sectorrect_t find_leaf_span(sectorrect_t roi, int world_width, int world_height)
+{
+    if(world_width < MIN_WORLD_WIDTH)
+        world_width = MIN_WORLD_WIDTH;
+    if(world_height < MIN_WORLD_HEIGHT)
+        world_height = MIN_WORLD_HEIGHT;
+
+    /* the ROI doesn't intersect the world */
+    sectorrect_t world = { .top = 0, .left = 0, .bottom = world_height - 1, .right = world_width - 1 };
+    if(disjoint_rects(world, roi))
+        return (sectorrect_t){ -1, -1, -1, -1 };
+
+    /* find the span */
+    return (sectorrect_t){
+        .top = find_leaf_coordinate(roi.top, world_height),
+        .left = find_leaf_coordinate(roi.left, world_width),
+        .bottom = find_leaf_coordinate(roi.bottom, world_height),
+        .right = find_leaf_coordinate(roi.right, world_width)
+    };
+}
+
+/* find the column (or the row) of the leaf sector that contains coordinate x
+   of an axis of the world of the given length. This mirrors find_sector_rect() */
+int find_leaf_coordinate(int x, int length)
+{
+    int first = 0, last = length - 1, coordinate = 0;
+
+    x = clip(x, first, last);
+    for(int depth = 0; depth < TREE_HEIGHT; depth++) {
+        int middle = first + (last - first + 2) / 2 - 1;
+
+        if(x <= middle) {
+            last = middle;
+            coordinate = 2 * coordinate;
+        }
+        else {
+            first = middle + 1;
+            coordinate = 2 * coordinate + 1;
+        }
+    }
+
+    return coordinate;
+}
+
 bool is_leaf_sector(int index)
 {
     /*
@@ -1075,6 +1161,10 @@ sector_t* sector_ctor(int index, int world_width, int world_height)
     sector->vt = is_leaf ? &LEAF_VTABLE : &NONLEAF_VTABLE;
     sector->flags = is_leaf ? SECTOR_IS_LEAF : 0;
 
+    sector->root = sector; /* will be changed if this isn't the root */
+    sector->leaf_span = (sectorrect_t){ -1, -1, -1, -1 };
+    sector->flags |= SECTOR_IS_DIRTY;
+
     sector->cached_world_width = 0;
     sector->cached_world_height = 0;
     sector->cached_rect = (sectorrect_t){ 0, 0, 0, 0 };
@@ -1129,6 +1219,9 @@ bool sector_update_rect(sector_t* sector, int world_width, int world_height)
                 sector->child[j].cached_rect = sector->cached_rect;
         }
 
+        /* the intersecting leaf sectors must be searched again */
+        sector->root->flags |= SECTOR_IS_DIRTY;
+
         return true;
     }
 
@@ -1156,6 +1249,10 @@ surgescript_objecthandle_t spawn_child(surgescript_object_t* parent, sectorquadr
 
     int child_index = 1 + 4 * parent_sector->index + quadrant; /* quadrant = 0, 1, 2, 3 */
     sector_t* child_sector = sector_ctor(child_index, world_width, world_height);
+
+    /* a new sector may intersect the ROI */
+    child_sector->root = parent_sector->root;
+    child_sector->root->flags |= SECTOR_IS_DIRTY;
     const char* child_name = (child_sector->flags & SECTOR_IS_LEAF) ? "EntityTreeLeaf" : "EntityTree";
 
     surgescript_objectmanager_t* manager = surgescript_object_manager(parent);
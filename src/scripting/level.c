@@ -71,6 +71,11 @@ static surgescript_var_t* fun_entityid(surgescript_object_t* object, const surge
 static surgescript_var_t* fun_findentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_findentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_activeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_activeentitiesview(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_sleepentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_sleepentityuntil(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_wakeentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_wakeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setup(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getnext(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setnext(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
@@ -172,6 +177,11 @@ void scripting_register_level(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Level", "findEntity", fun_findentity, 1);
     surgescript_vm_bind(vm, "Level", "findEntities", fun_findentities, 1);
     surgescript_vm_bind(vm, "Level", "activeEntities", fun_activeentities, 0);
+    surgescript_vm_bind(vm, "Level", "activeEntitiesView", fun_activeentitiesview, 0);
+    surgescript_vm_bind(vm, "Level", "sleepEntity", fun_sleepentity, 2);
+    surgescript_vm_bind(vm, "Level", "sleepEntityUntil", fun_sleepentityuntil, 2);
+    surgescript_vm_bind(vm, "Level", "wakeEntity", fun_wakeentity, 1);
+    surgescript_vm_bind(vm, "Level", "wakeEntities", fun_wakeentities, 1);
     surgescript_vm_bind(vm, "Level", "setup", fun_setup, 1);
     surgescript_vm_bind(vm, "Level", "get_debugMode", fun_get_debugmode, 0);
     surgescript_vm_bind(vm, "Level", "set_debugMode", fun_set_debugmode, 1);
@@ -782,6 +792,71 @@ surgescript_var_t* fun_activeentities(surgescript_object_t* object, const surges
     return ret;
 }
 
+/* get active entities without allocating: returns a read-only view of them that
+   is valid until the next call. Unlike activeEntities(), the view can't be modified */
+surgescript_var_t* fun_activeentitiesview(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+
+    /* delegate to the entity manager */
+    surgescript_var_t* ret = surgescript_var_create();
+    surgescript_object_call_function(entity_manager, "activeEntitiesView", NULL, 0, ret);
+
+    /* done! */
+    return ret;
+}
+
+/* Level.sleepEntity(entity, seconds): stop updating an entity until the given number of
+   seconds have passed or until one of its colliders touches something. If seconds <= 0,
+   the entity sleeps until it's woken up by a collision or by Level.wakeEntity() */
+surgescript_var_t* fun_sleepentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+
+    /* delegate to the entity manager */
+    surgescript_object_call_function(entity_manager, "sleepEntity", param, 2, NULL);
+
+    /* done! */
+    return NULL;
+}
+
+/* Level.sleepEntityUntil(entity, eventName): stop updating an entity until the given
+   event is fired with Level.wakeEntities() or until one of its colliders touches something */
+surgescript_var_t* fun_sleepentityuntil(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+
+    /* delegate to the entity manager */
+    surgescript_object_call_function(entity_manager, "sleepEntityUntil", param, 2, NULL);
+
+    /* done! */
+    return NULL;
+}
+
+/* Level.wakeEntity(entity): wake up an entity that was put to sleep */
+surgescript_var_t* fun_wakeentity(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+
+    /* delegate to the entity manager */
+    surgescript_object_call_function(entity_manager, "wakeEntity", param, 1, NULL);
+
+    /* done! */
+    return NULL;
+}
+
+/* Level.wakeEntities(eventName): wake up all entities that sleep until the given event */
+surgescript_var_t* fun_wakeentities(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_object_t* entity_manager = get_entity_manager(object);
+
+    /* delegate to the entity manager */
+    surgescript_object_call_function(entity_manager, "wakeEntities", param, 1, NULL);
+
+    /* done! */
+    return NULL;
+}
+
 /* Level.setup(config): configure level entities using a config Dictionary */
 surgescript_var_t* fun_setup(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {
@@ -0,0 +1,148 @@
+/*
+ * Open Surge Engine
+ * renderstats.c - scripting system: rendering statistics
+ * Copyright (C) 2008-2023  Alexandre Martins <alemartf@gmail.com>
+ * http://opensurge2d.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <allegro5/allegro.h>
+#include <surgescript.h>
+#include "../core/renderstats.h"
+#include "../core/asset.h"
+#include "../util/stringutil.h"
+
+/* private */
+static surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getdrawcalls(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getbatches(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getvertices(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_gettexturebinds(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getstatechanges(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_gettargetswitches(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_exportcsv(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_stopcsv(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getexporting(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+
+/*
+ * scripting_register_renderstats()
+ * Register the RenderStats object
+ */
+void scripting_register_renderstats(surgescript_vm_t* vm)
+{
+    surgescript_vm_bind(vm, "RenderStats", "state:main", fun_main, 0);
+    surgescript_vm_bind(vm, "RenderStats", "destroy", fun_destroy, 0);
+    surgescript_vm_bind(vm, "RenderStats", "spawn", fun_spawn, 1);
+    surgescript_vm_bind(vm, "RenderStats", "get_drawCalls", fun_getdrawcalls, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_batches", fun_getbatches, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_vertices", fun_getvertices, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_textureBinds", fun_gettexturebinds, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_stateChanges", fun_getstatechanges, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_targetSwitches", fun_gettargetswitches, 0);
+    surgescript_vm_bind(vm, "RenderStats", "exportCSV", fun_exportcsv, 1);
+    surgescript_vm_bind(vm, "RenderStats", "stopCSV", fun_stopcsv, 0);
+    surgescript_vm_bind(vm, "RenderStats", "get_exporting", fun_getexporting, 0);
+}
+
+/* main state */
+surgescript_var_t* fun_main(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    /* do nothing */
+    return NULL;
+}
+
+/* destroy */
+surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    /* not allowed */
+    return NULL;
+}
+
+/* spawn */
+surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    /* not allowed */
+    return NULL;
+}
+
+/* drawing operations in the last frame */
+surgescript_var_t* fun_getdrawcalls(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_DRAW_CALLS));
+}
+
+/* estimated draw submissions to the GPU in the last frame */
+surgescript_var_t* fun_getbatches(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_BATCHES));
+}
+
+/* submitted vertices in the last frame */
+surgescript_var_t* fun_getvertices(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_VERTICES));
+}
+
+/* estimated texture binds in the last frame */
+surgescript_var_t* fun_gettexturebinds(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_TEXTURE_BINDS));
+}
+
+/* changes of the rendering state in the last frame */
+surgescript_var_t* fun_getstatechanges(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_STATE_CHANGES));
+}
+
+/* changes of the drawing target in the last frame */
+surgescript_var_t* fun_gettargetswitches(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_number(surgescript_var_create(), renderstats_get(RENDERSTAT_TARGET_SWITCHES));
+}
+
+/* exportCSV(filename): export the statistics of each frame to a CSV file
+   stored in the user-modifiable data folder. Returns true on success */
+surgescript_var_t* fun_exportcsv(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    char* filename = surgescript_var_get_string(param[0], surgescript_object_manager(object));
+    char datadir[1024];
+    bool success = false;
+
+    /* we only accept a filename, not a path */
+    ALLEGRO_PATH* path = al_create_path_for_directory(asset_user_datadir(datadir, sizeof(datadir)));
+    al_set_path_filename(path, str_basename(filename));
+    if(*str_basename(filename) != '\0')
+        success = renderstats_start_csv(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+    al_destroy_path(path);
+
+    ssfree(filename);
+    return surgescript_var_set_bool(surgescript_var_create(), success);
+}
+
+/* stopCSV(): stop exporting the statistics */
+surgescript_var_t* fun_stopcsv(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    renderstats_stop_csv();
+    return NULL;
+}
+
+/* are we exporting the statistics to a CSV file? */
+surgescript_var_t* fun_getexporting(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    return surgescript_var_set_bool(surgescript_var_create(), renderstats_is_exporting_csv());
+}
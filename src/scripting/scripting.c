@@ -19,13 +19,19 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_physfs.h>
 #include "scripting.h"
 #include "../core/global.h"
 #include "../core/asset.h"
 #include "../core/video.h"
 #include "../util/v2d.h"
 #include "../util/util.h"
+#include "../util/darray.h"
 #include "../util/stringutil.h"
+#include "../util/fasthash.h"
+#include "../util/djb2.h"
 #include "../scenes/level.h"
 
 /* private area */
@@ -35,12 +41,40 @@ static int vm_argc = 0;
 static bool test_mode = false;
 static int pause_counter = 0;
 static void compile_scripts(surgescript_vm_t* vm);
-static int compile_script(const char* filepath, void* param);
+static bool compile_script(const char* fullpath, const char* script);
 static char* read_file(const char* filepath);
 static bool found_test_script(const surgescript_vm_t* vm);
 static void check_if_compatible();
 static void parse_surgescript_options(surgescript_vm_t* vm, int argc, char** argv);
 
+/* capabilities of the object classes, indexed by the djb2 hash of the object name */
+typedef struct objectclass_t objectclass_t;
+struct objectclass_t {
+    char* name; /* name of the object */
+    uint32_t flags; /* OBJECTCLASS_* flags */
+};
+static fasthash_t* object_class = NULL;
+static uint32_t compute_object_class(const surgescript_object_t* object);
+static void objectclass_dtor(void* ptr);
+
+/* scripts are read in parallel and compiled sequentially */
+#define MAX_READER_THREADS 4
+typedef struct scriptfile_t scriptfile_t;
+typedef struct scriptreader_t scriptreader_t;
+struct scriptfile_t {
+    char* fullpath; /* computed in the calling thread, as asset_path() isn't thread-safe */
+    char* script; /* contents of the file; NULL if it can't be read */
+};
+struct scriptreader_t {
+    scriptfile_t* file; /* the scripts to be read (shared by all readers) */
+    int file_count; /* length of file[] */
+    int first; /* index of the first script read by this thread */
+    int stride; /* number of reader threads */
+};
+STATIC_DARRAY(scriptfile_t, script_file); /* the scripts being compiled */
+static int list_script(const char* filepath, void* param);
+static void* read_scripts(ALLEGRO_THREAD* thread, void* arg);
+
 /* SurgeEngine */
 static void setup_surgeengine(surgescript_vm_t* vm);
 extern void scripting_register_application(surgescript_vm_t* vm);
@@ -70,6 +104,7 @@ extern void scripting_register_platform(surgescript_vm_t* vm);
 extern void scripting_register_player(surgescript_vm_t* vm);
 extern void scripting_register_playermanager(surgescript_vm_t* vm);
 extern void scripting_register_prefs(surgescript_vm_t* vm);
+extern void scripting_register_renderstats(surgescript_vm_t* vm);
 extern void scripting_register_screen(surgescript_vm_t* vm);
 extern void scripting_register_sensor(surgescript_vm_t* vm);
 extern void scripting_register_sound(surgescript_vm_t* vm);
@@ -90,6 +125,9 @@ void scripting_init(int argc, const char** argv)
     check_if_compatible();
     vm = surgescript_vm_create();
 
+    /* the capabilities of the object classes are computed on demand */
+    object_class = fasthash_create(objectclass_dtor, 8);
+
     /* copy command line arguments */
     vm_argv = mallocx((vm_argc = argc) * sizeof(*vm_argv));
     while(argc-- > 0)
@@ -127,6 +165,9 @@ void scripting_release()
 
     /* destroy VM */
     vm = surgescript_vm_destroy(vm);
+
+    /* release the capabilities of the object classes */
+    object_class = fasthash_destroy(object_class);
 }
 
 /*
@@ -174,6 +215,10 @@ void scripting_reload()
         return;
     }
 
+    /* the tags and the functions of the objects may have changed */
+    fasthash_destroy(object_class);
+    object_class = fasthash_create(objectclass_dtor, 8);
+
     /* parse special command-line options that affect the SurgeScript runtime */
     parse_surgescript_options(vm, vm_argc, vm_argv);
 
@@ -285,6 +330,61 @@ float scripting_util_object_zindex(surgescript_object_t* object)
     return zindex;
 }
 
+/* describe a built-in renderable without calling the VM. Returns
+   false if the object isn't a built-in renderable */
+bool scripting_util_describe_renderable(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    static const struct {
+        const char* object_name;
+        void (*describe)(surgescript_object_t*,renderabledesc_t*);
+    } builtin[] = {
+        { "Actor", scripting_actor_describe },
+        { "Text", scripting_text_describe },
+        { "BrickParticles", scripting_brickparticles_describe },
+        { "CollisionBox", scripting_collider_describe },
+        { "CollisionBall", scripting_collider_describe },
+        { "Sensor", scripting_sensor_describe }
+    };
+    const int count = sizeof(builtin) / sizeof(builtin[0]);
+    const char* object_name = surgescript_object_name(object);
+
+    for(int i = 0; i < count; i++) {
+        if(0 == strcmp(object_name, builtin[i].object_name)) {
+            builtin[i].describe(object, desc);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* the OBJECTCLASS_* flags of an object. These are computed once per
+   object class. Loops over entities should use the flags cached in the
+   entity info instead; see entitymanager_get_entity_class() */
+uint32_t scripting_util_object_class(const surgescript_object_t* object)
+{
+    const char* object_name = surgescript_object_name(object);
+    uint64_t key = djb2(object_name);
+    objectclass_t* cls = fasthash_get(object_class, key);
+
+    /* found in the cache */
+    if(cls != NULL) {
+        if(0 == strcmp(cls->name, object_name))
+            return cls->flags;
+
+        /* hash collision; don't cache */
+        return compute_object_class(object);
+    }
+
+    /* first time we see this object class */
+    cls = mallocx(sizeof *cls);
+    cls->name = str_dup(object_name);
+    cls->flags = compute_object_class(object);
+    fasthash_put(object_class, key, cls);
+
+    return cls->flags;
+}
+
 /* the name of the parent object */
 const char* scripting_util_parent_name(const surgescript_object_t* object)
 {
@@ -376,6 +476,41 @@ void check_if_compatible()
         surgescript_util_fatal("This build requires at least SurgeScript %s (using: %s)", SURGESCRIPT_MIN_VERSION, surgescript_util_version());
 }
 
+/* compute the OBJECTCLASS_* flags of an object */
+uint32_t compute_object_class(const surgescript_object_t* object)
+{
+    uint32_t flags = 0;
+
+    if(surgescript_object_has_tag(object, "entity"))
+        flags |= OBJECTCLASS_ENTITY;
+    if(surgescript_object_has_tag(object, "renderable"))
+        flags |= OBJECTCLASS_RENDERABLE;
+    if(surgescript_object_has_tag(object, "gizmo"))
+        flags |= OBJECTCLASS_GIZMO;
+    if(surgescript_object_has_tag(object, "awake"))
+        flags |= OBJECTCLASS_AWAKE;
+    if(surgescript_object_has_tag(object, "detached"))
+        flags |= OBJECTCLASS_DETACHED;
+    if(surgescript_object_has_tag(object, "private"))
+        flags |= OBJECTCLASS_PRIVATE;
+    if(surgescript_object_has_tag(object, "disposable"))
+        flags |= OBJECTCLASS_DISPOSABLE;
+    if(surgescript_object_has_function(object, "lateUpdate"))
+        flags |= OBJECTCLASS_HAS_LATEUPDATE;
+    if(surgescript_object_has_function(object, "onReset"))
+        flags |= OBJECTCLASS_HAS_ONRESET;
+
+    return flags;
+}
+
+/* destroy an objectclass_t */
+void objectclass_dtor(void* ptr)
+{
+    objectclass_t* cls = (objectclass_t*)ptr;
+    free(cls->name);
+    free(cls);
+}
+
 /* register SurgeEngine builtins */
 void setup_surgeengine(surgescript_vm_t* vm)
 {
@@ -409,6 +544,7 @@ void setup_surgeengine(surgescript_vm_t* vm)
     scripting_register_player(vm);
     scripting_register_playermanager(vm);
     scripting_register_prefs(vm);
+    scripting_register_renderstats(vm);
     scripting_register_screen(vm);
     scripting_register_sensor(vm);
     scripting_register_sound(vm);
@@ -423,8 +559,78 @@ void setup_surgeengine(surgescript_vm_t* vm)
 /* compiles all .ss scripts from the scripts/ folder */
 void compile_scripts(surgescript_vm_t* vm)
 {
-    /* compile scripts */
-    asset_foreach_file("scripts", ".ss", compile_script, NULL, true);
+    ALLEGRO_THREAD* thread[MAX_READER_THREADS];
+    scriptreader_t reader[MAX_READER_THREADS];
+    int thread_count = clip(al_get_cpu_count(), 1, MAX_READER_THREADS);
+    double start_time = al_get_time(), listing_time, reading_time, compiling_time;
+    bool success = true;
+
+    /* list the scripts */
+    darray_init(script_file);
+    asset_foreach_file("scripts", ".ss", list_script, NULL, true);
+    listing_time = al_get_time();
+
+    /* read the scripts in parallel. We don't compile them in parallel,
+       because compiling a script modifies the state of the VM */
+    for(int i = 0; i < thread_count; i++) {
+        reader[i].file = script_file;
+        reader[i].file_count = darray_length(script_file);
+        reader[i].first = i;
+        reader[i].stride = thread_count;
+        thread[i] = al_create_thread(read_scripts, &reader[i]);
+
+        /* if we can't create a thread, read its slice on this thread */
+        if(thread[i] != NULL)
+            al_start_thread(thread[i]);
+        else
+            read_scripts(NULL, &reader[i]);
+    }
+
+    for(int i = 0; i < thread_count; i++) {
+        if(thread[i] != NULL)
+            al_destroy_thread(thread[i]); /* joins the thread */
+    }
+
+    reading_time = al_get_time();
+
+    /* compile the scripts in order. Note: compiled programs aren't cached
+       across launches, because SurgeScript has no API for serializing the
+       programs of its program pool (nor the tags registered by the parser) */
+    for(int i = 0; i < darray_length(script_file) && success; i++) {
+        scriptfile_t* file = &(script_file[i]);
+
+        if(file->script != NULL)
+            success = compile_script(file->fullpath, file->script);
+        else
+            success = false;
+    }
+
+    compiling_time = al_get_time();
+
+    /* log the timings */
+    surgescript_util_log("Compiled %d scripts in %.3f seconds (listing: %.3fs, reading: %.3fs with %d thread%s, compiling: %.3fs)",
+        darray_length(script_file),
+        compiling_time - start_time,
+        listing_time - start_time,
+        reading_time - listing_time, thread_count, thread_count != 1 ? "s" : "",
+        compiling_time - reading_time
+    );
+
+    /* release the scripts; report errors after that */
+    char error_path[1024] = "";
+    for(int i = darray_length(script_file) - 1; i >= 0; i--) {
+        scriptfile_t* file = &(script_file[i]);
+
+        if(file->script == NULL)
+            str_cpy(error_path, file->fullpath, sizeof(error_path));
+
+        free(file->script);
+        free(file->fullpath);
+    }
+    darray_release(script_file);
+
+    if(*error_path != '\0')
+        surgescript_util_fatal("Can't read file \"%s\"", error_path);
 
     /* if no test script is present... */
     if(found_test_script(vm)) {
@@ -437,22 +643,37 @@ void compile_scripts(surgescript_vm_t* vm)
     }
 }
 
-/* compile a .ss script from the scripts/ folder */
-int compile_script(const char* filepath, void* param)
+/* compile a .ss script that has been read */
+bool compile_script(const char* fullpath, const char* script)
+{
+    surgescript_util_log("Compiling script %s...", fullpath);
+    return surgescript_vm_compile_virtual_file(vm, script, fullpath);
+}
+
+/* add a .ss script from the scripts/ folder to the list of scripts to be read */
+int list_script(const char* filepath, void* param)
 {
-    const char* fullpath = asset_path(filepath);
+    scriptfile_t file = { .fullpath = str_dup(asset_path(filepath)), .script = NULL };
 
-    /* read script */
-    char* script = read_file(fullpath);
-    if(script == NULL)
-        return -1;
+    darray_push(script_file, file);
+    return 0;
+}
+
+/* reader thread: reads every stride-th script of the list */
+void* read_scripts(ALLEGRO_THREAD* thread, void* arg)
+{
+    scriptreader_t* reader = (scriptreader_t*)arg;
 
-    /* compile script */
-    bool success = surgescript_vm_compile_virtual_file(vm, script, fullpath);
+    /* use the physfs file interface in this thread */
+    al_set_physfs_file_interface();
 
-    /* done! */
-    free(script);
-    return success ? 0 : -1;
+    /* read the scripts; each script is read by a single thread */
+    for(int i = reader->first; i < reader->file_count; i += reader->stride)
+        reader->file[i].script = read_file(reader->file[i].fullpath);
+
+    /* done */
+    (void)thread;
+    return NULL;
 }
 
 /* do we have a test script? (that is, did the user write his/her own "Application" object?) */
@@ -462,7 +683,8 @@ bool found_test_script(const surgescript_vm_t* vm)
     return surgescript_programpool_exists(pool, "Application", "state:main");
 }
 
-/* reads a file using Allegro's File I/O interface */
+/* reads a file using Allegro's File I/O interface; returns NULL on error.
+   This may be called from any thread */
 char* read_file(const char* filepath)
 {
     const size_t BUFSIZE = 4096;
@@ -471,13 +693,10 @@ char* read_file(const char* filepath)
 
     /* open the file in binary mode, so that offsets don't get messed up */
     ALLEGRO_FILE* fp = al_fopen(filepath, "rb");
-    if(!fp) {
-        surgescript_util_fatal("Can't read file \"%s\". errno = %d", filepath, al_get_errno());
+    if(!fp)
         return NULL;
-    }
 
     /* read file to data[] */
-    surgescript_util_log("Reading script %s...", filepath);
     do {
         data_size += BUFSIZE;
         data = reallocx(data, data_size + 1);
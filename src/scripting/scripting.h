@@ -21,6 +21,7 @@
 #ifndef _SCRIPTING_H
 #define _SCRIPTING_H
 
+#include <stdint.h>
 #include <surgescript.h>
 #include "util/iterators.h"
 #include "../util/v2d.h"
@@ -38,6 +39,29 @@ void scripting_resume_vm();
 
 bool scripting_testmode();
 
+/* a descriptor of a built-in renderable, read by the render queue without calling the VM */
+typedef struct renderabledesc_t renderabledesc_t;
+struct renderabledesc_t {
+    bool visible; /* is the renderable visible? */
+    float zindex; /* the zindex of the renderable */
+    bool has_texture; /* is there a texture handle? */
+    uint32_t texture; /* texture handle (texturehandle_t), if has_texture is true */
+    bool is_translucent; /* is the renderable translucent? */
+};
+
+/* capabilities of an object class, computed once per class */
+enum {
+    OBJECTCLASS_ENTITY = 0x1, /* tagged "entity" */
+    OBJECTCLASS_RENDERABLE = 0x2, /* tagged "renderable" */
+    OBJECTCLASS_GIZMO = 0x4, /* tagged "gizmo" */
+    OBJECTCLASS_AWAKE = 0x8, /* tagged "awake" */
+    OBJECTCLASS_DETACHED = 0x10, /* tagged "detached" */
+    OBJECTCLASS_PRIVATE = 0x20, /* tagged "private" */
+    OBJECTCLASS_DISPOSABLE = 0x40, /* tagged "disposable" */
+    OBJECTCLASS_HAS_LATEUPDATE = 0x80, /* implements lateUpdate() */
+    OBJECTCLASS_HAS_ONRESET = 0x100 /* implements onReset() */
+};
+
 /* scripting utilities */
 surgescript_objecthandle_t scripting_util_require_component(const surgescript_object_t* object, const char* component_name);
 v2d_t scripting_util_world_position(const surgescript_object_t* object);
@@ -46,6 +70,8 @@ void scripting_util_set_world_position(surgescript_object_t* object, v2d_t posit
 void scripting_util_set_world_angle(surgescript_object_t* object, float angle);
 int scripting_util_is_object_inside_screen(const surgescript_object_t* object);
 float scripting_util_object_zindex(surgescript_object_t* object);
+bool scripting_util_describe_renderable(surgescript_object_t* object, renderabledesc_t* desc); /* returns false if the object isn't a built-in renderable */
+uint32_t scripting_util_object_class(const surgescript_object_t* object); /* the OBJECTCLASS_* flags of the object */
 const char* scripting_util_parent_name(const surgescript_object_t* object);
 surgescript_object_t* scripting_util_surgeengine_object(surgescript_vm_t* vm);
 surgescript_object_t* scripting_util_surgeengine_component(surgescript_vm_t* vm, const char* component_name);
@@ -67,6 +93,12 @@ extern void scripting_vector2_read(const surgescript_object_t* object, double* x
 extern v2d_t scripting_vector2_to_v2d(const surgescript_object_t* object);
 
 extern struct actor_t* scripting_actor_ptr(const surgescript_object_t* object);
+extern void scripting_actor_describe(surgescript_object_t* object, renderabledesc_t* desc);
+extern void scripting_text_describe(surgescript_object_t* object, renderabledesc_t* desc);
+extern void scripting_brickparticles_describe(surgescript_object_t* object, renderabledesc_t* desc);
+extern void scripting_collider_describe(surgescript_object_t* object, renderabledesc_t* desc);
+extern bool scripting_collider_poll(surgescript_object_t* object);
+extern void scripting_sensor_describe(surgescript_object_t* object, renderabledesc_t* desc);
 extern struct player_t* scripting_player_ptr(const surgescript_object_t* object);
 extern struct music_t* scripting_music_ptr(const surgescript_object_t* object);
 
@@ -81,6 +113,8 @@ extern struct collisionmask_t* scripting_brick_mask(const surgescript_object_t*
 
 extern const struct obstaclemap_t* scripting_obstaclemap_ptr(const surgescript_object_t* object);
 
+extern void scripting_brickparticles_emit(surgescript_object_t* emitter, int brick_id, int src_x, int src_y, int width, int height, v2d_t position, v2d_t velocity);
+
 extern iterator_t* scripting_levelobjectcontainer_iterator(surgescript_object_t* container);
 extern void* scripting_levelobjectcontainer_token();
 
@@ -93,14 +127,19 @@ extern void entitymanager_remove_entity_info(surgescript_object_t* entity_manage
 extern surgescript_objecthandle_t entitymanager_find_entity_by_id(surgescript_object_t* entity_manager, uint64_t entity_id);
 extern uint64_t entitymanager_get_entity_id(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern void entitymanager_set_entity_id(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, uint64_t entity_id);
+extern uint32_t entitymanager_get_entity_class(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern v2d_t entitymanager_get_entity_spawn_point(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern bool entitymanager_is_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern void entitymanager_set_entity_persistent(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_persistent);
 extern bool entitymanager_is_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern void entitymanager_set_entity_sleeping(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle, bool is_sleeping);
+extern bool entitymanager_is_entity_dormant(surgescript_object_t* entity_manager, surgescript_objecthandle_t entity_handle);
 extern bool entitymanager_is_inside_roi(surgescript_object_t* entity_manager, v2d_t position);
 extern void entitymanager_get_roi(surgescript_object_t* entity_manager, int* top, int* left, int* bottom, int* right);
 extern iterator_t* entitymanager_bricklike_iterator(surgescript_object_t* entity_manager);
 extern iterator_t* entitymanager_activeentities_iterator(surgescript_object_t* entity_manager);
 
+extern bool entitytree_sector_contains_entity(surgescript_object_t* tree_node, surgescript_object_t* entity);
+extern void entitycontainer_select_active_entities(surgescript_object_t* entity_container, bool skip_inactive_entities, void (*callback)(surgescript_objecthandle_t,void*), void* data);
+
 #endif
\ No newline at end of file
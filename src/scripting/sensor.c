@@ -86,6 +86,22 @@ void scripting_register_sensor(surgescript_vm_t* vm)
 }
 
 
+/*
+ * scripting_sensor_describe()
+ * Describes a Sensor to the render queue
+ */
+void scripting_sensor_describe(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+
+    desc->visible = surgescript_var_get_bool(surgescript_heap_at(heap, VISIBLE_ADDR));
+    desc->zindex = LARGE_INT; /* see fun_getzindex() */
+    desc->has_texture = false;
+    desc->texture = 0;
+    desc->is_translucent = false;
+}
+
+
 /* private */
 
 /* constructor */
@@ -110,6 +110,23 @@ void scripting_register_text(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Text", "get___isTranslucent", fun_getistranslucent, 0);
 }
 
+/*
+ * scripting_text_describe()
+ * Describes a Text to the render queue
+ */
+void scripting_text_describe(surgescript_object_t* object, renderabledesc_t* desc)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    const font_t* font = get_font(object);
+    const image_t* image = (font != NULL) ? font_get_image(font) : NULL;
+
+    desc->visible = surgescript_var_get_bool(surgescript_heap_at(heap, VISIBLE_ADDR));
+    desc->zindex = surgescript_var_get_number(surgescript_heap_at(heap, ZINDEX_ADDR));
+    desc->has_texture = (image != NULL); /* is this a bitmap font? */
+    desc->texture = (image != NULL) ? image_texture(image) : 0;
+    desc->is_translucent = (font != NULL) && (image == NULL); /* see fun_getistranslucent() */
+}
+
 /*
  * scripting_text_fontptr()
  * Returns the font_t* associated with the given SurgeScript Text object
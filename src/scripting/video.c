@@ -30,11 +30,13 @@ static surgescript_var_t* fun_destructor(surgescript_object_t* object, const sur
 static surgescript_var_t* fun_destroy(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_spawn(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getscreen(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
+static surgescript_var_t* fun_getstats(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getfullscreen(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setfullscreen(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_getmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static surgescript_var_t* fun_setmode(surgescript_object_t* object, const surgescript_var_t** param, int num_params);
 static const surgescript_heapptr_t SCREEN_ADDR = 0;
+static const surgescript_heapptr_t STATS_ADDR = 1;
 
 /*
  * scripting_register_video()
@@ -48,6 +50,7 @@ void scripting_register_video(surgescript_vm_t* vm)
     surgescript_vm_bind(vm, "Video", "destroy", fun_destroy, 0);
     surgescript_vm_bind(vm, "Video", "spawn", fun_spawn, 1);
     surgescript_vm_bind(vm, "Video", "get_Screen", fun_getscreen, 0);
+    surgescript_vm_bind(vm, "Video", "get_stats", fun_getstats, 0);
     surgescript_vm_bind(vm, "Video", "get_fullscreen", fun_getfullscreen, 0);
     surgescript_vm_bind(vm, "Video", "set_fullscreen", fun_setfullscreen, 1);
     surgescript_vm_bind(vm, "Video", "get_mode", fun_getmode, 0);
@@ -66,11 +69,15 @@ surgescript_var_t* fun_constructor(surgescript_object_t* object, const surgescri
 
     /* allocate variables */
     ssassert(SCREEN_ADDR == surgescript_heap_malloc(heap));
+    ssassert(STATS_ADDR == surgescript_heap_malloc(heap));
 
     /* internal data */
     surgescript_var_set_objecthandle(surgescript_heap_at(heap, SCREEN_ADDR),
         surgescript_objectmanager_spawn(manager, me, "Screen", NULL)
     );
+    surgescript_var_set_objecthandle(surgescript_heap_at(heap, STATS_ADDR),
+        surgescript_objectmanager_spawn(manager, me, "RenderStats", NULL)
+    );
 
     /* done! */
     return NULL;
@@ -111,6 +118,13 @@ surgescript_var_t* fun_getscreen(surgescript_object_t* object, const surgescript
     return surgescript_var_clone(surgescript_heap_at(heap, SCREEN_ADDR));
 }
 
+/* get the RenderStats object */
+surgescript_var_t* fun_getstats(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
+{
+    surgescript_heap_t* heap = surgescript_object_heap(object);
+    return surgescript_var_clone(surgescript_heap_at(heap, STATS_ADDR));
+}
+
 /* is the engine running on fullscreen mode? */
 surgescript_var_t* fun_getfullscreen(surgescript_object_t* object, const surgescript_var_t** param, int num_params)
 {